@@ -1,5 +1,19 @@
 #include <iostream>
+#include <iomanip>
 #include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <memory>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include "BenchmarkHarness.h"
+#include "NetworkSimulator.h"
 using namespace std;
 
 class Process {
@@ -25,7 +39,717 @@ void printClocks(vector<Process>& processes) {
     }
 }
 
-int main() {
+// A Process on the discrete-event simulator. The clock rules are the ones in
+// Process, but the message travels over the simulated network instead of being
+// a direct call. The node sends `budget` messages in total: the first to the
+// next process at start-up, then one to a random process after each message it
+// receives. `peers` is the number of nodes in its simulation.
+class LamportNode : public SimNode {
+public:
+    Process process;
+    long long budget;
+    int peers;
+
+    LamportNode(int id, long long budget, int peers) : process(id), budget(budget), peers(peers) {}
+
+    void onStart(SimContext &ctx) override {
+        send(ctx, (ctx.self() + 1) % peers);
+    }
+
+    void onMessage(SimContext &ctx, const SimMessage &msg) override {
+        process.receiveMessage(msg.a);
+        send(ctx, ctx.rng()() % peers);
+    }
+
+private:
+    void send(SimContext &ctx, int to) {
+        if (budget <= 0) {
+            return;
+        }
+        budget--;
+        process.logicalClock++;
+        ctx.send(to, 0, process.logicalClock);
+    }
+};
+
+SimStats runLamportSimulation(vector<LamportNode> &nodes, LinkModel &link, int partitions) {
+    NetworkSimulator sim(link, partitions, 42);
+    for (LamportNode &node : nodes) {
+        sim.addNode(&node);
+    }
+    return sim.run();
+}
+
+void benchmarkLamportSimulation(int n, long long perProcess, int linkChoice, int maxPartitions) {
+    cout << "\n" << n << " processes, " << perProcess << " messages each\n";
+    cout << setw(12) << "partitions" << setw(14) << "events" << setw(12) << "wall ms" << setw(16) << "Mevents/sec"
+         << setw(16) << "sim time (ms)" << setw(12) << "max clock" << "\n";
+    for (int partitions = 1; partitions <= maxPartitions; partitions *= 2) {
+        LinkModelChoice link(linkChoice, 1000);
+        vector<LamportNode> nodes;
+        nodes.reserve(n);
+        for (int i = 0; i < n; i++) {
+            nodes.emplace_back(i + 1, perProcess, n);
+        }
+        SimStats stats = runLamportSimulation(nodes, link.get(), partitions);
+        int maxClock = 0;
+        for (LamportNode &node : nodes) {
+            maxClock = max(maxClock, node.process.logicalClock);
+        }
+        cout << setw(12) << partitions << setw(14) << stats.events << setw(12) << fixed << setprecision(1)
+             << stats.wallMs << setw(16) << setprecision(2) << stats.events / stats.wallMs / 1000 << setw(16)
+             << setprecision(3) << stats.endTimeNs / 1e6 << setw(12) << maxClock << "\n";
+    }
+}
+
+// Application state that makes snapshots non-trivial: a ledger of 64-bit
+// words in 4 KB pages. Pages are shared with snapshots that were taken while
+// they were unchanged, and a page is copied the first time it is written
+// while a snapshot still holds it (copy-on-write), so taking a snapshot costs
+// one pointer per page instead of a copy of the state.
+struct LedgerPage {
+    static const int WORDS = 512;
+    long long words[WORDS];
+
+    // Pages alive in the process and the most there have been since
+    // resetPeak(), so the benchmark can report what snapshots keep alive.
+    static atomic<long long> live, peak;
+
+    LedgerPage() { counted(); }
+    LedgerPage(const LedgerPage &other) {
+        memcpy(words, other.words, sizeof(words));
+        counted();
+    }
+    ~LedgerPage() { live--; }
+
+    static void resetPeak() { peak = live.load(); }
+
+private:
+    static void counted() {
+        long long now = ++live;
+        long long seen = peak.load();
+        while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+        }
+    }
+};
+
+atomic<long long> LedgerPage::live(0), LedgerPage::peak(0);
+
+class Ledger {
+public:
+    explicit Ledger(int words) {
+        for (int i = 0; i < (words + LedgerPage::WORDS - 1) / LedgerPage::WORDS; i++) {
+            pages.push_back(make_shared<LedgerPage>());
+            fill(begin(pages.back()->words), end(pages.back()->words), 0);
+        }
+    }
+
+    void add(size_t word, long long delta) {
+        shared_ptr<LedgerPage> &page = pages[word / LedgerPage::WORDS % pages.size()];
+        // A count of 1 means no snapshot or writer still holds the page. The
+        // writer drops its reference only after it has written the page, and
+        // the fence orders that before our write.
+        if (page.use_count() > 1) {
+            page = make_shared<LedgerPage>(*page);
+            copiedPages++;
+        }
+        atomic_thread_fence(memory_order_acquire);
+        page->words[word % LedgerPage::WORDS] += delta;
+    }
+
+    // The pages as they are now, shared with the live ledger.
+    vector<shared_ptr<const LedgerPage>> share() const {
+        return vector<shared_ptr<const LedgerPage>>(pages.begin(), pages.end());
+    }
+
+    // A private copy of every page.
+    vector<shared_ptr<const LedgerPage>> copyAll() const {
+        vector<shared_ptr<const LedgerPage>> copy;
+        for (const shared_ptr<LedgerPage> &page : pages) {
+            copy.push_back(make_shared<LedgerPage>(*page));
+        }
+        return copy;
+    }
+
+    long long copiedPages = 0;
+
+private:
+    vector<shared_ptr<LedgerPage>> pages;
+};
+
+// A message that was in flight on a channel when the snapshot cut it.
+struct RecordedMessage {
+    long long clock;
+    long long amount;
+};
+
+// One process's part of a global snapshot: its state when it recorded it and
+// the messages that arrived on each incoming channel between then and the
+// marker on that channel.
+struct SnapshotPiece {
+    int snapshot = 0;
+    int node = 0;
+    int clock = 0;
+    long long balance = 0;
+    vector<long long> sent;       // per outgoing channel, messages sent before the cut
+    vector<long long> received;   // per incoming channel, messages received before the cut
+    const vector<int> *inChannels = nullptr;  // global ids of the incoming channels
+    vector<shared_ptr<const LedgerPage>> pages;
+    vector<vector<RecordedMessage>> channels;  // per incoming channel
+};
+
+struct SnapshotOptions {
+    bool enabled = false;
+    bool copyOnWrite = true;   // share ledger pages instead of copying them when recording
+    bool async = true;         // write pieces on a background thread instead of in the handler
+    uint64_t intervalNs = 100000;
+    int maxSnapshots = 1000;
+};
+
+// Collects the pieces of every snapshot, checks each completed snapshot for
+// consistency and writes the pieces to a file. With async, pieces go through
+// a queue to a writer thread, so a handler only pays for the hand-off.
+//
+// A page that is the same object as in the node's previous snapshot has not
+// been written since, so only its index is stored: with copy-on-write the
+// file grows by the pages that changed, not by the whole state. The store
+// keeps the pages of each node's last written piece for that comparison,
+// which also keeps their addresses from being reused while it matters. The
+// price is that the ledger copies every page on its first write after each
+// snapshot, and up to one old copy of the state per node stays alive.
+class SnapshotStore {
+public:
+    SnapshotStore(const string &path, int nodes, int channels, long long totalMoney, bool async)
+        : out(path, ios::binary | ios::trunc), nodes(nodes), channelCount(channels), totalMoney(totalMoney),
+          async(async), lastPages(nodes) {
+        if (async) {
+            writer = thread(&SnapshotStore::writeLoop, this);
+        }
+    }
+
+    ~SnapshotStore() { finish(); }
+
+    // Called by a node when its piece is complete. Thread-safe.
+    void submit(const shared_ptr<SnapshotPiece> &piece) {
+        unique_lock<mutex> lock(m);
+        check(*piece);
+        if (!async) {
+            write(*piece);
+            return;
+        }
+        queue.push_back(piece);
+        ready.notify_one();
+    }
+
+    // Waits until every submitted piece is written.
+    void finish() {
+        {
+            unique_lock<mutex> lock(m);
+            done = true;
+            ready.notify_one();
+        }
+        if (writer.joinable()) {
+            writer.join();
+        }
+        out.flush();
+    }
+
+    int completed = 0, consistent = 0;
+    long long bytesWritten = 0, pagesWritten = 0, pagesSkipped = 0, recordedMessages = 0;
+
+private:
+    struct Progress {
+        int pieces = 0;
+        long long money = 0;
+        vector<long long> channelDelta;  // sent - received - recorded, per channel
+    };
+
+    // A snapshot is consistent if no money was created or lost and every
+    // channel satisfies sent = received + recorded at the cut.
+    void check(const SnapshotPiece &piece) {
+        Progress &p = progress[piece.snapshot];
+        if (p.channelDelta.empty()) {
+            p.channelDelta.assign(channelCount, 0);
+        }
+        p.pieces++;
+        p.money += piece.balance;
+        int outDegree = piece.sent.size();
+        for (int k = 0; k < outDegree; k++) {
+            p.channelDelta[piece.node * outDegree + k] += piece.sent[k];
+        }
+        for (size_t c = 0; c < piece.channels.size(); c++) {
+            int channel = (*piece.inChannels)[c];
+            p.channelDelta[channel] -= piece.received[c] + piece.channels[c].size();
+            for (const RecordedMessage &msg : piece.channels[c]) {
+                p.money += msg.amount;
+            }
+            recordedMessages += piece.channels[c].size();
+        }
+        if (p.pieces == nodes) {
+            completed++;
+            bool ok = p.money == totalMoney;
+            for (long long delta : p.channelDelta) {
+                ok = ok && delta == 0;
+            }
+            consistent += ok;
+            progress.erase(piece.snapshot);
+        }
+    }
+
+    void put(const void *data, size_t size) {
+        out.write(static_cast<const char *>(data), size);
+        bytesWritten += size;
+    }
+
+    void write(const SnapshotPiece &piece) {
+        long long header[6] = { piece.snapshot, piece.node, piece.clock, piece.balance, (long long)piece.pages.size(),
+                                (long long)piece.channels.size() };
+        put(header, sizeof(header));
+        put(piece.sent.data(), piece.sent.size() * sizeof(long long));
+        put(piece.received.data(), piece.received.size() * sizeof(long long));
+        vector<shared_ptr<const LedgerPage>> &last = lastPages[piece.node];
+        for (size_t i = 0; i < piece.pages.size(); i++) {
+            bool unchanged = i < last.size() && last[i] == piece.pages[i];
+            long long tag = unchanged ? -1 : (long long)i;
+            put(&tag, sizeof(tag));
+            if (unchanged) {
+                pagesSkipped++;
+            } else {
+                put(piece.pages[i]->words, sizeof(LedgerPage));
+                pagesWritten++;
+            }
+        }
+        for (const vector<RecordedMessage> &channel : piece.channels) {
+            long long count = channel.size();
+            put(&count, sizeof(count));
+            put(channel.data(), channel.size() * sizeof(RecordedMessage));
+        }
+        last = piece.pages;
+    }
+
+    void writeLoop() {
+        unique_lock<mutex> lock(m);
+        while (true) {
+            ready.wait(lock, [&]() { return done || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            shared_ptr<SnapshotPiece> piece = queue.front();
+            queue.pop_front();
+            lock.unlock();
+            write(*piece);
+            piece.reset();  // lastPages still holds this piece's pages until the node's next piece
+            lock.lock();
+        }
+    }
+
+    ofstream out;
+    int nodes, channelCount;
+    long long totalMoney;
+    bool async, done = false;
+    mutex m;
+    condition_variable ready;
+    deque<shared_ptr<SnapshotPiece>> queue;
+    map<int, Progress> progress;
+    vector<vector<shared_ptr<const LedgerPage>>> lastPages;  // per node, only touched by the writer
+    thread writer;
+};
+
+// A Lamport process that moves money to its neighbours and takes part in
+// Chandy-Lamport snapshots. Each node sends to a fixed set of out-neighbours
+// (the next node on the ring plus random chords), so a snapshot needs one
+// marker per channel rather than n^2. Every message carries the sender's
+// clock and an amount, which moves to the receiver's balance and is booked on
+// both sides in the ledger account of the other process. A process only
+// talks to its neighbours, so it touches a few ledger pages between
+// snapshots. Channels must be FIFO (FifoLink), or a message sent after a
+// marker could be received before it.
+//
+// Node 0 starts a snapshot every intervalNs of simulated time: it records its
+// state and sends a marker on every outgoing channel. A node that gets its
+// first marker of a snapshot does the same; from then until the marker
+// arrives on an incoming channel, the messages on that channel are recorded
+// as in flight. When markers have come in on all incoming channels, the piece
+// goes to the SnapshotStore. The application keeps running throughout.
+class SnapshotNode : public SimNode {
+public:
+    enum { APP = 0, MARKER = 1, TAKE_SNAPSHOT = 2 };
+
+    Process process;
+    long long budget;
+    long long balance;
+    Ledger ledger;
+    vector<int> out, in;          // neighbour ids; `in` is sorted
+    vector<int> inChannels;       // global channel id of each incoming channel
+    vector<long long> sent, received;
+    long long delivered = 0, markers = 0;
+
+    SnapshotNode(int id, long long budget, long long balance, int ledgerWords, const SnapshotOptions &options,
+                 SnapshotStore *store)
+        : process(id), budget(budget), balance(balance), ledger(ledgerWords), options(options), store(store) {}
+
+    // Call once all nodes have their out-neighbours: fills in the incoming
+    // channels of every node. Channel k of node i has id i * degree + k.
+    static void connect(vector<SnapshotNode> &nodes) {
+        for (size_t i = 0; i < nodes.size(); i++) {
+            for (int j : nodes[i].out) {
+                nodes[j].in.push_back(i);
+            }
+        }
+        for (size_t j = 0; j < nodes.size(); j++) {
+            SnapshotNode &node = nodes[j];
+            sort(node.in.begin(), node.in.end());
+            for (int i : node.in) {
+                const vector<int> &out = nodes[i].out;
+                node.inChannels.push_back(i * out.size() + (std::find(out.begin(), out.end(), j) - out.begin()));
+            }
+            node.sent.assign(node.out.size(), 0);
+            node.received.assign(node.in.size(), 0);
+        }
+    }
+
+    void onStart(SimContext &ctx) override {
+        send(ctx);
+        if (ctx.self() == 0 && options.enabled) {
+            ctx.schedule(options.intervalNs, TAKE_SNAPSHOT, 1);
+        }
+    }
+
+    void onMessage(SimContext &ctx, const SimMessage &msg) override {
+        if (msg.type == TAKE_SNAPSHOT) {
+            // Stop once the application has gone quiet here: no message
+            // since the previous snapshot.
+            if (msg.a > 1 && delivered == deliveredAtLastSnapshot) {
+                return;
+            }
+            deliveredAtLastSnapshot = delivered;
+            record(ctx, msg.a);
+            if (msg.a < options.maxSnapshots) {
+                ctx.schedule(options.intervalNs, TAKE_SNAPSHOT, msg.a + 1);
+            }
+            return;
+        }
+        int channel = lower_bound(in.begin(), in.end(), msg.from) - in.begin();
+        if (msg.type == MARKER) {
+            markers++;
+            Active *s = find(msg.a);
+            if (!s) {
+                s = record(ctx, msg.a);
+            }
+            if (s->recording[channel]) {
+                s->recording[channel] = 0;
+                s->pending--;
+            }
+            finishIfComplete(msg.a);
+            return;
+        }
+
+        for (Active &s : active) {
+            if (s.recording[channel]) {
+                s.piece->channels[channel].push_back({ msg.a, msg.b });
+            }
+        }
+        received[channel]++;
+        delivered++;
+        balance += msg.b;
+        process.receiveMessage(msg.a);
+        ledger.add(account(msg.from), msg.b);
+        send(ctx);
+    }
+
+private:
+    struct Active {
+        int snapshot;
+        shared_ptr<SnapshotPiece> piece;
+        vector<char> recording;   // per incoming channel
+        int pending;              // incoming channels still waiting for the marker
+    };
+
+    void send(SimContext &ctx) {
+        if (budget <= 0) {
+            return;
+        }
+        budget--;
+        int k = ctx.rng()() % out.size();
+        long long amount = min<long long>(balance, 1 + ctx.rng()() % 10);
+        balance -= amount;
+        sent[k]++;
+        process.logicalClock++;
+        ledger.add(account(out[k]), -amount);
+        ctx.send(out[k], APP, process.logicalClock, amount);
+    }
+
+    // Ledger word that holds the account of a peer.
+    static size_t account(int peer) { return (uint64_t)(peer + 1) * 0x9E3779B97F4A7C15ULL >> 24; }
+
+    Active *find(int snapshot) {
+        for (Active &s : active) {
+            if (s.snapshot == snapshot) {
+                return &s;
+            }
+        }
+        return nullptr;
+    }
+
+    // Records the local state for `snapshot` and sends its markers.
+    Active *record(SimContext &ctx, int snapshot) {
+        shared_ptr<SnapshotPiece> piece = make_shared<SnapshotPiece>();
+        piece->snapshot = snapshot;
+        piece->node = ctx.self();
+        piece->clock = process.logicalClock;
+        piece->balance = balance;
+        piece->sent = sent;
+        piece->received = received;
+        piece->inChannels = &inChannels;
+        piece->pages = options.copyOnWrite ? ledger.share() : ledger.copyAll();
+        piece->channels.resize(in.size());
+        active.push_back({ snapshot, piece, vector<char>(in.size(), 1), (int)in.size() });
+        for (int to : out) {
+            ctx.send(to, MARKER, snapshot);
+        }
+        finishIfComplete(snapshot);
+        return find(snapshot);
+    }
+
+    void finishIfComplete(int snapshot) {
+        Active *s = find(snapshot);
+        if (s && s->pending == 0) {
+            store->submit(s->piece);
+            active.erase(active.begin() + (s - active.data()));
+        }
+    }
+
+    SnapshotOptions options;
+    SnapshotStore *store;
+    vector<Active> active;
+    long long deliveredAtLastSnapshot = 0;
+};
+
+struct SnapshotRunResult {
+    SimStats stats;
+    long long delivered = 0, markers = 0, copiedPages = 0;
+};
+
+// n processes with `degree` out-neighbours each, FIFO jittered links of 1 us
+// on average. The same seed gives every run the same topology.
+SnapshotRunResult runSnapshotSimulation(int n, long long perProcess, int degree, int ledgerWords,
+                                        const SnapshotOptions &options, SnapshotStore *store, int partitions) {
+    JitterLink jitter(500, 1500);
+    FifoLink link(jitter);
+    vector<SnapshotNode> nodes;
+    nodes.reserve(n);
+    for (int i = 0; i < n; i++) {
+        nodes.emplace_back(i + 1, perProcess, 1000, ledgerWords, options, store);
+    }
+    mt19937 rng(99);
+    degree = min(degree, n - 1);
+    for (int i = 0; i < n; i++) {
+        vector<int> &out = nodes[i].out;
+        out.push_back((i + 1) % n);
+        while ((int)out.size() < degree) {
+            int j = rng() % n;
+            if (j != i && std::find(out.begin(), out.end(), j) == out.end()) {
+                out.push_back(j);
+            }
+        }
+    }
+    SnapshotNode::connect(nodes);
+
+    NetworkSimulator sim(link, partitions, 42);
+    for (SnapshotNode &node : nodes) {
+        sim.addNode(&node);
+    }
+    SnapshotRunResult result;
+    result.stats = sim.run();
+    for (SnapshotNode &node : nodes) {
+        result.delivered += node.delivered;
+        result.markers += node.markers;
+        result.copiedPages += node.ledger.copiedPages;
+    }
+    return result;
+}
+
+// Runs the same workload without snapshots, then with snapshots taken by a
+// full copy written in the handler, by copy-on-write written in the handler,
+// and by copy-on-write written by the background thread, and reports the
+// message throughput of each against the run without snapshots. Wall time
+// includes waiting for the writer to finish.
+void benchmarkSnapshots(int n, long long perProcess, int degree, int ledgerWords, double intervalUs,
+                        const string &path, int partitions) {
+    struct Variant {
+        const char *name;
+        bool enabled, copyOnWrite, async;
+    };
+    const Variant variants[] = {
+        { "no snapshots", false, true, true },
+        { "full copy, sync write", true, false, false },
+        { "COW, sync write", true, true, false },
+        { "COW, async write", true, true, true },
+    };
+
+    cout << "\n" << n << " processes, " << degree << " channels each, " << perProcess << " messages each, "
+         << ledgerWords * 8 / 1024 << " KB ledger per process, snapshot every " << intervalUs << " us\n";
+    cout << setw(24) << "mode" << setw(11) << "wall ms" << setw(13) << "Mmsgs/sec" << setw(9) << "drop %"
+         << setw(11) << "snapshots" << setw(12) << "consistent" << setw(10) << "markers" << setw(11) << "in flight"
+         << setw(13) << "pages copied" << setw(12) << "MB written" << setw(11) << "held MB" << "\n";
+    {
+        // Untimed warm-up, so the baseline does not pay for first-touch page
+        // faults that the later variants get for free.
+        SnapshotStore store(path, n, n * min(degree, n - 1), 1000LL * n, false);
+        runSnapshotSimulation(n, perProcess, degree, ledgerWords, SnapshotOptions(), &store, partitions);
+        store.finish();
+    }
+    double baseline = 0;
+    for (const Variant &v : variants) {
+        SnapshotOptions options;
+        options.enabled = v.enabled;
+        options.copyOnWrite = v.copyOnWrite;
+        options.async = v.async;
+        options.intervalNs = intervalUs * 1000;
+        LedgerPage::resetPeak();
+        long long ledgerPages = (long long)n * ((ledgerWords + LedgerPage::WORDS - 1) / LedgerPage::WORDS);
+        auto start = chrono::steady_clock::now();
+        SnapshotStore store(path, n, n * min(degree, n - 1), 1000LL * n, v.async);
+        SnapshotRunResult r = runSnapshotSimulation(n, perProcess, degree, ledgerWords, options, &store, partitions);
+        store.finish();
+        double wallMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        double rate = r.delivered / wallMs / 1000;
+        if (!v.enabled) {
+            baseline = rate;
+        }
+        cout << setw(24) << v.name << fixed << setprecision(1) << setw(11) << wallMs << setw(13) << setprecision(3)
+             << rate << setw(9) << setprecision(1) << (baseline > 0 ? (1 - rate / baseline) * 100 : 0.0)
+             << setw(11) << store.completed << setw(12) << store.consistent << setw(10) << r.markers << setw(11)
+             << store.recordedMessages << setw(13) << r.copiedPages << setw(12) << setprecision(1)
+             << store.bytesWritten / 1048576.0 << setw(11)
+             << (LedgerPage::peak - ledgerPages) * sizeof(LedgerPage) / 1048576.0 << "\n";
+        cout.unsetf(ios::fixed);
+    }
+}
+
+// --bench n=1000 messages=1000 link=2 partitions=1: one run of the simulator,
+// work counted in delivered events. snap_n=200 snap_messages=20000
+// ledger_kb=256 interval_us=2000: one run with copy-on-write snapshots
+// written in the background, work counted in delivered application messages.
+int runBenchmarks(int argc, char **argv) {
+    BenchmarkParams params(argc, argv, 2);
+    int n = params.integer("n", 1000);
+    long long perProcess = params.integer("messages", 1000);
+    int linkChoice = params.integer("link", 2);
+    int partitions = params.integer("partitions", 1);
+    LinkModelChoice link(linkChoice, 1000);
+    vector<LamportNode> nodes;
+    nodes.reserve(n);
+    for (int i = 0; i < n; i++) {
+        nodes.emplace_back(i + 1, perProcess, n);
+    }
+    runBenchmark("2_Lamport", "simulation", params, "events", [&]() {
+        return runLamportSimulation(nodes, link.get(), partitions).events;
+    });
+
+    int snapN = params.integer("snap_n", 200);
+    long long snapMessages = params.integer("snap_messages", 20000);
+    int ledgerKB = params.integer("ledger_kb", 256);
+    double intervalUs = params.real("interval_us", 2000);
+    string path = params.text("snap_path", "/tmp/lamport_snapshots.bin");
+    if (snapN < 2 || ledgerKB < 1 || intervalUs <= 0) {
+        cerr << "Invalid snapshot parameters\n";
+        return 1;
+    }
+    SnapshotOptions options;
+    options.enabled = true;
+    options.intervalNs = intervalUs * 1000;
+    long long completed = 0, consistent = 0;
+    runBenchmark("2_Lamport", "snapshots", params, "messages", [&]() {
+        // The store starts its writer thread, so it is built inside the
+        // measurement where the counters follow it.
+        SnapshotStore store(path, snapN, snapN * min(8, snapN - 1), 1000LL * snapN, true);
+        SnapshotRunResult r =
+            runSnapshotSimulation(snapN, snapMessages, 8, ledgerKB * 1024 / 8, options, &store, partitions);
+        store.finish();
+        completed = store.completed;
+        consistent = store.consistent;
+        return r.delivered;
+    });
+    if (completed == 0 || consistent != completed) {
+        cerr << "Inconsistent snapshot: " << consistent << " of " << completed << " consistent\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (benchmarkRequested(argc, argv)) {
+        return runBenchmarks(argc, argv);
+    }
+
+    int mode;
+    cout << "Select mode:\n";
+    cout << "1. Message exchange with direct calls\n";
+    cout << "2. Message exchange on the network simulator\n";
+    cout << "3. Network simulator throughput\n";
+    cout << "4. Chandy-Lamport snapshots: cost on message throughput\n";
+    cout << "Enter choice: ";
+    cin >> mode;
+
+    if (mode == 4) {
+        int n, degree, ledgerKB, partitions;
+        long long perProcess;
+        double intervalUs;
+        string path;
+        cout << "Enter the number of processes and the channels per process (e.g. 1000 8): ";
+        cin >> n >> degree;
+        cout << "Enter the number of messages each process sends: ";
+        cin >> perProcess;
+        cout << "Enter the ledger size per process in KB and the snapshot interval in simulated us (e.g. 16 200): ";
+        cin >> ledgerKB >> intervalUs;
+        cout << "Enter the snapshot file path and the number of partitions (threads): ";
+        cin >> path >> partitions;
+        if (n < 2 || degree < 1 || perProcess < 1 || ledgerKB < 1 || intervalUs <= 0 || partitions < 1) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        benchmarkSnapshots(n, perProcess, degree, ledgerKB * 1024 / 8, intervalUs, path, partitions);
+        return 0;
+    }
+
+    if (mode == 2 || mode == 3) {
+        int numProcesses, linkChoice;
+        cout << "Enter the number of processes: ";
+        cin >> numProcesses;
+        cout << "Link model (1 = fixed, 2 = jitter, 3 = jitter with FIFO channels, 4 = jitter with 1% loss): ";
+        cin >> linkChoice;
+        if (numProcesses < 1) {
+            cout << "Invalid number of processes. Exiting...\n";
+            return 1;
+        }
+        if (mode == 2) {
+            LinkModelChoice link(linkChoice, 1000);
+            vector<LamportNode> nodes;
+            for (int i = 0; i < numProcesses; ++i) {
+                nodes.emplace_back(i + 1, 1, numProcesses);
+            }
+            SimStats stats = runLamportSimulation(nodes, link.get(), 1);
+            cout << "\nLogical clocks after message exchanges (" << stats.messages << " sent, " << stats.dropped
+                 << " lost):\n";
+            for (LamportNode &node : nodes) {
+                cout << "Process " << node.process.id << " logical clock: " << node.process.logicalClock << endl;
+            }
+        } else {
+            long long perProcess;
+            int maxPartitions;
+            cout << "Enter the number of messages each process sends: ";
+            cin >> perProcess;
+            cout << "Enter the largest number of partitions (threads): ";
+            cin >> maxPartitions;
+            benchmarkLamportSimulation(numProcesses, perProcess, linkChoice, maxPartitions);
+        }
+        return 0;
+    } else if (mode != 1) {
+        cout << "Invalid choice. Exiting...\n";
+        return 1;
+    }
+
     int numProcesses;
 
     cout << "Enter the number of processes: ";
@@ -99,7 +823,7 @@ void printClocks(vector<Process>& processes) {
 ```
 
 #### 3. **`main` Function**
-- **Input**: The user enters the number of processes.
+- **Input**: The user selects a mode (`1` for the direct-call exchange below) and enters the number of processes.
   ```cpp
   cout << "Enter the number of processes: ";
   cin >> numProcesses;
@@ -133,6 +857,7 @@ void printClocks(vector<Process>& processes) {
 
 #### **Input**:
 ```
+Enter choice: 1
 Enter the number of processes: 3
 ```
 
@@ -169,6 +894,31 @@ Process 3 logical clock: 4
 
 ---
 
+### **Network Simulator (`NetworkSimulator.h`)**
+- Mode 2 runs the same exchange on the shared discrete-event simulator: `LamportNode` wraps a `Process`, and messages travel over a fixed, jittered, FIFO or lossy link instead of a direct call. All processes send at time 0, so every clock ends at 2.
+- Mode 3 is a load test: every process keeps sending to random processes until it has sent its quota, and the run reports events per second sequentially and with 2, 4, ... partitions. Partitions run on their own threads and advance in windows as wide as the link's minimum latency, so no message can arrive inside the window it was sent in.
+- The radix heap, message pool and per-partition random streams keep a single core above 20 million events per second with the fixed link.
+
+---
+
+### **Chandy-Lamport Snapshots (`SnapshotNode`, `SnapshotStore`, `Ledger`)**
+- Mode 4 runs a money-transfer workload on the simulator: every process keeps a balance and a ledger, and sends random amounts to its out-neighbours (the next process on the ring plus random chords). Node 0 starts a Chandy-Lamport snapshot every interval of simulated time while the application keeps running; the other processes join when their first marker arrives and record each incoming channel until its marker arrives.
+- Channels are FIFO (`FifoLink` over a jittered link), which the algorithm needs: a marker must not overtake a message sent before it.
+- `SnapshotStore` collects the pieces and checks every completed snapshot: the recorded balances plus the money in flight add up to the starting total, and every channel satisfies sent = received + recorded.
+- The ledger is split into 4 KB pages held by `shared_ptr`. Recording shares the pages instead of copying them, and a write to a page that a snapshot still holds copies that page first (copy-on-write). The store writes only the pages that changed since the node's previous snapshot.
+- Pieces are written in the handler or by a background thread. The run is repeated without snapshots, with full copies, with copy-on-write and with copy-on-write plus background writes, and the table shows the throughput drop of each.
+- The store keeps the pages of each node's last written piece to find the unchanged ones, so the ledger copies a page on its first write after every snapshot. The `held MB` column is the peak memory of ledger pages beyond the live ledgers: snapshots in flight plus that retained copy.
+- With 200 processes, 8 channels each, 20000 messages each, a 256 KB ledger and a snapshot every 2 ms, full copies write 301 MB and hold 100 MB; copy-on-write writes 99 MB and holds 13-21 MB. The throughput drop is not quoted because it varies widely from run to run on a single core, where the writer thread shares the CPU with the simulation; compare the variants within one run.
+
+---
+
+### **Benchmark Mode (`--bench`)**
+- `./2_Lamport --bench n=1000 messages=1000 link=2 partitions=1` runs one mode-3 simulation without prompts and prints a JSON line with the wall time, events delivered, events per second and the hardware counters (`BenchmarkHarness.h`).
+- A second line, `snapshots`, runs the mode-4 workload with copy-on-write snapshots written in the background (`snap_n=200 snap_messages=20000 ledger_kb=256 interval_us=2000`); the program exits non-zero if any snapshot is inconsistent.
+- `BenchmarkDriver.cpp` runs it with the other programs and flags regressions against a saved baseline.
+
+---
+
 ### **Key Takeaways**
 1. The program simulates distributed message-passing using logical clocks.
 2. The clocks help maintain causal relationships between events.
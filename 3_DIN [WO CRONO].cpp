@@ -2,6 +2,7 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <unistd.h>
+#include "BenchmarkHarness.h"
 using namespace std;
 
 #define N 5                  // Number of philosophers
@@ -16,6 +17,21 @@ int phil[N] = { 0, 1, 2, 3, 4 }; // Philosopher IDs
 sem_t mutex;                 // Semaphore for critical section
 sem_t S[N];                  // Semaphore for individual philosophers
 
+// Timings in microseconds; the defaults are the original sleeps. The benchmark
+// mode sets them (usually to 0), bounds the number of meals and turns off the
+// per-step output.
+long eatMicros = 2000000;    // held inside test(), under the mutex
+long holdMicros = 1000000;   // after the forks are granted
+long thinkMicros = 1000000;
+long long mealsPerPhilosopher = -1; // -1 = run forever
+bool quiet = false;
+
+void pauseMicros(long micros) {
+    if (micros > 0) {
+        usleep(micros);
+    }
+}
+
 // Function to test if a philosopher can eat
 void test(int phnum) {
     if (state[phnum] == HUNGRY &&
@@ -23,11 +39,13 @@ void test(int phnum) {
         state[RIGHT] != EATING) {
         
         state[phnum] = EATING;
-        sleep(2); // Simulate eating process
+        pauseMicros(eatMicros); // Simulate eating process
         
-        cout << "Philosopher " << phnum + 1 << " takes fork " 
-             << LEFT + 1 << " and " << phnum + 1 << endl;
-        cout << "Philosopher " << phnum + 1 << " is Eating" << endl;
+        if (!quiet) {
+            cout << "Philosopher " << phnum + 1 << " takes fork " 
+                 << LEFT + 1 << " and " << phnum + 1 << endl;
+            cout << "Philosopher " << phnum + 1 << " is Eating" << endl;
+        }
         
         sem_post(&S[phnum]); // Signal philosopher to start eating
     }
@@ -38,13 +56,15 @@ void take_fork(int phnum) {
     sem_wait(&mutex); // Enter critical section
     
     state[phnum] = HUNGRY;
-    cout << "Philosopher " << phnum + 1 << " is Hungry" << endl;
+    if (!quiet) {
+        cout << "Philosopher " << phnum + 1 << " is Hungry" << endl;
+    }
     
     test(phnum); // Try to take forks
     
     sem_post(&mutex); // Exit critical section
     sem_wait(&S[phnum]); // Wait until allowed to eat
-    sleep(1);
+    pauseMicros(holdMicros);
 }
 
 // Function for a philosopher to put down forks
@@ -52,9 +72,11 @@ void put_fork(int phnum) {
     sem_wait(&mutex); // Enter critical section
     
     state[phnum] = THINKING;
-    cout << "Philosopher " << phnum + 1 << " putting fork " 
-         << LEFT + 1 << " and " << phnum + 1 << " down" << endl;
-    cout << "Philosopher " << phnum + 1 << " is thinking" << endl;
+    if (!quiet) {
+        cout << "Philosopher " << phnum + 1 << " putting fork " 
+             << LEFT + 1 << " and " << phnum + 1 << " down" << endl;
+        cout << "Philosopher " << phnum + 1 << " is thinking" << endl;
+    }
     
     // Test left and right neighbors
     test(LEFT);
@@ -67,15 +89,18 @@ void put_fork(int phnum) {
 void* philosopher(void* num) {
     int* i = (int*)num;
 
-    while (true) {
-        sleep(1); // Thinking
+    for (long long meal = 0; mealsPerPhilosopher < 0 || meal < mealsPerPhilosopher; meal++) {
+        pauseMicros(thinkMicros); // Thinking
         take_fork(*i); // Try to pick up forks
         sleep(0); // Eating
         put_fork(*i); // Put down forks
     }
+    return NULL;
 }
 
-int main() {
+// Starts the philosophers and waits for them. They only return when
+// mealsPerPhilosopher is bounded.
+void runTable() {
     pthread_t thread_id[N]; // Thread IDs for philosophers
 
     // Initialize the semaphores
@@ -86,8 +111,11 @@ int main() {
 
     // Create philosopher threads
     for (int i = 0; i < N; i++) {
+        state[i] = THINKING;
         pthread_create(&thread_id[i], NULL, philosopher, &phil[i]);
-        cout << "Philosopher " << i + 1 << " is thinking" << endl;
+        if (!quiet) {
+            cout << "Philosopher " << i + 1 << " is thinking" << endl;
+        }
     }
 
     // Join philosopher threads
@@ -95,6 +123,33 @@ int main() {
         pthread_join(thread_id[i], NULL);
     }
 
+    sem_destroy(&mutex);
+    for (int i = 0; i < N; i++) {
+        sem_destroy(&S[i]);
+    }
+}
+
+// --bench meals=2000 eat_us=0 hold_us=0 think_us=0: every philosopher eats
+// `meals` times; work is the total number of meals.
+int runBenchmarks(int argc, char **argv) {
+    BenchmarkParams params(argc, argv, 2);
+    mealsPerPhilosopher = params.integer("meals", 2000);
+    eatMicros = params.integer("eat_us", 0);
+    holdMicros = params.integer("hold_us", 0);
+    thinkMicros = params.integer("think_us", 0);
+    quiet = true;
+    runBenchmark("3_DIN", "meals", params, "meals", []() {
+        runTable();
+        return N * mealsPerPhilosopher;
+    });
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (benchmarkRequested(argc, argv)) {
+        return runBenchmarks(argc, argv);
+    }
+    runTable();
     return 0;
 }
 
@@ -234,6 +289,13 @@ This loop continues indefinitely, simulating the philosopher's behavior.
 
 ---
 
+### **Bounded Runs and Benchmark Mode (`--bench`)**
+- The sleeps are now the globals `eatMicros`, `holdMicros` and `thinkMicros`, with the original values (2 s, 1 s, 1 s) as defaults, and `mealsPerPhilosopher` (-1 = forever) bounds the loop. Without arguments the program behaves as before.
+- `./3_DIN --bench meals=2000 eat_us=0 hold_us=0 think_us=0` turns the output off, lets every philosopher eat `meals` times, joins the threads and prints a JSON line: wall time, meals, meals per second and the hardware counters (`BenchmarkHarness.h`). With zero delays it measures the cost of the semaphore hand-offs; with `eat_us` set it shows how much the sleep held under `mutex` in `test()` serializes the table.
+- `BenchmarkDriver.cpp` runs it with the other programs and flags regressions against a saved baseline.
+
+---
+
 ### **Key Features**
 - **Deadlock Prevention**: By ensuring a philosopher eats only if both adjacent philosophers are not eating, deadlock is avoided.
 - **Concurrency**: The mutex ensures only one philosopher modifies shared resources at a time.
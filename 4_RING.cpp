@@ -1,13 +1,29 @@
 #include <iostream>
+#include <iomanip>
 #include <vector>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include "BenchmarkHarness.h"
+#include "FailureDetector.h"
+#include "NetworkSimulator.h"
+#include "ThreadPool.h"
 using namespace std;
 
 void ringAlgorithm(vector<int> &processes, int initiator) {
     int n = processes.size();
-    int leaderID = processes[initiator];
-    int currentID = leaderID;
+    int leaderIndex = initiator;
+    int currentID = processes[initiator];
 
-    cout << "Initiator process: P" << initiator << " with ID " << leaderID << "\n";
+    cout << "Initiator process: P" << initiator << " with ID " << currentID << "\n";
 
     // Election process
     cout << "Starting election...\n";
@@ -15,6 +31,7 @@ void ringAlgorithm(vector<int> &processes, int initiator) {
         cout << "P" << i << " receives ID " << currentID << "\n";
         if (processes[i] > currentID) {
             currentID = processes[i];
+            leaderIndex = i;
             cout << "P" << i << " forwards new ID " << currentID << "\n";
         } else {
             cout << "P" << i << " forwards current ID " << currentID << "\n";
@@ -22,8 +39,8 @@ void ringAlgorithm(vector<int> &processes, int initiator) {
     }
 
     // Leader announcement
-    leaderID = currentID;
-    cout << "\nLeader is P" << initiator << " with ID " << leaderID << "\n";
+    int leaderID = currentID;
+    cout << "\nLeader is P" << leaderIndex << " with ID " << leaderID << "\n";
     cout << "Announcing leader to all processes...\n";
 
     for (int i = (initiator + 1) % n; i != initiator; i = (i + 1) % n) {
@@ -32,7 +49,1021 @@ void ringAlgorithm(vector<int> &processes, int initiator) {
     cout << "Election completed. Leader: " << leaderID << "\n";
 }
 
-int main() {
+// Seeded splitmix64 stream; every random choice in the simulations comes from
+// one of these so a run can be replayed exactly.
+struct SplitMix64 {
+    uint64_t state;
+
+    explicit SplitMix64(uint64_t seed = 1) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, 1).
+    double nextDouble() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+};
+
+// Per-hop latency model: every message costs baseNs plus a uniform jitter in
+// [0, jitterNs).
+struct LatencyModel {
+    double baseNs;
+    double jitterNs;
+    SplitMix64 rng;
+
+    LatencyModel(double baseNs = 1000.0, double jitterNs = 0.0, uint64_t seed = 1)
+        : baseNs(baseNs), jitterNs(jitterNs), rng(seed) {}
+
+    double nextHop() {
+        if (jitterNs <= 0.0) {
+            return baseNs;
+        }
+        return baseNs + jitterNs * rng.nextDouble();
+    }
+};
+
+struct ElectionResult {
+    int leaderIndex;
+    int leaderID;
+    long long messages;
+    double simulatedNs;
+};
+
+// Simulation engine for the ring election: no output per hop, one pass over
+// the ring. The election token and the coordinator announcement travel the
+// same n links, so both messages of a hop are accounted for in the same
+// iteration. Every message is counted and charged one sample of the latency
+// model.
+ElectionResult simulateRingElection(const vector<int> &processes, int initiator, LatencyModel &latency) {
+    int n = processes.size();
+    ElectionResult result = { initiator, processes[initiator], 0, 0.0 };
+    if (n == 1) {
+        return result;
+    }
+
+    double electionNs = 0.0;
+    double announceNs = 0.0;
+    int i = initiator;
+    for (int hop = 0; hop < n; hop++) {
+        i = (i + 1 == n) ? 0 : i + 1;
+        if (processes[i] > result.leaderID) {
+            result.leaderID = processes[i];
+            result.leaderIndex = i;
+        }
+        electionNs += latency.nextHop();
+        announceNs += latency.nextHop();
+        result.messages += 2;
+    }
+    result.simulatedNs = electionNs + announceNs;
+    return result;
+}
+
+// Random permutation of 1..n used as process IDs by the benchmarks.
+vector<int> makeRingIDs(int n, uint32_t seed) {
+    vector<int> ids(n);
+    for (int i = 0; i < n; i++) {
+        ids[i] = i + 1;
+    }
+    mt19937 rng(seed);
+    shuffle(ids.begin(), ids.end(), rng);
+    return ids;
+}
+
+void benchmarkRingEngine(int maxN, double baseNs, double jitterNs) {
+    LatencyModel latency(baseNs, jitterNs, 42);
+    mt19937 rng(7);
+
+    cout << "\n" << setw(10) << "n" << setw(16) << "elections/sec" << setw(16) << "msgs/election"
+         << setw(18) << "total messages" << setw(16) << "sim time (ms)" << "\n";
+
+    for (int n = 1000; n <= maxN; n *= 10) {
+        vector<int> processes = makeRingIDs(n, n);
+        int expected = n;
+
+        long long elections = 0;
+        long long totalMessages = 0;
+        double simulatedNs = 0.0;
+        auto start = chrono::steady_clock::now();
+        double elapsed = 0.0;
+        while (elapsed < 0.5 || elections < 3) {
+            int initiator = rng() % n;
+            ElectionResult r = simulateRingElection(processes, initiator, latency);
+            if (r.leaderID != expected || processes[r.leaderIndex] != expected) {
+                cout << "Wrong leader for n = " << n << "\n";
+                return;
+            }
+            elections++;
+            totalMessages += r.messages;
+            simulatedNs += r.simulatedNs;
+            elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+
+        cout << setw(10) << n << setw(16) << fixed << setprecision(1) << elections / elapsed
+             << setw(16) << totalMessages / elections << setw(18) << totalMessages
+             << setw(16) << setprecision(3) << simulatedNs / elections / 1e6 << "\n";
+    }
+}
+
+enum ElectionMode { LE_LANN, CHANG_ROBERTS, HIRSCHBERG_SINCLAIR };
+
+const char *electionModeName(ElectionMode mode) {
+    switch (mode) {
+        case LE_LANN: return "LeLann (naive)";
+        case CHANG_ROBERTS: return "Chang-Roberts";
+        default: return "Hirschberg-Sinclair";
+    }
+}
+
+struct ConcurrentElectionResult {
+    int leaderIndex;
+    int leaderID;
+    long long messages;
+    long long convergenceHops;  // hops on the critical path, all initiators start together
+    double simulatedNs;         // convergenceHops charged through the latency model
+};
+
+// Elections started by several initiators at once. A process that has not
+// started an election wakes up when the first message reaches it and takes
+// part from then on, so every mode elects the highest process of the ring,
+// as ringAlgorithm and ThreadedRing do. Every message takes one hop time, so
+// the first message to reach a process comes from the nearest initiator
+// before it on the ring.
+//
+// - LeLann: a process sends its own token when it wakes, and every token goes
+//   all the way round, n * n messages; every process has seen every ID when
+//   the last token arrives.
+// - Chang-Roberts: a waking process forwards max(own, received) and becomes a
+//   candidate if its own ID is the larger. A token is swallowed by the first
+//   process with a higher ID, so only the highest process's token returns
+//   home; it then sends the coordinator message round the ring.
+// - Hirschberg-Sinclair: in phase p every active candidate probes 2^p hops in
+//   both directions, and the probes are replied to unless an active
+//   candidate or a sleeping process with a higher ID swallows them. A
+//   sleeping process wakes as a new candidate if every probe that reached it
+//   had a lower ID and as a relay otherwise. A candidate that misses a reply
+//   becomes a relay and passes probes on from then on. O(n log n) messages.
+//
+// The candidates' tokens are spread over the thread pool and every worker
+// sums the messages of its own tokens.
+ConcurrentElectionResult simulateConcurrentElection(const vector<int> &processes, const vector<int> &initiators,
+                                                    ElectionMode mode, ThreadPool &pool, LatencyModel &latency) {
+    int n = processes.size();
+    vector<int> starters = initiators;
+    sort(starters.begin(), starters.end());
+    starters.erase(unique(starters.begin(), starters.end()), starters.end());
+    int k = starters.size();
+    auto nextOf = [n](int i) { return i + 1 == n ? 0 : i + 1; };
+
+    // wake[i]: hops from the nearest initiator at or before i. In the segment
+    // an initiator wakes, the Chang-Roberts candidates are the initiator and
+    // every process with a higher ID than all before it.
+    vector<int> wake(n, 0);
+    vector<char> isCandidate(n, 0);
+    pool.parallelFor(k, [&](int, int begin, int end) {
+        for (int t = begin; t < end; t++) {
+            int origin = starters[t], stop = starters[(t + 1) % k];
+            int highest = processes[origin];
+            isCandidate[origin] = 1;
+            for (int i = nextOf(origin), hops = 1; i != stop; i = nextOf(i), hops++) {
+                wake[i] = hops;
+                if (processes[i] > highest) {
+                    highest = processes[i];
+                    isCandidate[i] = 1;
+                }
+            }
+        }
+    });
+
+    ConcurrentElectionResult result = { -1, -1, 0, 0, 0.0 };
+    vector<long long> workerMessages(pool.size(), 0);
+    vector<int> winners(pool.size(), -1);
+    auto collectWinner = [&]() {
+        for (int &w : winners) {
+            if (w >= 0) {
+                result.leaderIndex = w;
+                w = -1;
+            }
+        }
+        return result.leaderIndex >= 0;
+    };
+
+    if (mode == LE_LANN) {
+        // Every token visits every process, so there is nothing to walk.
+        result.leaderIndex = max_element(processes.begin(), processes.end()) - processes.begin();
+        result.messages = (long long)n * n;
+        result.convergenceHops = *max_element(wake.begin(), wake.end()) + (long long)n;
+    } else if (mode == CHANG_ROBERTS) {
+        vector<int> candidates;
+        for (int i = 0; i < n; i++) {
+            if (isCandidate[i]) {
+                candidates.push_back(i);
+            }
+        }
+        pool.parallelFor(candidates.size(), [&](int w, int begin, int end) {
+            long long local = 0;
+            for (int t = begin; t < end; t++) {
+                int origin = candidates[t];
+                int id = processes[origin];
+                int i = origin;
+                for (int hop = 1; hop <= n; hop++) {
+                    i = nextOf(i);
+                    local++;
+                    if (i == origin) {
+                        winners[w] = origin;
+                        break;
+                    }
+                    if (processes[i] > id) {
+                        break;
+                    }
+                }
+            }
+            workerMessages[w] += local;
+        });
+        collectWinner();
+        result.messages = n;  // coordinator announcement
+        result.convergenceHops = wake[result.leaderIndex] + 2LL * n;
+    } else {
+        enum { ASLEEP, ACTIVE, RELAY };
+        vector<char> state(n, ASLEEP);
+        vector<pair<int, long long>> active;  // (candidate, probe distance of its next phase)
+        for (int c : starters) {
+            state[c] = ACTIVE;
+            active.push_back({ c, 1 });
+        }
+        vector<vector<pair<int, long long>>> survivors(pool.size());
+        vector<vector<pair<int, int>>> reached(pool.size());  // (sleeping process, probe ID)
+        vector<char> seen(n, 0), sawHigher(n, 0);
+        while (true) {
+            long long roundHops = 0;
+            for (const pair<int, long long> &c : active) {
+                roundHops = max(roundHops, c.second >= n ? n : 2 * c.second);
+            }
+            pool.parallelFor(active.size(), [&](int w, int begin, int end) {
+                long long local = 0;
+                for (int t = begin; t < end; t++) {
+                    int origin = active[t].first;
+                    long long distance = active[t].second;
+                    int id = processes[origin];
+                    bool lastPhase = distance >= n;
+                    bool wonBoth = true;
+                    for (int dir = 1; dir >= -1; dir -= 2) {
+                        int i = origin;
+                        bool swallowed = false;
+                        for (long long hop = 1; hop <= distance && hop <= n; hop++) {
+                            i += dir;
+                            i = (i == n) ? 0 : (i < 0 ? n - 1 : i);
+                            local++;
+                            if (i == origin) {
+                                break;
+                            }
+                            if (state[i] == ASLEEP) {
+                                reached[w].push_back({ i, id });
+                            }
+                            if (state[i] != RELAY && processes[i] > id) {
+                                swallowed = true;
+                                break;
+                            }
+                        }
+                        if (swallowed) {
+                            wonBoth = false;
+                        } else if (!lastPhase) {
+                            local += distance;  // reply travels back
+                        }
+                    }
+                    if (wonBoth && lastPhase) {
+                        winners[w] = origin;
+                    } else if (wonBoth) {
+                        survivors[w].push_back({ origin, distance * 2 });
+                    }
+                }
+                workerMessages[w] += local;
+            });
+            result.convergenceHops += roundHops;
+            if (collectWinner()) {
+                break;
+            }
+            for (const pair<int, long long> &c : active) {
+                state[c.first] = RELAY;
+            }
+            active.clear();
+            for (vector<pair<int, long long>> &part : survivors) {
+                for (const pair<int, long long> &c : part) {
+                    state[c.first] = ACTIVE;
+                    active.push_back(c);
+                }
+                part.clear();
+            }
+            vector<int> woken;
+            for (vector<pair<int, int>> &part : reached) {
+                for (const pair<int, int> &r : part) {
+                    if (!seen[r.first]) {
+                        seen[r.first] = 1;
+                        woken.push_back(r.first);
+                    }
+                    sawHigher[r.first] |= r.second > processes[r.first];
+                }
+                part.clear();
+            }
+            for (int i : woken) {
+                state[i] = sawHigher[i] ? RELAY : ACTIVE;
+                if (!sawHigher[i]) {
+                    active.push_back({ i, 1 });
+                }
+            }
+        }
+        result.messages = n;  // coordinator announcement
+        result.convergenceHops += n;
+    }
+    for (long long m : workerMessages) {
+        result.messages += m;
+    }
+    result.leaderID = processes[result.leaderIndex];
+
+    for (long long h = 0; h < result.convergenceHops; h++) {
+        result.simulatedNs += latency.nextHop();
+    }
+    return result;
+}
+
+void compareElectionModes(int maxN, double initiatorFraction, int threads, double baseNs, double jitterNs) {
+    ThreadPool pool(threads);
+    LatencyModel latency(baseNs, jitterNs, 42);
+    const ElectionMode modes[] = { LE_LANN, CHANG_ROBERTS, HIRSCHBERG_SINCLAIR };
+
+    cout << "\nInitiators: " << initiatorFraction * 100 << "% of the ring, " << pool.size() << " worker threads\n";
+    cout << setw(10) << "n" << setw(22) << "mode" << setw(16) << "messages" << setw(12) << "msgs/n"
+         << setw(18) << "converge (ms)" << setw(14) << "wall (ms)" << setw(14) << "leader ok" << "\n";
+
+    for (int n = 1000; n <= maxN; n *= 10) {
+        vector<int> processes = makeRingIDs(n, n);
+        vector<int> order(n);
+        for (int i = 0; i < n; i++) {
+            order[i] = i;
+        }
+        mt19937 rng(n + 1);
+        shuffle(order.begin(), order.end(), rng);
+        int k = max(1, (int)(n * initiatorFraction));
+        vector<int> initiators(order.begin(), order.begin() + k);
+        sort(initiators.begin(), initiators.end());
+
+        for (ElectionMode mode : modes) {
+            cout << setw(10) << n << setw(22) << electionModeName(mode);
+            auto start = chrono::steady_clock::now();
+            ConcurrentElectionResult r = simulateConcurrentElection(processes, initiators, mode, pool, latency);
+            double wallMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            // Every mode must elect the highest process, as ringAlgorithm does.
+            bool leaderOk = r.leaderID == *max_element(processes.begin(), processes.end());
+            cout << setw(16) << r.messages << setw(12) << fixed << setprecision(2) << (double)r.messages / n
+                 << setw(18) << setprecision(3) << r.simulatedNs / 1e6 << setw(14) << wallMs << setw(14)
+                 << (leaderOk ? "yes" : "no") << "\n";
+        }
+    }
+}
+
+// Hint to the CPU that we are spinning on a shared location.
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    this_thread::yield();
+#endif
+}
+
+// Bounded lock-free single-producer/single-consumer queue. The consumer index
+// and the producer index live on separate cache lines, and each side keeps a
+// private copy of the other side's index so it only touches the shared line
+// when its copy says the queue looks full (or empty).
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size *= 2;
+        }
+        mask = size - 1;
+        buffer.resize(size);
+    }
+
+    bool push(const T &value) {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - cachedHead > mask) {
+            cachedHead = head.load(memory_order_acquire);
+            if (t - cachedHead > mask) {
+                return false;
+            }
+        }
+        buffer[t & mask] = value;
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+
+    bool pop(T &value) {
+        size_t h = head.load(memory_order_relaxed);
+        if (h == cachedTail) {
+            cachedTail = tail.load(memory_order_acquire);
+            if (h == cachedTail) {
+                return false;
+            }
+        }
+        value = buffer[h & mask];
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head.load(memory_order_acquire) == tail.load(memory_order_acquire);
+    }
+
+private:
+    alignas(64) atomic<size_t> head{0};  // written by the consumer
+    size_t cachedTail = 0;
+    alignas(64) atomic<size_t> tail{0};  // written by the producer
+    size_t cachedHead = 0;
+    alignas(64) size_t mask;
+    vector<T> buffer;
+};
+
+enum WaitStrategy { BUSY_POLL, BLOCKING };
+
+enum RingMessageType { ELECTION_MSG, COORDINATOR_MSG, PROBE_MSG };
+
+struct RingMessage {
+    RingMessageType type;
+    int candidate;
+    long long sentNs;
+};
+
+// Link from one shard to the next. With BLOCKING the consumer parks on the
+// condition variable and the producer only takes the mutex when it sees the
+// consumer asleep.
+struct RingLink {
+    SpscQueue<RingMessage> queue;
+    mutex m;
+    condition_variable cv;
+    atomic<bool> sleeping{false};
+
+    RingLink() : queue(1024) {}
+};
+
+struct ThreadedRingResult {
+    int leaderID;
+    long long messages;
+    long long linkHops;
+    double linkLatencyNs;  // average time a message spends on a cross-thread link
+    double wallNs;
+};
+
+inline long long nowNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// A ring whose processes are split into contiguous shards, one worker thread
+// per shard. Hops inside a shard are plain function calls; the last process of
+// a shard hands its messages to the next shard over an SPSC link, so tokens
+// really do travel round the ring concurrently.
+class ThreadedRing {
+public:
+    ThreadedRing(const vector<int> &processes, int threads, WaitStrategy wait)
+        : ids(processes), threadCount(max(1, min(threads, (int)processes.size()))), wait(wait) {
+        int n = ids.size();
+        for (int w = 0; w <= threadCount; w++) {
+            shardBegin.push_back((long long)n * w / threadCount);
+        }
+        for (int w = 0; w < threadCount; w++) {
+            links.emplace_back(new RingLink());
+        }
+    }
+
+    // Chang-Roberts election started by every process at the same moment.
+    ThreadedRingResult runElection() {
+        return run(false, 0);
+    }
+
+    // A single probe token circulating the ring for the given number of laps.
+    ThreadedRingResult runTraversal(int laps) {
+        return run(true, laps);
+    }
+
+private:
+    struct WorkerStats {
+        long long messages = 0;
+        long long linkHops = 0;
+        long long linkNs = 0;
+        int leaderID = -1;
+    };
+
+    ThreadedRingResult run(bool traversal, int laps) {
+        done = false;
+        inFlight = traversal ? 1 : (long long)ids.size();
+        lapsLeft = laps;
+        vector<WorkerStats> stats(threadCount);
+
+        long long start = nowNs();
+        vector<thread> workers;
+        for (int w = 0; w < threadCount; w++) {
+            workers.emplace_back(&ThreadedRing::workerLoop, this, w, traversal, ref(stats[w]));
+        }
+        for (thread &t : workers) {
+            t.join();
+        }
+
+        ThreadedRingResult result = { -1, 0, 0, 0.0, (double)(nowNs() - start) };
+        long long linkNs = 0;
+        for (const WorkerStats &s : stats) {
+            result.messages += s.messages;
+            result.linkHops += s.linkHops;
+            linkNs += s.linkNs;
+            result.leaderID = max(result.leaderID, s.leaderID);
+        }
+        result.linkLatencyNs = result.linkHops ? (double)linkNs / result.linkHops : 0.0;
+        return result;
+    }
+
+    void finish() {
+        done.store(true);
+        for (auto &link : links) {
+            lock_guard<mutex> lock(link->m);
+            link->cv.notify_all();
+        }
+    }
+
+    void retire() {
+        if (inFlight.fetch_sub(1) == 1) {
+            finish();
+        }
+    }
+
+    void send(RingLink &out, RingMessage msg, deque<RingMessage> &overflow) {
+        msg.sentNs = nowNs();
+        if (!overflow.empty() || !out.queue.push(msg)) {
+            overflow.push_back(msg);
+            return;
+        }
+        wakeConsumer(out);
+    }
+
+    void wakeConsumer(RingLink &out) {
+        if (wait == BLOCKING) {
+            atomic_thread_fence(memory_order_seq_cst);
+            if (out.sleeping.load()) {
+                lock_guard<mutex> lock(out.m);
+                out.cv.notify_one();
+            }
+        }
+    }
+
+    // Delivers msg to process `from` and onwards through this shard until it is
+    // consumed or leaves the shard.
+    void route(RingMessage msg, int from, int end, bool traversal, RingLink &out,
+               deque<RingMessage> &overflow, WorkerStats &stats) {
+        for (int j = from; j < end; j++) {
+            stats.messages++;
+            if (traversal) {
+                if (j == 0 && --lapsLeft == 0) {
+                    finish();
+                    return;
+                }
+            } else if (msg.type == ELECTION_MSG) {
+                if (msg.candidate < ids[j]) {
+                    retire();  // swallowed by a higher process
+                    return;
+                }
+                if (msg.candidate == ids[j]) {
+                    msg.type = COORDINATOR_MSG;  // own ID came back: j is the leader
+                }
+            } else {
+                stats.leaderID = msg.candidate;
+                if (msg.candidate == ids[j]) {
+                    retire();  // announcement went all the way round
+                    return;
+                }
+            }
+        }
+        send(out, msg, overflow);
+    }
+
+    void workerLoop(int w, bool traversal, WorkerStats &stats) {
+        int begin = shardBegin[w], end = shardBegin[w + 1];
+        RingLink &in = *links[w];
+        RingLink &out = *links[(w + 1) % threadCount];
+        deque<RingMessage> overflow;
+
+        if (traversal) {
+            if (w == 0) {
+                route(RingMessage{ PROBE_MSG, 0, 0 }, 1, end, true, out, overflow, stats);
+            }
+        } else {
+            for (int i = begin; i < end; i++) {
+                route(RingMessage{ ELECTION_MSG, ids[i], 0 }, i + 1, end, false, out, overflow, stats);
+            }
+        }
+
+        int spins = 0;
+        while (!done.load(memory_order_relaxed)) {
+            while (!overflow.empty() && out.queue.push(overflow.front())) {
+                overflow.pop_front();
+                wakeConsumer(out);
+            }
+
+            RingMessage msg;
+            if (in.queue.pop(msg)) {
+                stats.linkHops++;
+                stats.linkNs += nowNs() - msg.sentNs;
+                route(msg, begin, end, traversal, out, overflow, stats);
+                spins = 0;
+                continue;
+            }
+
+            if (wait == BUSY_POLL || ++spins < 64) {
+                cpuRelax();
+                if ((spins & 63) == 0) {
+                    this_thread::yield();
+                }
+                continue;
+            }
+            in.sleeping.store(true);
+            {
+                unique_lock<mutex> lock(in.m);
+                in.cv.wait_for(lock, chrono::microseconds(overflow.empty() ? 1000 : 50),
+                               [&] { return !in.queue.empty() || done.load(); });
+            }
+            in.sleeping.store(false);
+            spins = 0;
+        }
+    }
+
+    vector<int> ids;
+    int threadCount;
+    WaitStrategy wait;
+    vector<int> shardBegin;
+    vector<unique_ptr<RingLink>> links;
+    atomic<bool> done{false};
+    atomic<long long> inFlight{0};
+    long long lapsLeft = 0;  // only touched by the worker that owns process 0
+};
+
+void benchmarkThreadedRing(int n, int maxThreads, int laps, WaitStrategy wait) {
+    vector<int> processes = makeRingIDs(n, n);
+    vector<int> everyone(n);
+    for (int i = 0; i < n; i++) {
+        everyone[i] = i;
+    }
+    ThreadPool pool(1);
+    LatencyModel latency;
+    long long expectedMessages =
+        simulateConcurrentElection(processes, everyone, CHANG_ROBERTS, pool, latency).messages;
+
+    cout << "\nRing of " << n << " processes, Chang-Roberts with every process initiating, "
+         << (wait == BUSY_POLL ? "busy-poll" : "blocking") << " links\n";
+    cout << setw(9) << "threads" << setw(14) << "election ms" << setw(14) << "messages" << setw(16) << "link wait ns"
+         << setw(14) << "ns/lap" << setw(14) << "ns/hop" << setw(16) << "link hop ns" << "\n";
+
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        ThreadedRing ring(processes, threads, wait);
+        ThreadedRingResult election = ring.runElection();
+        if (election.leaderID != n || election.messages != expectedMessages) {
+            cout << "Threaded election disagrees with the simulation engine (leader " << election.leaderID
+                 << ", " << election.messages << " messages)\n";
+            return;
+        }
+        ThreadedRingResult traversal = ring.runTraversal(laps);
+        cout << setw(9) << threads << setw(14) << fixed << setprecision(3) << election.wallNs / 1e6
+             << setw(14) << election.messages << setw(16) << setprecision(1) << election.linkLatencyNs
+             << setw(14) << traversal.wallNs / laps << setw(14) << traversal.wallNs / laps / n
+             << setw(16) << traversal.linkLatencyNs << "\n";
+    }
+}
+
+// Crashes injected while an election runs. At every hop one random live
+// process crashes with probability crashProbability, and the scheduled
+// (hop, process index) pairs crash exactly at their hop. All random draws
+// come from the seed, so the same schedule replays the same run.
+struct FailureSchedule {
+    double crashProbability;
+    vector<pair<long long, int>> scheduled;  // sorted by hop
+    uint64_t seed;
+};
+
+struct FailureElectionResult {
+    bool converged;
+    int leaderIndex;
+    int leaderID;
+    long long messages;     // live hops plus sends that timed out on dead processes
+    long long crashes;
+    long long timeouts;     // sends to dead processes
+    long long repairs;      // successor lists that ran out and were repaired
+    int elections;          // first election plus re-elections
+    double simulatedNs;     // time until a live leader has been announced
+};
+
+// Ring election in which processes crash mid-election. Every process knows its
+// next `successors` processes and forwards to the first live one; each dead
+// successor costs a message and a timeout, after which the sender links past
+// it, so later laps only pay for live hops. If the whole list is dead the token
+// is lost: its holder repairs its link by probing the processes after the list
+// one at a time and starts a new election. A token held by a crashing process
+// is lost too: its sender notices after a timeout and starts a new election. If
+// the winning process crashes before the announcement has gone round, the
+// election is stale and is run again.
+FailureElectionResult simulateElectionWithFailures(const vector<int> &processes, int initiator, int successors,
+                                                   const FailureSchedule &schedule, LatencyModel &latency,
+                                                   double timeoutNs, int maxElections = 1000) {
+    int n = processes.size();
+    vector<char> alive(n, 1);
+    int aliveCount = n;
+    SplitMix64 rng(schedule.seed);
+    size_t nextScheduled = 0;
+    long long hop = 0;
+    FailureElectionResult result = { false, -1, -1, 0, 0, 0, 0, 0, 0.0 };
+    successors = min(successors, n - 1);
+    vector<int> next(n);  // each process's first successor not known to be dead
+    for (int i = 0; i < n; i++) {
+        next[i] = (i + 1 == n) ? 0 : i + 1;
+    }
+
+    auto crash = [&](int victim) {
+        if (alive[victim] && aliveCount > 1) {
+            alive[victim] = 0;
+            aliveCount--;
+            result.crashes++;
+        }
+    };
+
+    auto injectCrashes = [&]() {
+        hop++;
+        while (nextScheduled < schedule.scheduled.size() && schedule.scheduled[nextScheduled].first <= hop) {
+            crash(schedule.scheduled[nextScheduled].second);
+            nextScheduled++;
+        }
+        if (schedule.crashProbability > 0.0 && aliveCount > 1 && rng.nextDouble() < schedule.crashProbability) {
+            int victim;
+            do {
+                victim = rng.next() % n;
+            } while (!alive[victim]);
+            crash(victim);
+        }
+    };
+
+    // Passes the token from i to the first live process of its successor list
+    // and returns it, or -1 if the whole list is dead. `travelled` counts ring
+    // positions, dead ones included, so a lap ends after n of them.
+    auto forward = [&](int i, long long &travelled) {
+        int j = next[i];
+        for (int attempt = 0; attempt < successors; attempt++) {
+            result.messages++;
+            if (alive[j]) {
+                result.simulatedNs += latency.nextHop();
+                travelled += (j - i + n) % n;
+                next[i] = j;
+                return j;
+            }
+            result.timeouts++;
+            result.simulatedNs += timeoutNs;
+            j = (j + 1 == n) ? 0 : j + 1;
+        }
+        next[i] = j;
+        return -1;
+    };
+
+    // Probes the processes after i's exhausted list until one answers.
+    auto repair = [&](int i) {
+        result.repairs++;
+        int j = next[i];
+        while (!alive[j]) {
+            result.messages++;
+            result.timeouts++;
+            result.simulatedNs += timeoutNs;
+            j = (j + 1 == n) ? 0 : j + 1;
+        }
+        result.messages++;
+        result.simulatedNs += latency.nextHop();
+        next[i] = j;
+    };
+
+    auto firstAliveFrom = [&](int i) {
+        while (!alive[i]) {
+            i = (i + 1 == n) ? 0 : i + 1;
+        }
+        return i;
+    };
+
+    // Walks one lap from `start`; returns false if the token was lost. On
+    // return `cur` is the live process that closed the lap (or the one that
+    // noticed the loss) and `candidate` the highest live-at-the-time ID seen.
+    auto lap = [&](int start, int &cur, int &candidate) {
+        long long travelled = 0;
+        int prev = start;
+        cur = start;
+        while (travelled < n) {
+            injectCrashes();
+            if (!alive[cur]) {
+                result.simulatedNs += timeoutNs;
+                cur = alive[prev] ? prev : firstAliveFrom(cur);
+                return false;
+            }
+            prev = cur;
+            int to = forward(cur, travelled);
+            if (to < 0) {
+                repair(cur);
+                return false;
+            }
+            cur = to;
+            if (candidate >= 0 && processes[cur] > processes[candidate]) {
+                candidate = cur;
+            }
+        }
+        return true;
+    };
+
+    int start = initiator;
+    while (result.elections < maxElections) {
+        result.elections++;
+        int cur, candidate = start;
+        if (!lap(start, cur, candidate)) {
+            start = cur;
+            continue;
+        }
+        if (!alive[candidate]) {
+            result.simulatedNs += timeoutNs;
+            start = cur;
+            continue;
+        }
+        int noCandidate = -1;
+        if (!lap(cur, cur, noCandidate) || !alive[candidate]) {
+            if (alive[candidate] == 0) {
+                result.simulatedNs += timeoutNs;
+            }
+            start = cur;
+            continue;
+        }
+        result.converged = true;
+        result.leaderIndex = candidate;
+        result.leaderID = processes[candidate];
+        break;
+    }
+    return result;
+}
+
+void benchmarkFailureInjection(int n, int successors, double timeoutNs, uint64_t seed, int runs,
+                               const vector<pair<long long, int>> &scheduled) {
+    vector<int> processes = makeRingIDs(n, seed);
+    const double rates[] = { 0.0, 1e-5, 1e-4, 1e-3, 1e-2 };
+
+    cout << "\nRing of " << n << " processes, successor list of " << successors << ", timeout "
+         << timeoutNs / 1000 << " us, seed " << seed << ", " << runs << " runs per rate\n";
+    cout << setw(12) << "crash/hop" << setw(10) << "crashes" << setw(11) << "elections" << setw(14) << "messages"
+         << setw(11) << "overhead" << setw(10) << "timeouts" << setw(10) << "repairs" << setw(18) << "stable leader ms"
+         << setw(11) << "converged" << "\n";
+
+    for (double rate : rates) {
+        double crashes = 0, elections = 0, messages = 0, failureFreeMessages = 0, timeouts = 0, repairs = 0,
+               timeNs = 0;
+        int converged = 0;
+        for (int r = 0; r < runs; r++) {
+            FailureSchedule schedule = { rate, scheduled, seed + r };
+            LatencyModel latency(1000.0, 200.0, seed + r);
+            FailureElectionResult res =
+                simulateElectionWithFailures(processes, (seed + r) % n, successors, schedule, latency, timeoutNs);
+            crashes += res.crashes;
+            elections += res.elections;
+            messages += res.messages;
+            failureFreeMessages += 2.0 * (n - res.crashes);
+            timeouts += res.timeouts;
+            repairs += res.repairs;
+            timeNs += res.simulatedNs;
+            converged += res.converged;
+        }
+        cout << setw(12) << scientific << setprecision(0) << rate << fixed << setprecision(1)
+             << setw(10) << crashes / runs << setw(11) << elections / runs << setw(14) << setprecision(0)
+             << messages / runs << setw(10) << setprecision(3) << messages / failureFreeMessages << "x"
+             << setw(10) << setprecision(1) << timeouts / runs << setw(10) << repairs / runs << setw(18) << setprecision(3) << timeNs / runs / 1e6
+             << setw(8) << converged << "/" << runs << "\n";
+    }
+}
+
+// The leader crashes while a HeartbeatMonitor watches the ring. The others
+// cannot see the crash, only missing heartbeats: a suspicion before the
+// leader's lease has safely run out is rechecked at that point and dropped if
+// the lease was renewed. Once they take over, the process after the leader
+// starts a ring election among the survivors.
+void runLeaderFailover(int n, const DetectorConfig &cfg, long long leaseMs, long long crashAtMs, uint64_t seed) {
+    HeartbeatNetwork net = { n, 100, 2.0, 5.0, 0.01 };
+    vector<int> processes = makeRingIDs(n, seed);
+    int leaderNode = max_element(processes.begin(), processes.end()) - processes.begin();
+
+    HeartbeatMonitor monitor(net, cfg, seed);
+    LeaderLease lease(leaseMs, leaseMs / 10);
+    monitor.trackLease(leaderNode, &lease);
+    monitor.crash(leaderNode, crashAtMs);
+
+    LeaderTakeover d = awaitLeaderTakeover(monitor, lease, leaderNode, crashAtMs + 60000);
+    if (d.takeoverAtMs < 0) {
+        cout << "The leader was never replaced.\n";
+        return;
+    }
+
+    vector<int> survivors;
+    for (int i = 0; i < n; i++) {
+        if (i != leaderNode) {
+            survivors.push_back(processes[i]);
+        }
+    }
+    LatencyModel latency(1000.0, 200.0, seed);
+    ElectionResult r = simulateRingElection(survivors, leaderNode % survivors.size(), latency);
+    double electedAt = d.takeoverAtMs + r.simulatedNs / 1e6;
+    DetectorStats s = monitor.stats();
+
+    cout << "\nLeader P" << leaderNode << " (ID " << processes[leaderNode] << ") crashed at " << crashAtMs << " ms\n";
+    cout << "Suspected at " << d.suspectedAtMs << " ms (detection latency " << d.suspectedAtMs - crashAtMs
+         << " ms)\n";
+    cout << "Taken over at " << d.takeoverAtMs << " ms, lease safe to take over at " << lease.safeTakeoverMs()
+         << " ms\n";
+    cout << "Ring election: " << r.messages << " messages, new leader ID " << r.leaderID << " at " << fixed
+         << setprecision(3) << electedAt << " ms (" << electedAt - crashAtMs << " ms after the crash)\n";
+    cout << "Suspicions postponed under the lease: " << d.postponed << ", dropped after it was renewed: "
+         << d.dropped << "\n";
+    cout << "False suspicions of other processes: " << s.falsePositives << ", heartbeats simulated: "
+         << s.heartbeatsSent << " in " << setprecision(1) << s.wallMs << " ms\n";
+}
+
+// Chang-Roberts on the shared discrete-event simulator: every process starts
+// an election at time 0 and forwards only IDs higher than its own. The process
+// whose token comes home announces itself with a coordinator message that
+// goes once round the ring.
+enum RingSimMessage { RING_ELECTION, RING_COORDINATOR };
+
+class ChangRobertsNode : public SimNode {
+public:
+    ChangRobertsNode(int id, int next) : id(id), next(next) {}
+
+    void onStart(SimContext &ctx) override { ctx.send(next, RING_ELECTION, id); }
+
+    void onMessage(SimContext &ctx, const SimMessage &msg) override {
+        if (msg.type == RING_ELECTION) {
+            if (msg.a > id) {
+                ctx.send(next, RING_ELECTION, msg.a);
+            } else if (msg.a == id) {
+                leaderID = id;
+                ctx.send(next, RING_COORDINATOR, id);
+            }
+        } else if (msg.a != id) {
+            leaderID = msg.a;
+            ctx.send(next, RING_COORDINATOR, msg.a);
+        }
+    }
+
+    int id, next;
+    int leaderID = -1;
+};
+
+void benchmarkSimulatedRing(int n, int linkChoice, int maxPartitions) {
+    vector<int> processes = makeRingIDs(n, n);
+    vector<int> everyone(n);
+    for (int i = 0; i < n; i++) {
+        everyone[i] = i;
+    }
+    ThreadPool pool(1);
+    LatencyModel latency;
+    long long expectedMessages =
+        simulateConcurrentElection(processes, everyone, CHANG_ROBERTS, pool, latency).messages;
+
+    cout << "\nRing of " << n << " processes, Chang-Roberts with every process initiating, " << expectedMessages
+         << " messages expected\n";
+    cout << setw(12) << "partitions" << setw(14) << "events" << setw(10) << "lost" << setw(12) << "wall ms"
+         << setw(16) << "Mevents/sec" << setw(16) << "sim time (us)" << setw(10) << "agreed" << "\n";
+    for (int partitions = 1; partitions <= maxPartitions; partitions *= 2) {
+        LinkModelChoice link(linkChoice, 1000);
+        vector<ChangRobertsNode> nodes;
+        nodes.reserve(n);
+        for (int i = 0; i < n; i++) {
+            nodes.emplace_back(processes[i], (i + 1) % n);
+        }
+        NetworkSimulator sim(link.get(), partitions, 42);
+        for (ChangRobertsNode &node : nodes) {
+            sim.addNode(&node);
+        }
+        SimStats stats = sim.run();
+        bool agreed = true;
+        for (const ChangRobertsNode &node : nodes) {
+            agreed = agreed && node.leaderID == n;
+        }
+        if (stats.dropped == 0 && (long long)stats.messages != expectedMessages) {
+            cout << "Simulated election disagrees with the engine (" << stats.messages << " messages)\n";
+            return;
+        }
+        cout << setw(12) << partitions << setw(14) << stats.events << setw(10) << stats.dropped << setw(12) << fixed
+             << setprecision(1) << stats.wallMs << setw(16) << setprecision(2) << stats.events / stats.wallMs / 1000
+             << setw(16) << setprecision(1) << stats.endTimeNs / 1e3 << setw(10) << (agreed ? "yes" : "no") << "\n";
+    }
+}
+
+int runInteractiveElection() {
     int n;
     cout << "Enter the number of processes: ";
     cin >> n;
@@ -54,6 +1085,181 @@ int main() {
     }
 
     ringAlgorithm(processes, initiator);
+    return 0;
+}
+
+// --bench n=100000 elections=50 sim_n=20000 link=2 partitions=1: repeated
+// elections on the simulation engine, then Chang-Roberts with every process
+// initiating on the network simulator. Work is counted in messages and events.
+int runBenchmarks(int argc, char **argv) {
+    BenchmarkParams params(argc, argv, 2);
+    int n = params.integer("n", 100000);
+    int elections = params.integer("elections", 50);
+    int simN = params.integer("sim_n", 20000);
+    int linkChoice = params.integer("link", 2);
+    int partitions = params.integer("partitions", 1);
+    if (n < 1 || simN < 1) {
+        cerr << "Invalid ring size\n";
+        return 1;
+    }
+
+    vector<int> processes = makeRingIDs(n, n);
+    LatencyModel latency(1000.0, 200.0, 42);
+    mt19937 rng(7);
+    bool correct = true;
+    runBenchmark("4_RING", "election", params, "messages", [&]() {
+        long long messages = 0;
+        for (int e = 0; e < elections; e++) {
+            ElectionResult r = simulateRingElection(processes, rng() % n, latency);
+            correct = correct && r.leaderID == n;
+            messages += r.messages;
+        }
+        return messages;
+    });
+
+    vector<int> simProcesses = makeRingIDs(simN, simN);
+    LinkModelChoice link(linkChoice, 1000);
+    vector<ChangRobertsNode> nodes;
+    nodes.reserve(simN);
+    for (int i = 0; i < simN; i++) {
+        nodes.emplace_back(simProcesses[i], (i + 1) % simN);
+    }
+    NetworkSimulator sim(link.get(), partitions, 42);
+    for (ChangRobertsNode &node : nodes) {
+        sim.addNode(&node);
+    }
+    runBenchmark("4_RING", "chang_roberts", params, "events", [&]() { return (long long)sim.run().events; });
+    if (linkChoice != 4) {
+        for (const ChangRobertsNode &node : nodes) {
+            correct = correct && node.leaderID == simN;
+        }
+    }
+    if (!correct) {
+        cerr << "Wrong leader elected\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (benchmarkRequested(argc, argv)) {
+        return runBenchmarks(argc, argv);
+    }
+
+    int mode;
+    cout << "Select mode:\n";
+    cout << "1. Interactive ring election\n";
+    cout << "2. Benchmark simulation engine\n";
+    cout << "3. Compare concurrent election modes\n";
+    cout << "4. Threaded ring with SPSC links\n";
+    cout << "5. Failure injection and re-election\n";
+    cout << "6. Leader failover with heartbeat detection\n";
+    cout << "7. Chang-Roberts on the network simulator\n";
+    cout << "Enter choice: ";
+    cin >> mode;
+
+    if (mode == 1) {
+        return runInteractiveElection();
+    } else if (mode == 2) {
+        int maxN;
+        double baseNs, jitterNs;
+        cout << "Enter the largest ring size (e.g. 1000000): ";
+        cin >> maxN;
+        cout << "Enter the per-hop base latency and jitter in ns: ";
+        cin >> baseNs >> jitterNs;
+        benchmarkRingEngine(maxN, baseNs, jitterNs);
+    } else if (mode == 3) {
+        int maxN, threads;
+        double fraction, baseNs, jitterNs;
+        cout << "Enter the largest ring size (e.g. 1000000): ";
+        cin >> maxN;
+        cout << "Enter the fraction of processes that start an election (0 to 1): ";
+        cin >> fraction;
+        cout << "Enter the number of worker threads: ";
+        cin >> threads;
+        cout << "Enter the per-hop base latency and jitter in ns: ";
+        cin >> baseNs >> jitterNs;
+        if (fraction <= 0.0 || fraction > 1.0) {
+            cout << "Invalid fraction. Exiting...\n";
+            return 1;
+        }
+        compareElectionModes(maxN, fraction, threads, baseNs, jitterNs);
+    } else if (mode == 4) {
+        int n, maxThreads, laps, waitChoice;
+        cout << "Enter the number of processes: ";
+        cin >> n;
+        cout << "Enter the largest number of threads: ";
+        cin >> maxThreads;
+        cout << "Enter the number of laps for the traversal test: ";
+        cin >> laps;
+        cout << "Wait strategy (1 = busy-poll, 2 = blocking): ";
+        cin >> waitChoice;
+        if (n < 1 || laps < 1) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        benchmarkThreadedRing(n, maxThreads, laps, waitChoice == 1 ? BUSY_POLL : BLOCKING);
+    } else if (mode == 5) {
+        int n, successors, runs, count;
+        double timeoutNs;
+        uint64_t seed;
+        cout << "Enter the number of processes (e.g. 100000): ";
+        cin >> n;
+        cout << "Enter the successor list length: ";
+        cin >> successors;
+        cout << "Enter the failure-detection timeout in ns: ";
+        cin >> timeoutNs;
+        cout << "Enter the seed and the number of runs per failure rate: ";
+        cin >> seed >> runs;
+        cout << "Enter the number of scheduled crashes, then a hop and a process index for each: ";
+        cin >> count;
+        if (n < 2 || successors < 1 || runs < 1 || count < 0) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        vector<pair<long long, int>> scheduled(count);
+        for (auto &crash : scheduled) {
+            cin >> crash.first >> crash.second;
+            if (crash.second < 0 || crash.second >= n) {
+                cout << "Invalid process index. Exiting...\n";
+                return 1;
+            }
+        }
+        sort(scheduled.begin(), scheduled.end());
+        benchmarkFailureInjection(n, successors, timeoutNs, seed, runs, scheduled);
+    } else if (mode == 6) {
+        int n, kind;
+        double setting;
+        long long leaseMs, crashAtMs;
+        cout << "Enter the number of processes: ";
+        cin >> n;
+        cout << "Detector (1 = fixed timeout in ms, 2 = phi accrual threshold) and its setting: ";
+        cin >> kind >> setting;
+        cout << "Enter the lease duration and the crash time in ms: ";
+        cin >> leaseMs >> crashAtMs;
+        if (n < 2 || (kind != 1 && kind != 2) || !(setting > 0) || leaseMs < 1 || crashAtMs < 0) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        DetectorConfig cfg = { kind == 1 ? FIXED_TIMEOUT : PHI_ACCRUAL, setting, setting, 100 };
+        runLeaderFailover(n, cfg, leaseMs, crashAtMs, 42);
+    } else if (mode == 7) {
+        int n, linkChoice, maxPartitions;
+        cout << "Enter the number of processes: ";
+        cin >> n;
+        cout << "Link model (1 = fixed, 2 = jitter, 3 = jitter with FIFO channels, 4 = jitter with 1% loss): ";
+        cin >> linkChoice;
+        cout << "Enter the largest number of partitions (threads): ";
+        cin >> maxPartitions;
+        if (n < 2 || maxPartitions < 1) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        benchmarkSimulatedRing(n, linkChoice, maxPartitions);
+    } else {
+        cout << "Invalid choice. Exiting...\n";
+        return 1;
+    }
 
     return 0;
 }
@@ -69,7 +1275,16 @@ This code implements the **Ring Algorithm** for leader election in a distributed
    - The processes in the system are represented by a vector `processes`, where each process has a unique ID.
 
 2. **Input:**
-   - The user provides:
+   - The user first selects one of seven modes:
+     1. Interactive ring election (described below).
+     2. Benchmark of the simulation engine (`simulateRingElection`).
+     3. Chang-Roberts and Hirschberg-Sinclair with concurrent initiators.
+     4. Threaded ring with SPSC links (`ThreadedRing`).
+     5. Failure injection and re-election.
+     6. Leader failover with heartbeat detection and leases.
+     7. Chang-Roberts on the network simulator.
+   - Modes 2-7 are described in their own sections further down.
+   - In interactive mode the user provides:
      - Number of processes (`n`).
      - Unique IDs for each process.
      - The index of the initiator process that starts the election.
@@ -92,7 +1307,7 @@ This code implements the **Ring Algorithm** for leader election in a distributed
 
 3. **Leader Announcement:**
    - Once the ID completes a full round back to the initiator:
-     - The initiator determines the highest ID as the leader.
+     - The initiator determines the highest ID as the leader; the leader is reported as the process holding that ID, not the initiator.
      - The leader ID is then sent around the ring again, and all processes acknowledge it.
 
 4. **Output:**
@@ -103,6 +1318,11 @@ This code implements the **Ring Algorithm** for leader election in a distributed
 ### **Example Input/Output Walkthrough**
 - **Input:**
   ```
+  Select mode:
+  1. Interactive ring election
+  ...
+  7. Chang-Roberts on the network simulator
+  Enter choice: 1
   Enter the number of processes: 5
   Enter the unique IDs of the processes:
   ID for process P0: 12
@@ -137,6 +1357,72 @@ This code implements the **Ring Algorithm** for leader election in a distributed
 
 ---
 
+### **Simulation Engine (`simulateRingElection`)**
+- Runs the same election without printing anything per hop, so rings of 1M+ processes can be simulated.
+- Makes a single pass over the ring: the election token and the coordinator announcement use the same n links, so both messages of a hop are handled in one iteration.
+- Counts every message exactly (2n for a ring of n > 1 processes) and charges each one a sample of the `LatencyModel` (base latency plus seeded uniform jitter).
+- Returns the index and ID of the winning process, the message count and the simulated election time.
+
+- **Benchmark (mode 2):**
+  ```
+  Enter choice: 2
+  Enter the largest ring size (e.g. 1000000): 1000000
+  Enter the per-hop base latency and jitter in ns: 1000 200
+  ```
+  For n = 1000, 10000, ... up to the largest size, it reports elections/sec, messages per election, total messages and simulated time per election.
+
+---
+
+### **Concurrent Election Modes (`simulateConcurrentElection`)**
+- Several processes detect the failure at once and start an election. Every other process wakes up when the first message reaches it and takes part from then on, so every mode elects the highest process of the ring, the same leader as `ringAlgorithm` and `ThreadedRing`.
+- **LeLann (naive):** a process sends its own token when it wakes and every token goes round the whole ring, n * n messages.
+- **Chang-Roberts:** a waking process forwards the larger of its own ID and the received one, and becomes a candidate if its own is larger. A token is swallowed by the first process with a higher ID, so only the highest process's token comes back; it then announces itself.
+- **Hirschberg-Sinclair:** in phase p each active candidate probes 2^p hops in both directions and only stays active if both probes are replied to, giving O(n log n) messages. A sleeping process that only sees lower IDs wakes as a new candidate; candidates that lose become relays and pass later probes on.
+- The candidates' tokens are walked concurrently on a `ThreadPool` (`ThreadPool.h`, shared with 5_BULLY); each worker sums the messages of its own tokens.
+- Mode 3 compares total messages and time to convergence (critical-path hops charged through the latency model) for n = 1000, 10000, ..., and checks that each mode elected the highest process.
+
+---
+
+### **Threaded Ring (`ThreadedRing`)**
+- The ring is cut into contiguous shards and every shard runs on its own worker thread. Hops inside a shard are function calls; the last process of a shard passes messages to the next shard over a lock-free `SpscQueue` whose producer and consumer indices sit on separate cache lines.
+- `runElection` starts Chang-Roberts at every process at once and checks the leader and message count against `simulateConcurrentElection`.
+- `runTraversal` sends one probe round the ring for a number of laps to measure ring traversal time.
+- Two wait strategies: **busy-poll** spins on the queue, **blocking** parks the consumer on a condition variable that the producer only signals when the consumer is asleep.
+- Mode 4 doubles the thread count up to the given maximum and reports election time, the average time messages wait on links during the election, ns per lap, ns per hop and the cross-thread hop latency of the probe.
+
+---
+
+### **Failure Injection (`simulateElectionWithFailures`)**
+- Processes crash while the election runs: at each hop a random live process crashes with a given probability, and explicitly scheduled crashes fire at their hop. Everything is drawn from one seed, so a run can be replayed.
+- Every process knows a list of its next successors and forwards to the first live one. Each dead successor costs a message and a timeout, after which the sender links past it, so later laps only pay for live hops.
+- If the whole successor list is dead the token is lost: the holder repairs its link by probing the processes after the list one at a time (a message and a timeout each) and starts a new election.
+- A token held by a crashing process is lost; its sender notices after the timeout and starts a new election. If the winner crashes before the announcement completes, the election is repeated.
+- Mode 5 sweeps the crash probability (0 to 1e-2 per hop, e.g. at 100k processes) and reports crashes, elections, messages, the overhead against the 2 messages per surviving process of a failure-free election, timed-out sends, repairs and the simulated time to a stable leader.
+
+---
+
+### **Leader Failover (`FailureDetector.h`)**
+- A `HeartbeatMonitor` (fixed timeout or phi accrual, batched heartbeats on a hierarchical timer wheel) watches every process, and the leader holds a `LeaderLease` renewed by its heartbeats.
+- Mode 6 crashes the leader. The survivors decide from heartbeats and the lease alone: a suspicion before the lease has safely expired is rechecked at that point and dropped if a heartbeat renewed the lease; otherwise they take over and run the ring election. It reports detection latency, the takeover time, postponed and dropped suspicions and when the new leader is known. The detector sweep (latency against false positives) is mode 6 of the Bully program.
+
+---
+
+### **Network Simulator (`NetworkSimulator.h`)**
+- The shared discrete-event simulator (radix heap of events, pooled messages, pluggable link models) also drives the Lamport and Bully programs.
+- `ChangRobertsNode` runs Chang-Roberts with every process initiating; the winner sends the coordinator message round the ring. Without loss the message count has to match `simulateConcurrentElection`.
+- Mode 7 reports events per second for a fixed, jittered, FIFO or lossy link, sequentially and with the ring split into partitions that advance in conservative lockstep windows. A lost token stalls the election, which the `agreed` column shows.
+
+---
+
+### **Benchmark Mode (`--bench`)**
+- `./4_RING --bench n=100000 elections=50 sim_n=20000 link=2 partitions=1` skips the menu and prints two JSON lines:
+  - `election`: `elections` runs of `simulateRingElection` from random initiators, counted in messages
+  - `chang_roberts`: Chang-Roberts on the network simulator with every process initiating, counted in events
+- Each line has wall time, throughput and the hardware counters (`BenchmarkHarness.h`). A wrong leader makes the run exit with status 1.
+- `BenchmarkDriver.cpp` runs it with the other programs and flags regressions against a saved baseline.
+
+---
+
 ### **Key Features**
 - The algorithm guarantees a unique leader by propagating and comparing IDs.
 - The ring structure ensures fairness and participation of all processes.
@@ -144,7 +1430,6 @@ This code implements the **Ring Algorithm** for leader election in a distributed
 ---
 
 ### **Possible Enhancements**
-- Add termination conditions to stop the loop if a process fails.
 - Include timestamps or priorities to handle processes with identical IDs.
 
 3. Ring Algorithm
@@ -1,5 +1,19 @@
 #include <iostream>
+#include <iomanip>
 #include <vector>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <set>
+#include "BenchmarkHarness.h"
+#include "FailureDetector.h"
+#include "NetworkSimulator.h"
+#include "ThreadPool.h"
 
 using namespace std;
 
@@ -9,7 +23,7 @@ void bullyAlgo(vector<int>& pro, int n, int init1) {
         if (pro[i] > pro[init1]) {
             cout << "\nProcess " << pro[init1] << " initiates election." << endl;
             cout << "\nProcess " << pro[i] << " responds to process " << pro[init1] << endl;
-            l = pro[i];
+            l = max(l, pro[i]);
         }
     }
     if (l == -1) {
@@ -23,7 +37,848 @@ void bullyAlgo(vector<int>& pro, int n, int init1) {
     cout << "Final leader (coordinator) is process " << l << endl;
 }
 
-int main() {
+struct TimerEntry {
+    long long deadline;
+    int actor;
+    int kind;
+    unsigned generation;
+};
+
+// Hashed timer wheel with one-tick resolution. A timer lands in slot
+// deadline % slots and stays there for as many revolutions as it needs.
+// Timers are never removed early: the owner bumps its generation and stale
+// entries are dropped when they fire.
+class TimerWheel {
+public:
+    explicit TimerWheel(int slots) : wheel(slots), pending(0) {}
+
+    void schedule(const TimerEntry &timer) {
+        wheel[timer.deadline % wheel.size()].push_back(timer);
+        pending++;
+    }
+
+    // Moves the timers due at `tick` into `due`.
+    void expire(long long tick, vector<TimerEntry> &due) {
+        vector<TimerEntry> &slot = wheel[tick % wheel.size()];
+        size_t kept = 0;
+        for (size_t i = 0; i < slot.size(); i++) {
+            if (slot[i].deadline <= tick) {
+                due.push_back(slot[i]);
+            } else {
+                slot[kept++] = slot[i];
+            }
+        }
+        pending -= slot.size() - kept;
+        slot.resize(kept);
+    }
+
+    size_t size() const { return pending; }
+
+private:
+    vector<vector<TimerEntry>> wheel;
+    size_t pending;
+};
+
+enum BullyMessageType { ELECTION, OK, COORDINATOR };
+enum BullyTimerKind { OK_TIMEOUT, COORDINATOR_TIMEOUT };
+enum BullyState { IDLE, ELECTING, WAITING_FOR_COORDINATOR, FOLLOWER, LEADER };
+
+struct BullyMessage {
+    BullyMessageType type;
+    int from;
+    int multicast;  // index of the multicast it arrived on, or -1
+};
+
+// One message sent to every process with a rank in [lo, hi].
+struct Multicast {
+    BullyMessageType type;
+    int from, lo, hi;
+};
+
+struct BullyActor {
+    bool alive;
+    BullyState state;
+    int leader;
+    unsigned timerGeneration;
+    long long learnedTick;
+};
+
+struct BullyResult {
+    int leaderID;
+    bool agreed;          // every live process knows the highest live process
+    long long messages;
+    long long ticks;      // tick at which the last live process learned the leader
+    double wallMs;
+};
+
+// Event-driven Bully election. Every process is an actor with its own state;
+// time advances in ticks and a message sent in one tick is handled in the
+// next. The actors that have work in a tick are processed in parallel on the
+// thread pool, each worker writing into its own outbox; the outboxes are merged
+// at the end of the tick.
+//
+// Processes are kept sorted by ID, so "all higher processes" is a rank range
+// and is sent as one multicast instead of n separate envelopes. OK replies to
+// a multicast are counted per worker and handed to its sender as a single
+// batched OK. Every delivery still counts as one message. Without a pool the
+// actors are handled on the calling thread.
+class BullySimulation {
+public:
+    BullySimulation(const vector<int> &ids, const vector<char> &alive, ThreadPool *pool,
+                    int okTimeout = 3, int coordinatorTimeout = 10)
+        : n(ids.size()), pool(pool), okTimeout(okTimeout), coordinatorTimeout(coordinatorTimeout), timers(64) {
+        vector<int> order(n);
+        for (int i = 0; i < n; i++) {
+            order[i] = i;
+        }
+        sort(order.begin(), order.end(), [&](int a, int b) { return ids[a] < ids[b]; });
+        rankToID.resize(n);
+        rankOf.resize(n);
+        actors.resize(n);
+        for (int r = 0; r < n; r++) {
+            rankToID[r] = ids[order[r]];
+            rankOf[order[r]] = r;
+            actors[r] = { alive[order[r]] != 0, IDLE, -1, 0, -1 };
+        }
+        outboxes.resize(pool ? pool->size() : 1);
+        inbox.resize(n);
+        dueTimers.resize(n);
+    }
+
+    // Runs until no messages or timers are left. `initiators` are indices into
+    // the original ID vector of the processes that notice the failure at tick 0.
+    BullyResult run(const vector<int> &initiators) {
+        auto start = chrono::steady_clock::now();
+        tick = 0;
+        for (int i : initiators) {
+            if (actors[rankOf[i]].alive) {
+                startElection(rankOf[i], outboxes[0]);
+            }
+        }
+        collect();
+
+        while (!multicasts.empty() || pendingPoints > 0 || timers.size() > 0) {
+            tick++;
+            deliver();
+            collect();
+        }
+
+        BullyResult result = { -1, true, 0, 0, 0.0 };
+        int highest = -1;
+        for (int r = 0; r < n; r++) {
+            if (actors[r].alive) {
+                highest = r;
+            }
+        }
+        for (int r = 0; r < n; r++) {
+            if (!actors[r].alive) {
+                continue;
+            }
+            if (actors[r].leader != highest) {
+                result.agreed = false;
+            }
+            result.ticks = max(result.ticks, actors[r].learnedTick);
+        }
+        result.leaderID = highest >= 0 ? rankToID[highest] : -1;
+        result.messages = messages;
+        result.wallMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+private:
+    struct Outbox {
+        vector<pair<int, BullyMessage>> points;
+        vector<Multicast> multicasts;
+        vector<int> replies;  // OK replies per multicast of the current tick
+        vector<TimerEntry> timers;
+        long long messages = 0;
+    };
+
+    void send(Outbox &out, int from, int to, BullyMessageType type) {
+        out.points.push_back(make_pair(to, BullyMessage{ type, from, -1 }));
+        out.messages++;
+    }
+
+    void multicast(Outbox &out, int from, int lo, int hi, BullyMessageType type) {
+        if (lo <= hi) {
+            out.multicasts.push_back(Multicast{ type, from, lo, hi });
+            out.messages += hi - lo + 1;
+        }
+    }
+
+    void reply(Outbox &out, int from, const BullyMessage &msg, BullyMessageType type) {
+        if (msg.multicast >= 0) {
+            out.replies[msg.multicast]++;
+            out.messages++;
+        } else {
+            send(out, from, msg.from, type);
+        }
+    }
+
+    void setTimer(Outbox &out, int r, int delay, BullyTimerKind kind) {
+        out.timers.push_back(TimerEntry{ tick + delay, r, kind, ++actors[r].timerGeneration });
+    }
+
+    void becomeLeader(int r, Outbox &out) {
+        BullyActor &a = actors[r];
+        a.state = LEADER;
+        a.leader = r;
+        a.learnedTick = tick;
+        a.timerGeneration++;
+        multicast(out, r, 0, r - 1, COORDINATOR);
+    }
+
+    void startElection(int r, Outbox &out) {
+        if (r == n - 1) {
+            becomeLeader(r, out);
+            return;
+        }
+        actors[r].state = ELECTING;
+        multicast(out, r, r + 1, n - 1, ELECTION);
+        setTimer(out, r, okTimeout, OK_TIMEOUT);
+    }
+
+    void handleMessage(int r, const BullyMessage &msg, Outbox &out) {
+        BullyActor &a = actors[r];
+        switch (msg.type) {
+            case ELECTION:
+                reply(out, r, msg, OK);
+                if (a.state == LEADER) {
+                    send(out, r, msg.from, COORDINATOR);
+                } else if (a.state == IDLE || a.state == FOLLOWER) {
+                    startElection(r, out);
+                }
+                break;
+            case OK:
+                if (a.state == ELECTING) {
+                    a.state = WAITING_FOR_COORDINATOR;
+                    setTimer(out, r, coordinatorTimeout, COORDINATOR_TIMEOUT);
+                }
+                break;
+            case COORDINATOR:
+                if (msg.from >= r) {
+                    a.state = FOLLOWER;
+                    a.leader = msg.from;
+                    a.learnedTick = tick;
+                    a.timerGeneration++;
+                } else {
+                    startElection(r, out);  // a lower process claims to lead: bully it
+                }
+                break;
+        }
+    }
+
+    void handleTimer(int r, const TimerEntry &timer, Outbox &out) {
+        BullyActor &a = actors[r];
+        if (timer.generation != a.timerGeneration) {
+            return;  // cancelled
+        }
+        if (timer.kind == OK_TIMEOUT && a.state == ELECTING) {
+            becomeLeader(r, out);  // nobody higher answered
+        } else if (timer.kind == COORDINATOR_TIMEOUT && a.state == WAITING_FOR_COORDINATOR) {
+            startElection(r, out);  // the higher process died before announcing
+        }
+    }
+
+    // Handles every actor that has mail or a timer due in this tick.
+    void deliver() {
+        vector<TimerEntry> due;
+        timers.expire(tick, due);
+        vector<int> active;
+        for (const TimerEntry &t : due) {
+            if (dueTimers[t.actor].empty()) {
+                active.push_back(t.actor);
+            }
+            dueTimers[t.actor].push_back(t);
+        }
+        for (int r : pointTargets) {
+            if (dueTimers[r].empty()) {
+                active.push_back(r);
+            }
+        }
+        // Actors covered by a multicast, found with a difference array.
+        vector<int> cover(n + 1, 0);
+        for (const Multicast &m : multicasts) {
+            cover[m.lo]++;
+            cover[m.hi + 1]--;
+        }
+        for (int r = 0, c = 0; r < n; r++) {
+            c += cover[r];
+            if (c > 0 && inbox[r].empty() && dueTimers[r].empty()) {
+                active.push_back(r);
+            }
+        }
+
+        for (Outbox &out : outboxes) {
+            out.replies.assign(multicasts.size(), 0);
+        }
+        ThreadPool::Body body = [&](int w, int begin, int end) {
+            Outbox &out = outboxes[w];
+            for (int i = begin; i < end; i++) {
+                int r = active[i];
+                if (actors[r].alive) {
+                    for (const TimerEntry &t : dueTimers[r]) {
+                        handleTimer(r, t, out);
+                    }
+                    for (const BullyMessage &msg : inbox[r]) {
+                        handleMessage(r, msg, out);
+                    }
+                    for (size_t m = 0; m < multicasts.size(); m++) {
+                        const Multicast &mc = multicasts[m];
+                        if (mc.lo <= r && r <= mc.hi) {
+                            handleMessage(r, BullyMessage{ mc.type, mc.from, (int)m }, out);
+                        }
+                    }
+                }
+                dueTimers[r].clear();
+                inbox[r].clear();
+            }
+        };
+        if (pool) {
+            pool->parallelFor(active.size(), body);
+        } else {
+            body(0, 0, active.size());
+        }
+    }
+
+    // Merges the worker outboxes into the mail for the next tick.
+    void collect() {
+        vector<Multicast> next;
+        pointTargets.clear();
+        pendingPoints = 0;
+        for (size_t m = 0; m < multicasts.size(); m++) {
+            int oks = 0;
+            for (Outbox &out : outboxes) {
+                oks += out.replies.empty() ? 0 : out.replies[m];
+            }
+            if (oks > 0) {
+                addPoint(multicasts[m].from, BullyMessage{ OK, -1, -1 });
+            }
+        }
+        for (Outbox &out : outboxes) {
+            for (auto &p : out.points) {
+                addPoint(p.first, p.second);
+            }
+            next.insert(next.end(), out.multicasts.begin(), out.multicasts.end());
+            for (const TimerEntry &t : out.timers) {
+                timers.schedule(t);
+            }
+            messages += out.messages;
+            out.points.clear();
+            out.multicasts.clear();
+            out.timers.clear();
+            out.replies.clear();
+            out.messages = 0;
+        }
+        multicasts.swap(next);
+    }
+
+    void addPoint(int to, const BullyMessage &msg) {
+        if (inbox[to].empty()) {
+            pointTargets.push_back(to);
+        }
+        inbox[to].push_back(msg);
+        pendingPoints++;
+    }
+
+    int n;
+    ThreadPool *pool;
+    int okTimeout, coordinatorTimeout;
+    vector<int> rankToID, rankOf;
+    vector<BullyActor> actors;
+    vector<Outbox> outboxes;
+    vector<vector<BullyMessage>> inbox;
+    vector<vector<TimerEntry>> dueTimers;
+    vector<int> pointTargets;
+    vector<Multicast> multicasts;
+    TimerWheel timers;
+    long long pendingPoints = 0;
+    long long messages = 0;
+    long long tick = 0;
+};
+
+// Process IDs 1..n in random order; the process holding ID n (the old
+// coordinator) has crashed.
+void benchmarkBully(int maxN, int threads, int initiatorCount) {
+    ThreadPool pool(threads);
+    cout << "\nOld coordinator crashed, " << initiatorCount << " initiator(s), " << pool.size() << " worker threads\n";
+    cout << setw(8) << "n" << setw(14) << "messages" << setw(8) << "ticks" << setw(12) << "wall ms"
+         << setw(14) << "Mmsgs/sec" << setw(8) << "leader" << setw(8) << "agreed" << "\n";
+
+    for (int n = 1000; n <= maxN; n *= 2) {
+        vector<int> pro(n);
+        for (int i = 0; i < n; i++) {
+            pro[i] = i + 1;
+        }
+        mt19937 rng(n);
+        shuffle(pro.begin(), pro.end(), rng);
+        vector<char> alive(n, 1);
+        int lowest = 0;
+        for (int i = 0; i < n; i++) {
+            if (pro[i] == n) {
+                alive[i] = 0;
+            }
+            if (pro[i] == 1) {
+                lowest = i;
+            }
+        }
+        // A single initiator is the lowest process, which makes every other
+        // process join the election. Otherwise pick random live processes.
+        vector<int> initiators;
+        if (initiatorCount <= 1) {
+            initiators.push_back(lowest);
+        } else {
+            for (int k = 0; k < initiatorCount; k++) {
+                int i;
+                do {
+                    i = rng() % n;
+                } while (!alive[i]);
+                initiators.push_back(i);
+            }
+        }
+
+        BullySimulation sim(pro, alive, &pool);
+        BullyResult r = sim.run(initiators);
+        cout << setw(8) << n << setw(14) << r.messages << setw(8) << r.ticks << setw(12) << fixed
+             << setprecision(2) << r.wallMs << setw(14) << r.messages / r.wallMs / 1000 << setw(8) << r.leaderID
+             << setw(8) << (r.agreed ? "yes" : "no") << "\n";
+    }
+}
+
+// Depth of a tree with the given fan-out that reaches `count` nodes from its root.
+int fanoutDepth(int count, int fanout) {
+    int depth = 0;
+    for (long long reached = 1, level = 1; reached < count; depth++) {
+        level *= fanout;
+        reached += level;
+    }
+    return depth;
+}
+
+// Two-level Bully election. Processes are cut into shards of groupSize by
+// position; every shard elects a group leader with its own BullySimulation
+// (shards run in parallel on the pool), then the group leaders elect the
+// global coordinator among themselves. Each group leader finally passes the
+// announcement down a tree with the given fan-out inside its shard, so no
+// process sends more than `fanout` notifications. Every level starts from its
+// lowest live process, the worst case for Bully.
+BullyResult hierarchicalBully(const vector<int> &pro, const vector<char> &alive, int groupSize, int fanout,
+                              ThreadPool &pool) {
+    auto start = chrono::steady_clock::now();
+    int n = pro.size();
+    int groups = (n + groupSize - 1) / groupSize;
+    vector<int> groupLeader(groups, -1), groupAlive(groups, 0);
+    vector<long long> groupMessages(groups, 0), groupTicks(groups, 0);
+    vector<char> groupAgreed(groups, 1);
+
+    pool.parallelFor(groups, [&](int, int begin, int end) {
+        for (int g = begin; g < end; g++) {
+            int lo = g * groupSize, hi = min(n, lo + groupSize);
+            vector<int> ids(pro.begin() + lo, pro.begin() + hi);
+            vector<char> up(alive.begin() + lo, alive.begin() + hi);
+            int initiator = -1;
+            for (int i = 0; i < hi - lo; i++) {
+                if (up[i]) {
+                    groupAlive[g]++;
+                    if (initiator < 0 || ids[i] < ids[initiator]) {
+                        initiator = i;
+                    }
+                }
+            }
+            if (initiator < 0) {
+                continue;
+            }
+            BullySimulation sim(ids, up, nullptr);
+            BullyResult r = sim.run(vector<int>(1, initiator));
+            groupLeader[g] = r.leaderID;
+            groupMessages[g] = r.messages;
+            groupTicks[g] = r.ticks;
+            groupAgreed[g] = r.agreed;
+        }
+    });
+
+    BullyResult result = { -1, true, 0, 0, 0.0 };
+    vector<int> leaders;
+    long long shardTicks = 0;
+    int deepest = 0;
+    for (int g = 0; g < groups; g++) {
+        result.messages += groupMessages[g];
+        result.agreed = result.agreed && groupAgreed[g];
+        shardTicks = max(shardTicks, groupTicks[g]);
+        if (groupLeader[g] >= 0) {
+            leaders.push_back(groupLeader[g]);
+            result.messages += groupAlive[g] - 1;  // announcement tree inside the shard
+            deepest = max(deepest, fanoutDepth(groupAlive[g], fanout));
+        }
+    }
+    if (leaders.empty()) {
+        return result;
+    }
+
+    int lowest = min_element(leaders.begin(), leaders.end()) - leaders.begin();
+    BullySimulation top(leaders, vector<char>(leaders.size(), 1), leaders.size() > 1000 ? &pool : nullptr);
+    BullyResult global = top.run(vector<int>(1, lowest));
+    result.leaderID = global.leaderID;
+    result.messages += global.messages;
+    result.agreed = result.agreed && global.agreed;
+    result.ticks = shardTicks + global.ticks + deepest;
+    result.wallMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// Flat Bully against the two-level election on the same processes: IDs 1..n
+// in random order and the old coordinator (ID n) crashed. Flat runs larger
+// than maxFlatN are not simulated; their count comes from the closed form
+// a * n - 1 for a live processes and the lowest process as initiator.
+void compareHierarchicalBully(int maxN, int maxFlatN, int groupSize, int fanout, int threads) {
+    ThreadPool pool(threads);
+    const int sizes[] = { 1000, 2000, 5000, 10000, 20000, 50000, 100000 };
+
+    cout << "\nShards of " << groupSize << ", announcement fan-out " << fanout << ", " << pool.size()
+         << " worker threads\n";
+    cout << setw(8) << "n" << setw(16) << "flat msgs" << setw(8) << "ticks" << setw(12) << "wall ms"
+         << setw(14) << "hier msgs" << setw(8) << "ticks" << setw(12) << "wall ms" << setw(10) << "ratio"
+         << setw(8) << "agreed" << "\n";
+
+    for (int n : sizes) {
+        if (n > maxN) {
+            break;
+        }
+        vector<int> pro(n);
+        for (int i = 0; i < n; i++) {
+            pro[i] = i + 1;
+        }
+        mt19937 rng(n);
+        shuffle(pro.begin(), pro.end(), rng);
+        vector<char> alive(n, 1);
+        int lowest = 0;
+        for (int i = 0; i < n; i++) {
+            if (pro[i] == n) {
+                alive[i] = 0;
+            }
+            if (pro[i] == 1) {
+                lowest = i;
+            }
+        }
+
+        BullyResult flat = { n - 1, true, (long long)(n - 1) * n - 1, 5, 0.0 };
+        bool simulated = n <= maxFlatN;
+        if (simulated) {
+            BullySimulation sim(pro, alive, &pool);
+            flat = sim.run(vector<int>(1, lowest));
+        }
+        BullyResult hier = hierarchicalBully(pro, alive, groupSize, fanout, pool);
+
+        cout << setw(8) << n << setw(16) << flat.messages << setw(8) << flat.ticks << setw(12) << fixed
+             << setprecision(2);
+        if (simulated) {
+            cout << flat.wallMs;
+        } else {
+            cout << "(model)";
+        }
+        cout << setw(14) << hier.messages << setw(8) << hier.ticks << setw(12) << hier.wallMs << setw(9)
+             << setprecision(1) << (double)flat.messages / hier.messages << "x" << setw(8)
+             << (flat.agreed && hier.agreed && hier.leaderID == n - 1 ? "yes" : "no") << "\n";
+    }
+}
+
+// Live process IDs kept in an ordered set. Joins, departures and failures are
+// O(log n), the next coordinator is the largest live ID, and the processes
+// with a higher priority than a given ID are a contiguous range of the set,
+// so none of these needs a scan over every process the way bullyAlgo does.
+class LiveMembership {
+public:
+    void join(int id) { live.insert(id); }
+    void leave(int id) { live.erase(id); }
+    bool contains(int id) const { return live.count(id) != 0; }
+    int size() const { return live.size(); }
+
+    int coordinator() const { return live.empty() ? -1 : *live.rbegin(); }
+
+    // Live IDs higher than id, in increasing order: [higherBegin(id), end()).
+    set<int>::const_iterator higherBegin(int id) const { return live.upper_bound(id); }
+    set<int>::const_iterator end() const { return live.end(); }
+
+    // Outcome of a Bully election started by `initiator`: the initiator wins
+    // if nobody above it is alive, otherwise the highest live process does.
+    int elect(int initiator) const {
+        return higherBegin(initiator) == end() ? initiator : coordinator();
+    }
+
+private:
+    set<int> live;
+};
+
+// Same election by scanning every live process, as bullyAlgo does.
+int electByScan(const vector<int> &live, int initiator) {
+    int l = -1;
+    for (int id : live) {
+        if (id > initiator) {
+            l = max(l, id);
+        }
+    }
+    return l == -1 ? initiator : l;
+}
+
+// Churn workload: 40% joins, 20% departures, 20% coordinator failures followed
+// by a re-election and 20% elections from a random initiator, so the
+// membership stays around n. Both variants
+// keep the same vector of members for sampling; only the election and the
+// membership bookkeeping differ.
+void benchmarkChurn(int maxN, double seconds) {
+    cout << "\n" << setw(10) << "n" << setw(20) << "scan elections/s" << setw(22) << "indexed elections/s"
+         << setw(10) << "speedup" << "\n";
+
+    for (int n = 1000; n <= maxN; n *= 10) {
+        double rates[2];
+        for (int indexed = 0; indexed < 2; indexed++) {
+            mt19937 rng(n);
+            vector<int> members;
+            vector<int> position;  // index in members by ID, -1 once gone
+            LiveMembership membership;
+            int nextID = 1;
+            auto add = [&]() {
+                position.push_back(members.size());
+                members.push_back(nextID);
+                if (indexed) {
+                    membership.join(nextID);
+                }
+                nextID++;
+            };
+            auto remove = [&](int id) {
+                int at = position[id - 1];
+                members[at] = members.back();
+                position[members[at] - 1] = at;
+                members.pop_back();
+                position[id - 1] = -1;
+                if (indexed) {
+                    membership.leave(id);
+                }
+            };
+            for (int i = 0; i < n; i++) {
+                add();
+            }
+
+            long long elections = 0, checksum = 0;
+            auto start = chrono::steady_clock::now();
+            double elapsed = 0.0;
+            for (long long op = 0; elapsed < seconds; op++) {
+                int kind = rng() % 100;
+                if (kind < 40) {
+                    add();
+                } else if (kind < 60 && members.size() > 1) {
+                    remove(members[rng() % members.size()]);
+                } else if (kind < 80 && members.size() > 1) {
+                    int leader = indexed ? membership.coordinator() : electByScan(members, 0);
+                    remove(leader);
+                    int initiator = members[rng() % members.size()];
+                    checksum += indexed ? membership.elect(initiator) : electByScan(members, initiator);
+                    elections++;
+                } else {
+                    int initiator = members[rng() % members.size()];
+                    checksum += indexed ? membership.elect(initiator) : electByScan(members, initiator);
+                    elections++;
+                }
+                if ((op & 255) == 0) {
+                    elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                }
+            }
+            rates[indexed] = elections / elapsed;
+            if (checksum == 0) {
+                cout << "(no elections)\n";
+            }
+        }
+        cout << setw(10) << n << setw(20) << fixed << setprecision(0) << rates[0] << setw(22) << rates[1]
+             << setw(9) << setprecision(1) << rates[1] / rates[0] << "x\n";
+    }
+}
+
+// Bully on the shared discrete-event simulator with point-to-point messages.
+// Node r holds the r-th lowest ID, so the higher processes are the nodes after
+// it. Timeouts are simulator timers tagged with a generation number; bumping
+// the generation cancels the pending timer. A coordinator message from a lower
+// process starts a new election, so an election that went wrong because of a
+// lost OK is corrected by the real leader.
+enum BullySimMessage { SIM_ELECTION, SIM_OK, SIM_COORDINATOR, SIM_OK_TIMEOUT, SIM_COORDINATOR_TIMEOUT };
+
+class BullySimNode : public SimNode {
+public:
+    BullySimNode(int n, bool alive, uint64_t okTimeoutNs, uint64_t coordinatorTimeoutNs)
+        : n(n), alive(alive), okTimeoutNs(okTimeoutNs), coordinatorTimeoutNs(coordinatorTimeoutNs) {}
+
+    void onStart(SimContext &ctx) override {
+        if (initiator && alive) {
+            startElection(ctx);
+        }
+    }
+
+    void onMessage(SimContext &ctx, const SimMessage &msg) override {
+        if (!alive) {
+            return;
+        }
+        switch (msg.type) {
+            case SIM_ELECTION:
+                ctx.send(msg.from, SIM_OK);
+                if (!electing) {
+                    startElection(ctx);
+                }
+                break;
+            case SIM_OK:
+                if (electing && !gotOk) {
+                    gotOk = true;
+                    ctx.schedule(coordinatorTimeoutNs, SIM_COORDINATOR_TIMEOUT, ++generation);
+                }
+                break;
+            case SIM_COORDINATOR:
+                if (msg.from < ctx.self()) {
+                    startElection(ctx);
+                } else {
+                    leader = msg.from;
+                    learnedAtNs = ctx.now();
+                    electing = false;
+                    generation++;
+                }
+                break;
+            case SIM_OK_TIMEOUT:
+                if (msg.a == (long long)generation) {
+                    becomeLeader(ctx);
+                }
+                break;
+            case SIM_COORDINATOR_TIMEOUT:
+                if (msg.a == (long long)generation) {
+                    startElection(ctx);
+                }
+                break;
+        }
+    }
+
+    int n;
+    bool alive;
+    bool initiator = false;
+    int leader = -1;
+    uint64_t learnedAtNs = 0;  // when this node last learned the leader
+
+private:
+    void startElection(SimContext &ctx) {
+        electing = true;
+        gotOk = false;
+        if (ctx.self() == n - 1) {
+            becomeLeader(ctx);
+            return;
+        }
+        for (int r = ctx.self() + 1; r < n; r++) {
+            ctx.send(r, SIM_ELECTION);
+        }
+        ctx.schedule(okTimeoutNs, SIM_OK_TIMEOUT, ++generation);
+    }
+
+    void becomeLeader(SimContext &ctx) {
+        leader = ctx.self();
+        learnedAtNs = ctx.now();
+        electing = false;
+        generation++;
+        for (int r = 0; r < ctx.self(); r++) {
+            ctx.send(r, SIM_COORDINATOR);
+        }
+    }
+
+    uint64_t okTimeoutNs, coordinatorTimeoutNs;
+    bool electing = false, gotOk = false;
+    unsigned generation = 0;
+};
+
+// The highest process has crashed and the lowest one starts the election.
+// Without loss every run has to match the closed form n(n - 1) - 1 of
+// BullySimulation.
+void benchmarkSimulatedBully(int maxN, int linkChoice, int partitions) {
+    cout << "\nOld coordinator crashed, lowest process initiates, " << partitions << " partition(s)\n";
+    cout << setw(8) << "n" << setw(14) << "messages" << setw(10) << "lost" << setw(14) << "events" << setw(12)
+         << "wall ms" << setw(16) << "Mevents/sec" << setw(16) << "sim time (us)" << setw(8) << "agreed" << "\n";
+    for (int n = 250; n <= maxN; n *= 2) {
+        LinkModelChoice link(linkChoice, 1000);
+        vector<BullySimNode> nodes;
+        nodes.reserve(n);
+        for (int r = 0; r < n; r++) {
+            nodes.emplace_back(n, r != n - 1, 4000, 20000);
+        }
+        nodes[0].initiator = true;
+        NetworkSimulator sim(link.get(), partitions, 42);
+        for (BullySimNode &node : nodes) {
+            sim.addNode(&node);
+        }
+        SimStats stats = sim.run();
+        bool agreed = true;
+        for (const BullySimNode &node : nodes) {
+            agreed = agreed && (!node.alive || node.leader == n - 2);
+        }
+        if (stats.dropped == 0 && (long long)stats.messages != (long long)n * (n - 1) - 1) {
+            cout << "Simulated election disagrees with the closed form (" << stats.messages << " messages)\n";
+            return;
+        }
+        cout << setw(8) << n << setw(14) << stats.messages << setw(10) << stats.dropped << setw(14) << stats.events
+             << setw(12) << fixed << setprecision(1) << stats.wallMs << setw(16) << setprecision(2)
+             << stats.events / stats.wallMs / 1000 << setw(16) << setprecision(1) << stats.endTimeNs / 1e3 << setw(8)
+             << (agreed ? "yes" : "no") << "\n";
+    }
+}
+
+// The coordinator crashes while a HeartbeatMonitor watches every process. The
+// others cannot see the crash, only missing heartbeats: a suspicion before the
+// coordinator's lease has safely run out is rechecked at that point and
+// dropped if the lease was renewed. Once they take over, the lowest process
+// starts a Bully election on the network simulator, so its messages and
+// latency are added to the failover time.
+void runLeaderFailover(int n, const DetectorConfig &cfg, long long leaseMs, long long crashAtMs, uint64_t seed) {
+    HeartbeatNetwork net = { n, 100, 2.0, 5.0, 0.01 };
+    int leaderNode = n - 1;  // node r holds ID r + 1
+
+    HeartbeatMonitor monitor(net, cfg, seed);
+    LeaderLease lease(leaseMs, leaseMs / 10);
+    monitor.trackLease(leaderNode, &lease);
+    monitor.crash(leaderNode, crashAtMs);
+
+    LeaderTakeover d = awaitLeaderTakeover(monitor, lease, leaderNode, crashAtMs + 60000);
+    if (d.takeoverAtMs < 0) {
+        cout << "The coordinator was never replaced.\n";
+        return;
+    }
+
+    LinkModelChoice link(1, 1000);
+    vector<BullySimNode> nodes;
+    nodes.reserve(n);
+    for (int r = 0; r < n; r++) {
+        nodes.emplace_back(n, r != leaderNode, 4000, 20000);
+    }
+    nodes[0].initiator = true;
+    NetworkSimulator sim(link.get(), 1, seed);
+    for (BullySimNode &node : nodes) {
+        sim.addNode(&node);
+    }
+    SimStats election = sim.run();
+    uint64_t learnedNs = 0;
+    for (const BullySimNode &node : nodes) {
+        if (node.alive) {
+            learnedNs = max(learnedNs, node.learnedAtNs);
+        }
+    }
+    double electedAt = d.takeoverAtMs + learnedNs / 1e6;
+    DetectorStats s = monitor.stats();
+
+    cout << "\nCoordinator " << leaderNode + 1 << " crashed at " << crashAtMs << " ms\n";
+    cout << "Suspected at " << d.suspectedAtMs << " ms (detection latency " << d.suspectedAtMs - crashAtMs
+         << " ms)\n";
+    cout << "Taken over at " << d.takeoverAtMs << " ms, lease safe to take over at " << lease.safeTakeoverMs()
+         << " ms\n";
+    cout << "Bully election: " << election.messages << " messages, process " << nodes[0].leader + 1
+         << " elected at " << fixed << setprecision(3) << electedAt << " ms (" << electedAt - crashAtMs
+         << " ms after the crash)\n";
+    cout << "Suspicions postponed under the lease: " << d.postponed << ", dropped after it was renewed: "
+         << d.dropped << "\n";
+    cout << "False suspicions of other processes: " << s.falsePositives << ", heartbeats simulated: "
+         << s.heartbeatsSent << " in " << setprecision(1) << s.wallMs << " ms\n";
+}
+
+int runInteractiveElection() {
     int n, init1;
     cout << "\nEnter number of processes:\n";
     cin >> n;
@@ -38,6 +893,176 @@ int main() {
     return 0;
 }
 
+// --bench n=8000 threads=1 sim_n=1000 link=2 partitions=1: the event-driven
+// election with the old coordinator crashed and the lowest process initiating,
+// then the same election on the network simulator. Work is counted in
+// messages and events.
+int runBenchmarks(int argc, char **argv) {
+    BenchmarkParams params(argc, argv, 2);
+    int n = params.integer("n", 8000);
+    int threads = params.integer("threads", 1);
+    int simN = params.integer("sim_n", 1000);
+    int linkChoice = params.integer("link", 2);
+    int partitions = params.integer("partitions", 1);
+    if (n < 2 || simN < 2) {
+        cerr << "Invalid number of processes\n";
+        return 1;
+    }
+
+    vector<int> pro(n);
+    for (int i = 0; i < n; i++) {
+        pro[i] = i + 1;
+    }
+    mt19937 rng(n);
+    shuffle(pro.begin(), pro.end(), rng);
+    vector<char> alive(n, 1);
+    int lowest = 0;
+    for (int i = 0; i < n; i++) {
+        if (pro[i] == n) {
+            alive[i] = 0;
+        }
+        if (pro[i] == 1) {
+            lowest = i;
+        }
+    }
+    bool correct = true;
+    runBenchmark("5_BULLY", "election", params, "messages", [&]() {
+        // Built inside the measurement so the counters follow the pool's threads.
+        ThreadPool pool(threads);
+        BullySimulation election(pro, alive, &pool);
+        BullyResult r = election.run(vector<int>(1, lowest));
+        correct = r.agreed && r.leaderID == n - 1;
+        return r.messages;
+    });
+
+    LinkModelChoice link(linkChoice, 1000);
+    vector<BullySimNode> nodes;
+    nodes.reserve(simN);
+    for (int r = 0; r < simN; r++) {
+        nodes.emplace_back(simN, r != simN - 1, 4000, 20000);
+    }
+    nodes[0].initiator = true;
+    NetworkSimulator sim(link.get(), partitions, 42);
+    for (BullySimNode &node : nodes) {
+        sim.addNode(&node);
+    }
+    runBenchmark("5_BULLY", "simulated", params, "events", [&]() { return (long long)sim.run().events; });
+    if (linkChoice != 4) {
+        for (const BullySimNode &node : nodes) {
+            correct = correct && (!node.alive || node.leader == simN - 2);
+        }
+    }
+    if (!correct) {
+        cerr << "Wrong leader elected\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (benchmarkRequested(argc, argv)) {
+        return runBenchmarks(argc, argv);
+    }
+
+    int mode;
+    cout << "Select mode:\n";
+    cout << "1. Interactive bully election\n";
+    cout << "2. Event-driven election benchmark\n";
+    cout << "3. Hierarchical vs flat election\n";
+    cout << "4. Re-election rate under churn\n";
+    cout << "5. Leader failover with heartbeat detection\n";
+    cout << "6. Failure detector latency vs false positives\n";
+    cout << "7. Point-to-point election on the network simulator\n";
+    cout << "Enter choice: ";
+    cin >> mode;
+
+    if (mode == 1) {
+        return runInteractiveElection();
+    } else if (mode == 2) {
+        int maxN, threads, initiators;
+        cout << "Enter the largest number of processes (e.g. 8000): ";
+        cin >> maxN;
+        cout << "Enter the number of worker threads: ";
+        cin >> threads;
+        cout << "Enter the number of processes that start an election: ";
+        cin >> initiators;
+        benchmarkBully(maxN, threads, initiators);
+    } else if (mode == 3) {
+        int maxN, maxFlatN, groupSize, fanout, threads;
+        cout << "Enter the largest number of processes (e.g. 100000): ";
+        cin >> maxN;
+        cout << "Enter the largest flat election to simulate (larger ones use the closed form): ";
+        cin >> maxFlatN;
+        cout << "Enter the shard size and the announcement fan-out: ";
+        cin >> groupSize >> fanout;
+        cout << "Enter the number of worker threads: ";
+        cin >> threads;
+        if (groupSize < 1 || fanout < 1) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        compareHierarchicalBully(maxN, maxFlatN, groupSize, fanout, threads);
+    } else if (mode == 4) {
+        int maxN;
+        double seconds;
+        cout << "Enter the largest number of processes (e.g. 1000000): ";
+        cin >> maxN;
+        cout << "Enter the seconds to run each workload: ";
+        cin >> seconds;
+        benchmarkChurn(maxN, seconds);
+    } else if (mode == 5) {
+        int n, kind;
+        double setting;
+        long long leaseMs, crashAtMs;
+        cout << "Enter the number of processes (e.g. 1000): ";
+        cin >> n;
+        cout << "Detector (1 = fixed timeout in ms, 2 = phi accrual threshold) and its setting: ";
+        cin >> kind >> setting;
+        cout << "Enter the lease duration and the crash time in ms: ";
+        cin >> leaseMs >> crashAtMs;
+        if (n < 2 || (kind != 1 && kind != 2) || !(setting > 0) || leaseMs < 1 || crashAtMs < 0) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        DetectorConfig cfg = { kind == 1 ? FIXED_TIMEOUT : PHI_ACCRUAL, setting, setting, 100 };
+        runLeaderFailover(n, cfg, leaseMs, crashAtMs, 42);
+    } else if (mode == 6) {
+        int n, intervalMs;
+        double baseDelayMs, tailDelayMs, lossRate, crashFraction, seconds;
+        cout << "Enter the number of monitored nodes (e.g. 100000): ";
+        cin >> n;
+        cout << "Enter the heartbeat interval in ms: ";
+        cin >> intervalMs;
+        cout << "Enter the base delay, mean tail delay (ms) and loss rate (0 to 1): ";
+        cin >> baseDelayMs >> tailDelayMs >> lossRate;
+        cout << "Enter the fraction of nodes that crash and the simulated seconds: ";
+        cin >> crashFraction >> seconds;
+        if (n < 1 || intervalMs < 1 || seconds <= 0) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        HeartbeatNetwork net = { n, intervalMs, baseDelayMs, tailDelayMs, lossRate };
+        benchmarkFailureDetectors(net, (long long)(seconds * 1000), crashFraction, 42);
+    } else if (mode == 7) {
+        int maxN, linkChoice, partitions;
+        cout << "Enter the largest number of processes (e.g. 4000): ";
+        cin >> maxN;
+        cout << "Link model (1 = fixed, 2 = jitter, 3 = jitter with FIFO channels, 4 = jitter with 1% loss): ";
+        cin >> linkChoice;
+        cout << "Enter the number of partitions (threads): ";
+        cin >> partitions;
+        if (maxN < 250 || partitions < 1) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        benchmarkSimulatedBully(maxN, linkChoice, partitions);
+    } else {
+        cout << "Invalid choice. Exiting...\n";
+        return 1;
+    }
+    return 0;
+}
+
 /*
 This program implements the **Bully Algorithm**, which is used for leader election in distributed systems. The algorithm selects the process with the highest ID as the leader (coordinator) after an election initiated by a process.
 
@@ -67,7 +1092,7 @@ This program implements the **Bully Algorithm**, which is used for leader electi
    - If a higher ID is found, that process responds and is considered a candidate for leadership.
 
 2. **Leader Determination:**
-   - The highest ID among the processes that responded becomes the new leader.
+   - The highest ID among the processes that responded becomes the new leader (the maximum, not the last responder found).
    - If no process responds (no higher ID exists), the initiator becomes the leader.
 
 3. **Leader Announcement:**
@@ -78,9 +1103,23 @@ This program implements the **Bully Algorithm**, which is used for leader electi
 ### **Detailed Code Flow**
 
 1. **Input Handling:**
+   - The user first selects one of seven modes:
+     1. Interactive bully election (described below).
+     2. Event-driven election benchmark (`BullySimulation`).
+     3. Hierarchical vs flat election (`hierarchicalBully`).
+     4. Re-election rate under churn (`LiveMembership`).
+     5. Leader failover with heartbeat detection and leases.
+     6. Failure detector latency vs false positives.
+     7. Point-to-point election on the network simulator.
+   - Modes 2-7 are described in their own sections further down.
    - The user inputs the number of processes, their IDs, and the initiator ID.
    - Example:
      ```
+     Select mode:
+     1. Interactive bully election
+     ...
+     7. Point-to-point election on the network simulator
+     Enter choice: 1
      Enter number of processes:
      4
      Enter process ID of process 0 :
@@ -121,6 +1160,56 @@ This program implements the **Bully Algorithm**, which is used for leader electi
 
 ---
 
+### **Event-Driven Simulation (`BullySimulation`)**
+- Every process is an actor with its own state (idle, electing, waiting for a coordinator, follower, leader).
+- Time advances in ticks; a message sent in one tick is handled in the next, and timeouts live in a hashed `TimerWheel`. Cancelled timers are dropped lazily through a per-actor generation number.
+- The full protocol runs: ELECTION to all higher processes, OK replies, an OK timeout after which a process declares itself coordinator, a coordinator timeout that restarts the election, and a COORDINATOR broadcast to all lower processes. Higher processes start their own elections when they hear from a lower one, so elections cascade.
+- The actors with work in a tick run in parallel on a `ThreadPool` (`ThreadPool.h`, shared with 4_RING), each worker writing into its own outbox; the outboxes are merged at the end of the tick.
+- "All higher" and "all lower" are rank ranges, so they are sent as one multicast, and OK replies to a multicast are batched into one OK for its sender. Every delivery is still counted as a message.
+- Mode 2 crashes the old coordinator and reports messages, ticks and wall-clock time to convergence for 1000, 2000, 4000, ... processes. With the lowest process as the only initiator the count is n(n-1) - 1 messages.
+
+---
+
+### **Hierarchical Election (`hierarchicalBully`)**
+- Flat Bully costs O(n^2) messages in the worst case, and the coordinator notifies the other n - 1 processes one by one.
+- The hierarchical mode cuts the processes into fixed-size shards. Each shard elects a group leader (shards run in parallel), then the group leaders elect the global coordinator among themselves.
+- The announcement goes down a tree: every group leader notifies its shard through a tree with a fixed fan-out, so nobody sends more than `fanout` notifications and the announcement takes O(log n) ticks.
+- Mode 3 compares messages, ticks and wall time of flat and hierarchical elections from 1k to 100k processes. Flat runs above a chosen size are not simulated; their count comes from the closed form n(n-1) - 1.
+
+---
+
+### **Indexed Membership (`LiveMembership`)**
+- `bullyAlgo` scans every process to find the higher IDs on each election, which is O(n) per election.
+- `LiveMembership` keeps the live IDs in an ordered set: joins, departures and failures are O(log n), the next coordinator after a failure is the largest live ID, and the higher-priority peers of a process are the range `[higherBegin(id), end())`, walked without a full scan.
+- Mode 4 runs a churn workload (joins, departures, coordinator failures with re-election, elections from random initiators) and reports elections/sec for the scan and the indexed structure.
+
+---
+
+### **Failure Detection and Leases (`FailureDetector.h`)**
+- A `HeartbeatMonitor` watches every process on a simulated network with base delay, an exponential delay tail and message loss.
+- Two detectors: a **fixed timeout** after the last heartbeat, and **phi accrual**, which suspects a process once the current silence is improbable given the observed heartbeat intervals.
+- Heartbeats are batched per tick: all processes in the same send phase share one timer entry, heartbeats that arrive in the same tick travel as one batch, and each process has at most one suspicion check in a hierarchical timer wheel. That keeps 100k processes on one core.
+- A `LeaderLease` is renewed by the coordinator's heartbeats. The others decide from heartbeats and the lease alone: a suspicion before the lease has safely expired is rechecked at that point and dropped if a heartbeat renewed the lease, so a false suspicion of a live coordinator does not start an election.
+- Mode 5 crashes the coordinator, takes over once the lease allows it and runs the Bully election from the lowest process on the network simulator (`BullySimNode`). It shows detection latency, the takeover time, postponed and dropped suspicions, and the messages and time of the election; mode 6 sweeps both detectors and reports detection latency against false positives per node-hour.
+
+---
+
+### **Network Simulator (`NetworkSimulator.h`)**
+- `BullySimNode` runs the election with point-to-point messages on the shared discrete-event simulator. OK and coordinator timeouts are simulator timers; a generation number cancels stale ones.
+- A coordinator message from a lower process starts a new election, so a process that wrongly declared itself leader after a lost OK is overruled.
+- Mode 7 checks the message count against n(n - 1) - 1 when nothing is lost and reports events per second for each link model and partition count.
+
+---
+
+### **Benchmark Mode (`--bench`)**
+- `./5_BULLY --bench n=8000 threads=1 sim_n=1000 link=2 partitions=1` skips the menu and prints two JSON lines:
+  - `election`: `BullySimulation` with the old coordinator crashed and the lowest process initiating, counted in messages
+  - `simulated`: the same election on the network simulator, counted in events
+- Each line has wall time, throughput and the hardware counters (`BenchmarkHarness.h`). A wrong or missing leader makes the run exit with status 1.
+- `BenchmarkDriver.cpp` runs it with the other programs and flags regressions against a saved baseline.
+
+---
+
 ### **Key Features**
 1. The process with the highest ID becomes the leader.
 2. The initiator need not always be the leader.
@@ -1,9 +1,44 @@
 #include <iostream>
+#include <iomanip>
+#include <fstream>
 #include <vector>
 #include <string>
 #include <map>
+#include <deque>
 #include <sstream>
 #include <iterator>
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <chrono>
+#include <cctype>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <malloc.h>
+#include <string_view>
+#include <charconv>
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "BenchmarkHarness.h"
+#include "FlatStringMap.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 using namespace std;
 
@@ -33,17 +68,3852 @@ map<string, int> shuffleAndSort(const vector<pair<string, int> > &mappedData) {
     return sortedData;
 }
 
+// Output through one large buffer: bytes are handed to write(2) only when the
+// buffer is full or on flush(), instead of once per line as with endl.
+class BufferedWriter {
+public:
+    explicit BufferedWriter(int fd, size_t capacity = 1 << 20) : fd(fd), owned(false) { buffer.reserve(capacity); }
+
+    // Creates or truncates `path`.
+    explicit BufferedWriter(const string &path, size_t capacity = 1 << 20)
+        : fd(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)), owned(true) {
+        buffer.reserve(capacity);
+    }
+
+    ~BufferedWriter() {
+        flush();
+        if (owned && fd >= 0) {
+            close(fd);
+        }
+    }
+
+    BufferedWriter(const BufferedWriter &) = delete;
+    BufferedWriter &operator=(const BufferedWriter &) = delete;
+
+    bool ok() const { return fd >= 0 && !failed; }
+    long long bytesWritten() const { return written + buffer.size(); }
+
+    void write(const char *data, size_t size) {
+        if (buffer.size() + size > buffer.capacity()) {
+            flush();
+            if (size > buffer.capacity()) {
+                writeAll(data, size);
+                return;
+            }
+        }
+        buffer.append(data, size);
+    }
+
+    BufferedWriter &operator<<(string_view s) {
+        write(s.data(), s.size());
+        return *this;
+    }
+
+    BufferedWriter &operator<<(char c) {
+        write(&c, 1);
+        return *this;
+    }
+
+    BufferedWriter &operator<<(long long v) {
+        char digits[24];
+        char *end = to_chars(digits, digits + sizeof(digits), v).ptr;
+        write(digits, end - digits);
+        return *this;
+    }
+
+    BufferedWriter &operator<<(int v) { return *this << (long long)v; }
+
+    void flush() {
+        writeAll(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+private:
+    void writeAll(const char *data, size_t size) {
+        while (size > 0 && fd >= 0 && !failed) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                failed = true;
+                return;
+            }
+            data += n;
+            size -= n;
+            written += n;
+        }
+    }
+
+    int fd;
+    bool owned, failed = false;
+    string buffer;
+    long long written = 0;
+};
+
 // Reduce function: processes each word and its count, aggregating counts
 void reduceFunction(const map<string, int> &sortedData) {
     cout << "\nWord Count Result: \n";
+    cout.flush();  // the words go straight to the file descriptor, after anything cout still holds
+
+    // Traditional loop to iterate through the map (sortedData)
+    BufferedWriter out(STDOUT_FILENO);
+    for (map<string, int>::const_iterator it = sortedData.begin(); it != sortedData.end(); ++it) {
+        out << it->first << ": " << it->second << '\n';  // Print word and its count
+    }
+}
+
+// Read-only memory mapping of a whole file. Tokens handed out as string_views
+// point straight into it, so nothing is copied until a key is stored.
+class MappedFile {
+public:
+    explicit MappedFile(const string &path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                madvise(p, st.st_size, MADV_SEQUENTIAL);
+                base = static_cast<const char *>(p);
+                length = st.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (base) {
+            munmap(const_cast<char *>(base), length);
+        }
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    string_view data() const { return string_view(base, length); }
+
+private:
+    const char *base = nullptr;
+    size_t length = 0;
+};
+
+// Same whitespace as `stringstream >> word` in the C locale: space, \t, \n,
+// \v, \f and \r.
+inline bool isWordSpace(char c) { return c == ' ' || (unsigned char)(c - 9) <= 4; }
+
+// Calls fn(token) for every whitespace-separated token in [p, end), one byte
+// at a time.
+template <typename Fn>
+void scanTokensScalar(const char *p, const char *end, Fn fn) {
+    const char *start = nullptr;
+    for (; p < end; p++) {
+        if (isWordSpace(*p)) {
+            if (start) {
+                fn(string_view(start, p - start));
+                start = nullptr;
+            }
+        } else if (!start) {
+            start = p;
+        }
+    }
+    if (start) {
+        fn(string_view(start, end - start));
+    }
+}
+
+// The same with SSE2: sixteen bytes are classified at once into a bit mask,
+// and only the positions where a token starts or ends are visited.
+template <typename Fn>
+void scanTokens(const char *p, const char *end, Fn fn) {
+#ifdef __SSE2__
+    const char *start = nullptr;
+    const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8(9), four = _mm_set1_epi8(4);
+    uint32_t previousWord = 0;  // 1 if the byte before this block is part of a token
+    for (; p + 16 <= end; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i shifted = _mm_sub_epi8(v, tab);
+        __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(shifted, four), shifted);
+        uint32_t word = ~_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, space), control)) & 0xFFFF;
+        uint32_t edges = (word ^ ((word << 1) | previousWord)) & 0xFFFF;
+        previousWord = word >> 15;
+        while (edges) {
+            int i = __builtin_ctz(edges);
+            edges &= edges - 1;
+            if (word >> i & 1) {
+                start = p + i;
+            } else {
+                fn(string_view(start, p + i - start));
+            }
+        }
+    }
+    if (previousWord) {
+        const char *q = p;
+        while (q < end && !isWordSpace(*q)) {
+            q++;
+        }
+        fn(string_view(start, q - start));
+        p = q;
+    }
+    scanTokensScalar(p, end, fn);
+#else
+    scanTokensScalar(p, end, fn);
+#endif
+}
+
+// The words that start in [begin, end) of `data`: a word that starts before
+// `begin` is skipped even if it runs past `end`, and the last word is
+// finished past `end`. Splitting [0, size) at any points with this gives
+// every word to exactly one range; a range in which no word starts is empty.
+// The result always points into `data`, even when empty.
+string_view wordRange(string_view data, long long begin, long long end) {
+    long long size = data.size();
+    if (begin > 0) {
+        while (begin < size && !isWordSpace(data[begin - 1])) {
+            begin++;
+        }
+    }
+    if (begin >= end) {
+        return data.substr(begin, 0);
+    }
+    while (end < size && !isWordSpace(data[end - 1])) {
+        end++;
+    }
+    return data.substr(begin, end - begin);
+}
+
+// Entry of a shuffle batch. The key points into the mapped input, which
+// outlives the run, and carries its hash so the reducer does not hash it again.
+struct ShuffleEntry {
+    string_view key;
+    uint64_t hash;
+    int count;
+};
+
+typedef vector<ShuffleEntry> KeyValueBatch;
+
+// Bounded queue of batches from the mappers to one reducer. Mappers block when
+// it is full, so the shuffle never holds more than `capacity` batches per
+// reducer however large the input is.
+template <typename Batch>
+class BasicPartitionQueue {
+public:
+    BasicPartitionQueue(size_t capacity, int producers) : capacity(capacity), producers(producers) {}
+
+    void push(Batch &&batch) {
+        unique_lock<mutex> lock(m);
+        notFull.wait(lock, [&] { return batches.size() < capacity; });
+        batches.push_back(move(batch));
+        notEmpty.notify_one();
+    }
+
+    // Returns false once every producer is done and the queue is drained.
+    bool pop(Batch &batch) {
+        unique_lock<mutex> lock(m);
+        notEmpty.wait(lock, [&] { return !batches.empty() || producers == 0; });
+        if (batches.empty()) {
+            return false;
+        }
+        batch = move(batches.front());
+        batches.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void producerDone() {
+        lock_guard<mutex> lock(m);
+        producers--;
+        notEmpty.notify_all();
+    }
+
+private:
+    size_t capacity;
+    int producers;
+    deque<Batch> batches;
+    mutex m;
+    condition_variable notEmpty, notFull;
+};
+
+typedef BasicPartitionQueue<KeyValueBatch> PartitionQueue;
+
+struct ParallelCountResult {
+    vector<FlatStringMap> partitions;  // reducer r holds the words that hash to r
+    long long tokens;
+    long long shuffled;  // pairs sent to the reducers
+    long long bytes;
+    double wallMs;
+};
+
+// Parallel word count over a memory-mapped file. The file is cut into
+// `mappers` byte ranges; a word belongs to the range its first byte is in, so
+// a mapper skips the tail of a word that started before its range and reads
+// past its end to finish its last word. Every (word, 1) pair goes to reducer
+// hash(word) % reducers in batches, and each reducer aggregates its own
+// partition while the mappers are still running. Partitions share no keys, so
+// no final merge is needed.
+//
+// Tokens are views into the mapping and the combiner only borrows them, so a
+// key is copied once, when a reducer first inserts it.
+//
+// With a combiner capacity, each mapper first sums its counts in a local hash
+// table of at most that many words and sends (word, count) pairs only when the
+// table is full and at the end, so the shuffle carries about one pair per
+// distinct word per flush instead of one per token.
+class ParallelWordCount {
+public:
+    ParallelWordCount(int mappers, int reducers, size_t combinerCapacity = 0)
+        : mappers(mappers), reducers(reducers), combinerCapacity(combinerCapacity) {}
+
+    ParallelCountResult run(const string &path) {
+        auto start = chrono::steady_clock::now();
+        MappedFile file(path);
+        string_view data = file.data();
+        long long size = data.size();
+
+        vector<unique_ptr<PartitionQueue> > queues;
+        for (int r = 0; r < reducers; r++) {
+            queues.emplace_back(new PartitionQueue(4 * mappers, mappers));
+        }
+        ParallelCountResult result;
+        for (int r = 0; r < reducers; r++) {
+            result.partitions.emplace_back();
+        }
+        vector<long long> tokens(mappers, 0), shuffled(mappers, 0);
+
+        vector<thread> threads;
+        for (int r = 0; r < reducers; r++) {
+            threads.emplace_back([&, r] {
+                KeyValueBatch batch;
+                while (queues[r]->pop(batch)) {
+                    for (size_t i = 0; i < batch.size(); i++) {
+                        result.partitions[r].add(batch[i].key, batch[i].hash, batch[i].count);
+                    }
+                }
+            });
+        }
+        for (int t = 0; t < mappers; t++) {
+            long long begin = size * t / mappers, end = size * (t + 1) / mappers;
+            threads.emplace_back([&, t, begin, end] {
+                tokens[t] = mapRange(data, begin, end, queues, shuffled[t]);
+                for (int r = 0; r < reducers; r++) {
+                    queues[r]->producerDone();
+                }
+            });
+        }
+        for (thread &th : threads) {
+            th.join();
+        }
+
+        result.tokens = result.shuffled = 0;
+        for (int t = 0; t < mappers; t++) {
+            result.tokens += tokens[t];
+            result.shuffled += shuffled[t];
+        }
+        result.bytes = size;
+        result.wallMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+private:
+    long long mapRange(string_view data, long long begin, long long end,
+                       vector<unique_ptr<PartitionQueue> > &queues, long long &sent) {
+        const size_t BATCH = 4096;
+        vector<KeyValueBatch> pending(reducers);
+        FlatStringMap combiner(combinerCapacity, true);
+        long long count = 0;
+
+        auto send = [&](string_view word, uint64_t hash, int value) {
+            int r = hash % reducers;
+            pending[r].push_back({ word, hash, value });
+            if (pending[r].size() == BATCH) {
+                queues[r]->push(move(pending[r]));
+                pending[r] = KeyValueBatch();
+                pending[r].reserve(BATCH);
+            }
+            sent++;
+        };
+        auto flush = [&]() {
+            combiner.forEachHashed(send);
+            combiner.clear();
+        };
+
+        string_view range = wordRange(data, begin, end);
+        scanTokens(range.data(), range.data() + range.size(), [&](string_view word) {
+            count++;
+            uint64_t hash = hashBytes(word);
+            if (combinerCapacity == 0) {
+                send(word, hash, 1);
+                return;
+            }
+            combiner.add(word, hash, 1);
+            if (combiner.size() >= combinerCapacity) {
+                flush();
+            }
+        });
+        flush();
+        for (int r = 0; r < reducers; r++) {
+            if (!pending[r].empty()) {
+                queues[r]->push(move(pending[r]));
+            }
+        }
+        return count;
+    }
+
+    int mappers, reducers;
+    size_t combinerCapacity;
+};
+
+// Sorted result of a run. Only built on request (for printing or checking);
+// the reducers themselves never order their keys.
+map<string, int> mergePartitions(const vector<FlatStringMap> &partitions) {
+    map<string, int> merged;
+    for (const FlatStringMap &part : partitions) {
+        part.forEach([&](string_view key, int value) { merged.emplace_hint(merged.end(), string(key), value); });
+    }
+    return merged;
+}
+
+// The original single-threaded path on a file: mapFunction per line, every
+// pair appended to one vector, then shuffleAndSort.
+map<string, int> sequentialWordCount(const string &path, long long &tokens) {
+    ifstream in(path);
+    string line;
+    vector<pair<string, int> > mappedData;
+    while (getline(in, line)) {
+        vector<pair<string, int> > mappedLine = mapFunction(line);
+        mappedData.insert(mappedData.end(), mappedLine.begin(), mappedLine.end());
+    }
+    tokens = mappedData.size();
+    return shuffleAndSort(mappedData);
+}
+
+// Peak resident set size in MB since resetPeakRss (Linux: VmHWM in
+// /proc/self/status, reset through /proc/self/clear_refs). Freed heap pages
+// are returned to the system first so one run does not inherit the last.
+void resetPeakRss() {
+    malloc_trim(0);
+    ofstream("/proc/self/clear_refs") << "5";
+}
+
+double peakRssMB() {
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return stod(line.substr(6)) / 1024;
+        }
+    }
+    return -1;
+}
+
+void benchmarkCombiner(const string &path, int threads, const vector<size_t> &capacities) {
+    ifstream probe(path, ios::binary | ios::ate);
+    long long bytes = probe.tellg();
+    cout << "\n" << setw(24) << "path" << setw(14) << "tokens" << setw(14) << "pairs sent" << setw(12) << "wall ms"
+         << setw(10) << "MB/s" << setw(14) << "peak RSS MB" << setw(10) << "matches" << "\n";
+
+    map<string, int> reference;
+    auto report = [&](const string &name, const map<string, int> &counts, long long tokens, long long shuffled,
+                      double ms, double rss) {
+        if (reference.empty()) {
+            reference = counts;
+        }
+        cout << setw(24) << name << setw(14) << tokens << setw(14) << shuffled << setw(12) << fixed << setprecision(1)
+             << ms << setw(10) << bytes / 1048576.0 / (ms / 1000) << setw(14) << rss << setw(10)
+             << (counts == reference ? "yes" : "no") << "\n";
+    };
+
+    // One pair per token lives in memory at once, so keep this to inputs that fit.
+    if (bytes <= (256LL << 20)) {
+        resetPeakRss();
+        auto start = chrono::steady_clock::now();
+        long long tokens;
+        map<string, int> counts = sequentialWordCount(path, tokens);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        report("sequential (original)", counts, tokens, tokens, ms, peakRssMB());
+    } else {
+        cout << setw(24) << "sequential (original)" << "  skipped, input larger than 256 MB\n";
+    }
+
+    vector<size_t> configs(1, 0);
+    configs.insert(configs.end(), capacities.begin(), capacities.end());
+    for (size_t capacity : configs) {
+        resetPeakRss();
+        ParallelWordCount counter(threads, threads, capacity);
+        ParallelCountResult r = counter.run(path);
+        double rss = peakRssMB();
+        string name = capacity == 0 ? "pipeline" : "combiner " + to_string(capacity);
+        report(name, mergePartitions(r.partitions), r.tokens, r.shuffled, r.wallMs, rss);
+    }
+}
+
+// Aggregation alone, on tokens already in memory: std::map as in
+// shuffleAndSort, unordered_map, and FlatStringMap with and without the final
+// sort. Every variant is checked against std::map.
+void benchmarkAggregation(const string &path, long long maxMegabytes) {
+    vector<string> tokens;
+    {
+        ifstream in(path);
+        string word;
+        long long bytes = 0, limit = maxMegabytes << 20;
+        while (bytes < limit && in >> word) {
+            bytes += word.size() + 1;
+            tokens.push_back(word);
+        }
+    }
+
+    auto elapsedMs = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+    cout << "\n" << tokens.size() << " tokens\n";
+    cout << setw(30) << "structure" << setw(12) << "words" << setw(12) << "ms" << setw(16) << "Mtokens/sec"
+         << setw(10) << "matches" << "\n";
+    auto report = [&](const string &name, size_t words, double ms, bool matches) {
+        cout << setw(30) << name << setw(12) << words << setw(12) << fixed << setprecision(1) << ms << setw(16)
+             << setprecision(2) << tokens.size() / ms / 1000 << setw(10) << (matches ? "yes" : "no") << "\n";
+    };
+
+    auto start = chrono::steady_clock::now();
+    map<string, int> ordered;
+    for (const string &t : tokens) {
+        ordered[t]++;
+    }
+    report("std::map", ordered.size(), elapsedMs(start), true);
+
+    start = chrono::steady_clock::now();
+    unordered_map<string, int> hashed;
+    for (const string &t : tokens) {
+        hashed[t]++;
+    }
+    double hashedMs = elapsedMs(start);
+    report("unordered_map", hashed.size(), hashedMs, hashed.size() == ordered.size());
+    start = chrono::steady_clock::now();
+    vector<pair<string, int> > hashedSorted(hashed.begin(), hashed.end());
+    sort(hashedSorted.begin(), hashedSorted.end());
+    bool matches = hashedSorted == vector<pair<string, int> >(ordered.begin(), ordered.end());
+    report("unordered_map + sort", hashed.size(), hashedMs + elapsedMs(start), matches);
+
+    start = chrono::steady_clock::now();
+    FlatStringMap flat;
+    for (const string &t : tokens) {
+        flat.add(t);
+    }
+    double flatMs = elapsedMs(start);
+    report("FlatStringMap", flat.size(), flatMs, flat.size() == ordered.size());
+    start = chrono::steady_clock::now();
+    vector<pair<string_view, int> > flatSorted = flat.sortedItems();
+    double sortMs = elapsedMs(start);
+    matches = flatSorted.size() == ordered.size();
+    map<string, int>::const_iterator it = ordered.begin();
+    for (size_t i = 0; matches && i < flatSorted.size(); i++, ++it) {
+        matches = flatSorted[i].first == it->first && flatSorted[i].second == it->second;
+    }
+    report("FlatStringMap + sort", flat.size(), flatMs + sortMs, matches);
+}
+
+// Tokenizing alone: getline + mapFunction as in the interactive mode, then the
+// memory-mapped file with the byte-at-a-time and the SSE2 scanner. Every token
+// is hashed so the scanners cannot skip work. Summing the mapped bytes gives
+// the memory-bandwidth ceiling. The file should already be in the page cache.
+void benchmarkTokenizer(const string &path) {
+    auto elapsedMs = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+    MappedFile file(path);
+    string_view data = file.data();
+    double megabytes = data.size() / 1048576.0;
+    cout << "\n" << setw(30) << "tokenizer" << setw(14) << "tokens" << setw(12) << "ms" << setw(10) << "MB/s" << "\n";
+    auto report = [&](const string &name, long long tokens, double ms) {
+        cout << setw(30) << name << setw(14) << tokens << setw(12) << fixed << setprecision(1) << ms << setw(10)
+             << megabytes / (ms / 1000) << "\n";
+    };
+
+    auto start = chrono::steady_clock::now();
+    uint64_t sum = 0;
+    for (size_t i = 0; i < data.size(); i += 8) {
+        uint64_t word = 0;
+        memcpy(&word, data.data() + i, min<size_t>(8, data.size() - i));
+        sum += word;
+    }
+    report("read mapped bytes", 0, elapsedMs(start));
+
+    start = chrono::steady_clock::now();
+    long long tokens = 0;
+    {
+        ifstream in(path);
+        string line;
+        while (getline(in, line)) {
+            tokens += mapFunction(line).size();
+        }
+    }
+    report("getline + mapFunction", tokens, elapsedMs(start));
+
+    start = chrono::steady_clock::now();
+    tokens = 0;
+    scanTokensScalar(data.data(), data.data() + data.size(), [&](string_view word) {
+        tokens++;
+        sum += hashBytes(word);
+    });
+    report("mmap, scalar scanner", tokens, elapsedMs(start));
+
+    start = chrono::steady_clock::now();
+    tokens = 0;
+    scanTokens(data.data(), data.data() + data.size(), [&](string_view word) {
+        tokens++;
+        sum += hashBytes(word);
+    });
+    report("mmap, SSE2 scanner", tokens, elapsedMs(start));
+    cout << "(checksum " << sum % 1000 << ")\n";
+}
+
+// Writes roughly `megabytes` MB of text whose words follow a Zipf distribution
+// over `vocabulary` distinct words, twelve words per line.
+void generateCorpus(const string &path, long long megabytes, int vocabulary, double skew, uint32_t seed) {
+    vector<string> words(vocabulary);
+    vector<double> cdf(vocabulary);
+    double total = 0;
+    for (int i = 0; i < vocabulary; i++) {
+        for (int v = i; ; v /= 26) {
+            words[i] += char('a' + v % 26);
+            if (v < 26) {
+                break;
+            }
+        }
+        total += 1.0 / pow(i + 1, skew);
+        cdf[i] = total;
+    }
+
+    mt19937_64 rng(seed);
+    uniform_real_distribution<double> uniform(0.0, total);
+    ofstream out(path, ios::binary);
+    string buffer;
+    long long target = megabytes << 20, written = 0;
+    while (written < target) {
+        buffer.clear();
+        while (buffer.size() < (1 << 20)) {
+            for (int w = 0; w < 12; w++) {
+                int i = lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+                buffer += words[min(i, vocabulary - 1)];
+                buffer += w == 11 ? '\n' : ' ';
+            }
+        }
+        out.write(buffer.data(), buffer.size());
+        written += buffer.size();
+    }
+}
+
+void benchmarkParallelWordCount(const string &path, int maxThreads) {
+    vector<int> threadCounts;
+    for (int t = 1; t < maxThreads; t *= 2) {
+        threadCounts.push_back(t);
+    }
+    threadCounts.push_back(maxThreads);
+
+    map<string, int> reference;
+    cout << "\n" << setw(9) << "mappers" << setw(10) << "reducers" << setw(14) << "tokens" << setw(12) << "words"
+         << setw(12) << "wall ms" << setw(10) << "MB/s" << setw(10) << "matches" << "\n";
+    for (int threads : threadCounts) {
+        ParallelWordCount counter(threads, threads);
+        ParallelCountResult r = counter.run(path);
+        map<string, int> merged = mergePartitions(r.partitions);
+        if (threads == 1) {
+            reference = merged;
+        }
+        cout << setw(9) << threads << setw(10) << threads << setw(14) << r.tokens << setw(12) << merged.size()
+             << setw(12) << fixed << setprecision(1) << r.wallMs << setw(10) << r.bytes / 1048576.0 / (r.wallMs / 1000)
+             << setw(10) << (merged == reference ? "yes" : "no") << "\n";
+    }
+}
+
+struct StreamSnapshot {
+    long long windowStartMs, windowEndMs;
+    long long tokens;                      // tokens counted in the window
+    vector<pair<string, int> > top;        // most frequent words, highest first
+};
+
+// Incremental word count over an unbounded stream of lines. Time is cut into
+// panes of `slideMs`; a window is the last windowMs / slideMs panes, so
+// slideMs == windowMs gives tumbling windows and a smaller slide gives sliding
+// ones. Whenever a pane closes, the window ending there is summarized into a
+// snapshot of its top words and handed to the callback.
+//
+// The window's counts are kept up to date as words arrive: a word is added to
+// its pane and to the window, and a pane's counts are subtracted from the
+// window when it expires. A snapshot then only ranks the window instead of
+// merging every pane. Words that drop to zero stay in the window map until
+// they are half of it, when it is rebuilt without them.
+//
+// Each pane holds at most `maxKeysPerPane` words. When a pane fills up, its
+// long tail (every word whose count is at or below a threshold that doubles
+// until at least half the keys go) is evicted and, if a spill file is given,
+// appended to it as "pane word count" lines so exact totals can still be
+// recomputed offline. Counts in snapshots are then lower bounds.
+class StreamingWordCount {
+public:
+    StreamingWordCount(long long windowMs, long long slideMs, size_t maxKeysPerPane, int topK,
+                       function<void(const StreamSnapshot &)> onSnapshot, const string &spillPath = "")
+        : slideMs(slideMs), maxKeysPerPane(maxKeysPerPane), topK(topK), onSnapshot(onSnapshot) {
+        int count = max(1LL, windowMs / slideMs);
+        for (int i = 0; i < count; i++) {
+            panes.emplace_back(maxKeysPerPane);
+        }
+        paneTokens.assign(count, 0);
+        if (!spillPath.empty()) {
+            spill.open(spillPath, ios::binary | ios::app);
+        }
+    }
+
+    void ingest(string_view line, long long nowMs) {
+        advanceTo(nowMs);
+        int p = currentPane % panes.size();
+        scanTokens(line.data(), line.data() + line.size(), [&](string_view word) {
+            uint64_t hash = hashBytes(word);
+            panes[p].add(word, hash, 1);
+            size_t before = window.size();
+            if (window.add(word, hash, 1) == 1 && window.size() == before) {
+                zeros--;
+            }
+            windowTokens++;
+            paneTokens[p]++;
+            if (panes[p].size() >= maxKeysPerPane) {
+                evictTail(p);
+            }
+        });
+    }
+
+    // Closes every pane that ended before nowMs, emitting one snapshot each.
+    void advanceTo(long long nowMs) {
+        long long pane = nowMs / slideMs;
+        if (currentPane < 0) {
+            currentPane = pane;
+        }
+        while (currentPane < pane) {
+            emitSnapshot();
+            currentPane++;
+            int p = currentPane % panes.size();
+            panes[p].forEachHashed([&](string_view key, uint64_t hash, int value) { subtract(key, hash, value); });
+            windowTokens -= paneTokens[p];
+            panes[p].clear();
+            paneTokens[p] = 0;
+            if (zeros * 2 > window.size()) {
+                compactWindow();
+            }
+        }
+    }
+
+    // Emits the window that ends with the current, still open pane.
+    void flush() { emitSnapshot(); }
+
+    long long evictedTokens = 0;
+    long long evictedKeys = 0;
+    int snapshots = 0;
+
+private:
+    void emitSnapshot() {
+        if (currentPane < 0) {
+            return;
+        }
+        StreamSnapshot snap;
+        snap.windowEndMs = (currentPane + 1) * slideMs;
+        snap.windowStartMs = snap.windowEndMs - (long long)panes.size() * slideMs;
+        snap.tokens = windowTokens;
+        vector<pair<int, string_view> > ranked;
+        ranked.reserve(window.size() - zeros);
+        window.forEach([&](string_view key, int value) {
+            if (value > 0) {
+                ranked.emplace_back(value, key);
+            }
+        });
+        size_t k = min<size_t>(topK, ranked.size());
+        partial_sort(ranked.begin(), ranked.begin() + k, ranked.end(),
+                     [](const pair<int, string_view> &a, const pair<int, string_view> &b) {
+                         return a.first != b.first ? a.first > b.first : a.second < b.second;
+                     });
+        for (size_t i = 0; i < k; i++) {
+            snap.top.emplace_back(string(ranked[i].second), ranked[i].first);
+        }
+        snapshots++;
+        onSnapshot(snap);
+    }
+
+    void evictTail(int p) {
+        int threshold = 1;
+        for (;;) {
+            size_t survivors = 0;
+            panes[p].forEach([&](string_view, int value) { survivors += value > threshold; });
+            if (survivors <= maxKeysPerPane / 2) {
+                break;
+            }
+            threshold *= 2;
+        }
+        FlatStringMap kept(maxKeysPerPane);
+        panes[p].forEachHashed([&](string_view key, uint64_t hash, int value) {
+            if (value > threshold) {
+                kept.add(key, hash, value);
+                return;
+            }
+            subtract(key, hash, value);
+            evictedTokens += value;
+            evictedKeys++;
+            if (spill.is_open()) {
+                spill << currentPane << ' ' << key << ' ' << value << '\n';
+            }
+        });
+        panes[p] = move(kept);
+        // The evicted words are still in the window with a count of 0; drop
+        // them here too, or a long pane would keep every word it has seen.
+        if (zeros * 2 > window.size()) {
+            compactWindow();
+        }
+    }
+
+    void subtract(string_view key, uint64_t hash, int value) {
+        if (window.add(key, hash, -value) == 0) {
+            zeros++;
+        }
+    }
+
+    void compactWindow() {
+        FlatStringMap live(window.size() - zeros);
+        window.forEachHashed([&](string_view key, uint64_t hash, int value) {
+            if (value > 0) {
+                live.add(key, hash, value);
+            }
+        });
+        window = move(live);
+        zeros = 0;
+    }
+
+    long long slideMs;
+    size_t maxKeysPerPane;
+    int topK;
+    function<void(const StreamSnapshot &)> onSnapshot;
+    vector<FlatStringMap> panes;
+    vector<long long> paneTokens;
+    FlatStringMap window;       // sum of the panes
+    size_t zeros = 0;           // window entries whose count dropped to 0
+    long long windowTokens = 0;
+    long long currentPane = -1;
+    ofstream spill;
+};
+
+long long steadyMs() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Counts lines from standard input as they arrive and prints the top words of
+// every window as it closes.
+int runStreamingWordCount(long long windowMs, long long slideMs, size_t maxKeysPerPane) {
+    StreamingWordCount stream(windowMs, slideMs, maxKeysPerPane, 10, [](const StreamSnapshot &snap) {
+        cout << "\n[window " << snap.windowStartMs << " - " << snap.windowEndMs << " ms, " << snap.tokens
+             << " words]\n";
+        for (const pair<string, int> &entry : snap.top) {
+            cout << entry.first << ": " << entry.second << "\n";
+        }
+    });
+    long long origin = steadyMs();
+    string line;
+    cout << "Enter text (type 'DONE' to finish input):\n";
+    while (getline(cin, line) && line != "DONE") {
+        stream.ingest(line, steadyMs() - origin);
+    }
+    stream.advanceTo(steadyMs() - origin);
+    stream.flush();
+    return 0;
+}
+
+// Open-loop load: line i is due at start + i / rate, and its latency is the
+// time from when it was due until it has been counted, so falling behind shows
+// up as growing latency instead of a slower generator. Lines are taken from a
+// corpus file in a loop.
+void benchmarkStreaming(const string &path, long long windowMs, long long slideMs, size_t maxKeysPerPane,
+                        double seconds, const vector<double> &rates) {
+    vector<string> lines;
+    {
+        ifstream in(path);
+        string line;
+        long long bytes = 0;
+        while (bytes < (64LL << 20) && getline(in, line)) {
+            bytes += line.size() + 1;
+            lines.push_back(line);
+        }
+    }
+    if (lines.empty()) {
+        cout << "The corpus is empty.\n";
+        return;
+    }
+
+    cout << "\n" << setw(12) << "lines/s" << setw(12) << "achieved" << setw(10) << "MB/s" << setw(10) << "p50 us"
+         << setw(10) << "p99 us" << setw(11) << "p99.9 us" << setw(10) << "max us" << setw(11) << "snapshots"
+         << setw(14) << "evicted" << "\n";
+    for (double rate : rates) {
+        StreamingWordCount stream(windowMs, slideMs, maxKeysPerPane, 10, [](const StreamSnapshot &) {});
+        vector<float> latencies;
+        long long bytes = 0;
+        auto start = chrono::steady_clock::now();
+        double elapsed = 0;
+        for (long long i = 0; elapsed < seconds; i++) {
+            auto due = start + chrono::nanoseconds((long long)(i * 1e9 / rate));
+            while (chrono::steady_clock::now() < due) {
+            }
+            const string &line = lines[i % lines.size()];
+            auto now = chrono::steady_clock::now();
+            elapsed = chrono::duration<double>(now - start).count();
+            stream.ingest(line, (long long)(elapsed * 1000));
+            latencies.push_back(chrono::duration<float, micro>(chrono::steady_clock::now() - due).count());
+            bytes += line.size() + 1;
+        }
+        sort(latencies.begin(), latencies.end());
+        auto pct = [&](double q) { return latencies[min(latencies.size() - 1, (size_t)(q * latencies.size()))]; };
+        cout << setw(12) << fixed << setprecision(0) << rate << setw(12) << latencies.size() / elapsed << setw(10)
+             << setprecision(1) << bytes / 1048576.0 / elapsed << setw(10) << pct(0.5) << setw(10) << pct(0.99)
+             << setw(11) << pct(0.999) << setw(10) << latencies.back() << setw(11) << stream.snapshots << setw(14)
+             << stream.evictedTokens << "\n";
+    }
+}
+
+// Feeds one pane more and more distinct words and reports the peak RSS growth
+// of each run. Eviction bounds the pane and the window, so the growth has to
+// stay flat once the word limit is reached.
+bool checkStreamingMemory(size_t maxKeysPerPane) {
+    long long smallest = max<long long>(4 * maxKeysPerPane, 250000);
+    vector<double> growth;
+    cout << "\n" << setw(16) << "distinct words" << setw(14) << "evicted" << setw(14) << "RSS +MB" << "\n";
+    for (long long distinct = smallest; distinct <= 16 * smallest; distinct *= 4) {
+        resetPeakRss();
+        double baseline = peakRssMB();
+        long long evicted;
+        {
+            StreamingWordCount stream(1LL << 40, 1LL << 40, maxKeysPerPane, 10, [](const StreamSnapshot &) {});
+            string line;
+            for (long long i = 0; i < distinct; i++) {
+                line += "w" + to_string(i) + " ";
+                if (i % 64 == 63 || i == distinct - 1) {
+                    stream.ingest(line, 0);
+                    line.clear();
+                }
+            }
+            stream.flush();
+            evicted = stream.evictedKeys;
+        }
+        growth.push_back(peakRssMB() - baseline);
+        cout << setw(16) << distinct << setw(14) << evicted << setw(14) << fixed << setprecision(1) << growth.back()
+             << "\n";
+    }
+    bool flat = growth.back() <= growth.front() * 1.5 + 4;
+    cout << (flat ? "Peak RSS stays flat as the number of distinct words grows.\n"
+                  : "Peak RSS grows with the number of distinct words.\n");
+    return flat;
+}
+
+// Sorted run of (word, count) records on disk. Keys are front-coded against
+// the previous key (shared prefix length, suffix length, suffix bytes) and all
+// numbers are varints, which shrinks sorted word lists severalfold.
+class RunWriter {
+public:
+    explicit RunWriter(const string &path) : out(path, ios::binary) {}
+
+    void write(string_view key, long long count) {
+        size_t shared = 0;
+        size_t limit = min(key.size(), previous.size());
+        while (shared < limit && key[shared] == previous[shared]) {
+            shared++;
+        }
+        putVarint(shared);
+        putVarint(key.size() - shared);
+        buffer.append(key.data() + shared, key.size() - shared);
+        putVarint(count);
+        previous.assign(key.data(), key.size());
+        if (buffer.size() >= (1 << 16)) {
+            flush();
+        }
+    }
+
+    // Bytes written so far.
+    long long close() {
+        flush();
+        out.close();
+        return written;
+    }
+
+private:
+    void putVarint(unsigned long long v) {
+        while (v >= 0x80) {
+            buffer += char(v | 0x80);
+            v >>= 7;
+        }
+        buffer += char(v);
+    }
+
+    void flush() {
+        out.write(buffer.data(), buffer.size());
+        written += buffer.size();
+        buffer.clear();
+    }
+
+    ofstream out;
+    string buffer, previous;
+    long long written = 0;
+};
+
+class RunReader {
+public:
+    // The stream itself is unbuffered; records are read from `buffer`, whose
+    // size the caller picks so that all open runs fit in the memory budget.
+    RunReader(const string &path, size_t bufferBytes) : buffer(bufferBytes) {
+        in.rdbuf()->pubsetbuf(nullptr, 0);
+        in.open(path, ios::binary);
+    }
+
+    // Loads the next record into key/count; false at the end of the run.
+    bool next() {
+        unsigned long long shared, suffix, value;
+        if (!getVarint(shared)) {
+            return false;
+        }
+        getVarint(suffix);
+        key.resize(shared + suffix);
+        for (size_t i = shared; i < key.size(); i++) {
+            key[i] = getByte();
+        }
+        getVarint(value);
+        count = value;
+        return true;
+    }
+
+    string key;
+    long long count = 0;
+
+private:
+    int getByte() {
+        if (position == filled) {
+            in.read(buffer.data(), buffer.size());
+            filled = in.gcount();
+            position = 0;
+            if (filled == 0) {
+                return -1;
+            }
+        }
+        return (unsigned char)buffer[position++];
+    }
+
+    bool getVarint(unsigned long long &v) {
+        v = 0;
+        for (int shift = 0;; shift += 7) {
+            int b = getByte();
+            if (b < 0) {
+                return false;
+            }
+            v |= (unsigned long long)(b & 0x7F) << shift;
+            if (b < 0x80) {
+                return true;
+            }
+        }
+    }
+
+    ifstream in;
+    vector<char> buffer;
+    size_t position = 0, filled = 0;
+};
+
+// Loser tree over k sorted runs: the root holds the run with the smallest
+// current key and every inner node the loser of the match played there, so
+// replacing the winner replays only the log2(k) matches on its path.
+class LoserTree {
+public:
+    explicit LoserTree(vector<unique_ptr<RunReader> > &runs) : runs(runs), k(runs.size()), tree(max<size_t>(k, 1)) {
+        live.assign(k, false);
+        for (size_t i = 0; i < k; i++) {
+            live[i] = runs[i]->next();
+        }
+        if (k == 0) {
+            return;
+        }
+        // winners[n] is the winner of the subtree at node n; leaves are k..2k-1.
+        vector<int> winners(2 * k);
+        for (size_t i = 0; i < k; i++) {
+            winners[k + i] = i;
+        }
+        for (size_t n = k - 1; n >= 1; n--) {
+            int a = winners[2 * n], b = winners[2 * n + 1];
+            bool aWins = less(a, b);
+            winners[n] = aWins ? a : b;
+            tree[n] = aWins ? b : a;
+        }
+        tree[0] = k == 1 ? 0 : winners[1];
+    }
+
+    bool empty() const { return k == 0 || !live[tree[0]]; }
+    RunReader &top() { return *runs[tree[0]]; }
+
+    // Advances the winning run and restores the tree.
+    void pop() {
+        int winner = tree[0];
+        live[winner] = runs[winner]->next();
+        for (size_t n = (winner + k) / 2; n >= 1; n /= 2) {
+            if (less(tree[n], winner)) {
+                swap(tree[n], winner);
+            }
+        }
+        tree[0] = winner;
+    }
+
+private:
+    bool less(int a, int b) const {
+        if (!live[a] || !live[b]) {
+            return live[a];
+        }
+        int c = runs[a]->key.compare(runs[b]->key);
+        return c != 0 ? c < 0 : a < b;
+    }
+
+    vector<unique_ptr<RunReader> > &runs;
+    size_t k;
+    vector<int> tree;
+    vector<bool> live;
+};
+
+struct ExternalSortStats {
+    int runs;
+    long long spilledBytes;
+    long long tokens;
+    long long words;
+    long long trackedPeakBytes;  // largest mapper table + sort buffer, summed over mappers
+    double mapMs, mergeMs;
+};
+
+// Word count whose vocabulary does not have to fit in memory. Each mapper
+// counts into a FlatStringMap until the table plus the buffer needed to sort
+// it would exceed its share of the budget, then writes the sorted table as a
+// run file and starts over. The reduce side merges all runs with a loser tree
+// and calls emit(word, count) in sorted order, with equal words from different
+// runs already added up. Pages of the mapped input are released once scanned
+// so they do not count against the budget.
+class ExternalSortWordCount {
+public:
+    ExternalSortWordCount(int mappers, size_t budgetBytes, const string &spillDirectory)
+        : mappers(mappers), budgetBytes(budgetBytes), spillDirectory(spillDirectory) {}
+
+    template <typename Emit>
+    ExternalSortStats run(const string &path, Emit emit) {
+        ExternalSortStats stats = { 0, 0, 0, 0, 0, 0.0, 0.0 };
+        auto start = chrono::steady_clock::now();
+        vector<vector<string> > runFiles(mappers);
+        vector<long long> tokens(mappers, 0), spilled(mappers, 0), peak(mappers, 0);
+        {
+            MappedFile file(path);
+            string_view data = file.data();
+            vector<thread> threads;
+            for (int t = 0; t < mappers; t++) {
+                long long begin = data.size() * t / mappers, end = data.size() * (t + 1) / mappers;
+                threads.emplace_back([&, t, begin, end] {
+                    tokens[t] = mapRange(data, begin, end, t, runFiles[t], spilled[t], peak[t]);
+                });
+            }
+            for (thread &th : threads) {
+                th.join();
+            }
+        }
+        auto mapped = chrono::steady_clock::now();
+
+        vector<string> files;
+        for (int t = 0; t < mappers; t++) {
+            files.insert(files.end(), runFiles[t].begin(), runFiles[t].end());
+            stats.tokens += tokens[t];
+            stats.spilledBytes += spilled[t];
+            stats.trackedPeakBytes += peak[t];
+        }
+        stats.runs = files.size();
+
+        // Read buffers share the budget with nothing else at this point.
+        size_t bufferBytes = max<size_t>(4096, min<size_t>(1 << 16, budgetBytes / max<size_t>(files.size(), 1)));
+        vector<unique_ptr<RunReader> > readers;
+        for (const string &f : files) {
+            readers.emplace_back(new RunReader(f, bufferBytes));
+        }
+        LoserTree tree(readers);
+        string current;
+        long long total = 0;
+        bool any = false;
+        while (!tree.empty()) {
+            RunReader &r = tree.top();
+            if (any && r.key == current) {
+                total += r.count;
+            } else {
+                if (any) {
+                    emit(string_view(current), total);
+                    stats.words++;
+                }
+                current = r.key;
+                total = r.count;
+                any = true;
+            }
+            tree.pop();
+        }
+        if (any) {
+            emit(string_view(current), total);
+            stats.words++;
+        }
+        readers.clear();
+        for (const string &f : files) {
+            remove(f.c_str());
+        }
+        auto done = chrono::steady_clock::now();
+        stats.mapMs = chrono::duration<double, milli>(mapped - start).count();
+        stats.mergeMs = chrono::duration<double, milli>(done - mapped).count();
+        return stats;
+    }
+
+private:
+    long long mapRange(string_view data, long long begin, long long end, int mapper, vector<string> &runFiles,
+                       long long &spilled, long long &peak) {
+        // The mapper's share of the budget covers the resident piece of the
+        // input and the table with the array needed to sort it.
+        const long long PIECE = max<long long>(1 << 16, min<long long>(4 << 20, budgetBytes / mappers / 8));
+        const size_t share = max<long long>(1 << 16, budgetBytes / mappers - PIECE);
+        const size_t sortEntry = sizeof(pair<string_view, int>);
+        FlatStringMap table;
+        long long count = 0;
+
+        auto spill = [&]() {
+            if (table.empty()) {
+                return;
+            }
+            peak = max<long long>(peak, table.memoryBytes() + table.size() * sortEntry);
+            string name = spillDirectory + "/wordcount-" + to_string(getpid()) + "-" + to_string(mapper) + "-" +
+                          to_string(runFiles.size()) + ".run";
+            RunWriter writer(name);
+            for (const pair<string_view, int> &entry : table.sortedItems()) {
+                writer.write(entry.first, entry.second);
+            }
+            spilled += writer.close();
+            runFiles.push_back(name);
+            table.clear();
+        };
+
+        string_view range = wordRange(data, begin, end);
+        long long first = range.data() - data.data(), last = first + range.size();
+        // Scan in pieces that end on whitespace and drop each piece's pages
+        // from memory afterwards.
+        const long long page = sysconf(_SC_PAGESIZE);
+        for (long long pos = first; pos < last;) {
+            long long stop = min(last, pos + PIECE);
+            while (stop < last && !isWordSpace(data[stop - 1])) {
+                stop++;
+            }
+            scanTokens(data.data() + pos, data.data() + stop, [&](string_view word) {
+                count++;
+                uint64_t hash = hashBytes(word);
+                if (table.atCapacity()) {
+                    // While growing, the old and the doubled table coexist.
+                    size_t grown = max(table.memoryBytes() * 3, table.memoryBytes() * 2 + (table.size() + 1) * sortEntry);
+                    if (grown > share) {
+                        spill();
+                    }
+                }
+                table.add(word, hash, 1);
+                if (table.memoryBytes() + table.size() * sortEntry > share) {
+                    spill();
+                }
+            });
+            long long releaseFrom = (pos + page - 1) / page * page, releaseTo = stop / page * page;
+            if (releaseTo > releaseFrom) {
+                madvise(const_cast<char *>(data.data()) + releaseFrom, releaseTo - releaseFrom, MADV_DONTNEED);
+            }
+            pos = stop;
+        }
+        spill();
+        return count;
+    }
+
+    int mappers;
+    size_t budgetBytes;
+    string spillDirectory;
+};
+
+// Runs the external sort at each budget and checks it against the in-memory
+// pipeline through a checksum of the sorted (word, count) sequence. Peak RSS
+// is reported as growth over the resident size at the start of each run.
+void benchmarkExternalSort(const string &path, int mappers, const string &spillDirectory,
+                           const vector<double> &budgetsMB) {
+    auto checksum = [](uint64_t h, string_view word, long long count) {
+        return (h ^ hashBytes(word)) * 0x100000001B3ULL + count;
+    };
+    uint64_t reference = 0;
+    long long referenceWords = 0;
+    {
+        ParallelWordCount counter(mappers, mappers);
+        ParallelCountResult r = counter.run(path);
+        map<string, int> merged = mergePartitions(r.partitions);
+        for (const pair<const string, int> &entry : merged) {
+            reference = checksum(reference, entry.first, entry.second);
+        }
+        referenceWords = merged.size();
+    }
+
+    MappedFile file(path);
+    double megabytes = file.data().size() / 1048576.0;
+    cout << "\n" << setw(11) << "budget MB" << setw(7) << "runs" << setw(12) << "spilled MB" << setw(10) << "map ms"
+         << setw(11) << "merge ms" << setw(9) << "MB/s" << setw(12) << "buffer MB" << setw(10) << "RSS +MB"
+         << setw(10) << "words" << setw(10) << "matches" << "\n";
+    for (double budget : budgetsMB) {
+        resetPeakRss();
+        double baseline = peakRssMB();
+        ExternalSortWordCount sorter(mappers, (size_t)(budget * 1048576), spillDirectory);
+        uint64_t sum = 0;
+        ExternalSortStats s = sorter.run(path, [&](string_view word, long long count) {
+            sum = checksum(sum, word, count);
+        });
+        double rss = peakRssMB() - baseline;
+        cout << setw(11) << fixed << setprecision(1) << budget << setw(7) << s.runs << setw(12)
+             << s.spilledBytes / 1048576.0 << setw(10) << s.mapMs << setw(11) << s.mergeMs << setw(9)
+             << megabytes / ((s.mapMs + s.mergeMs) / 1000) << setw(12) << s.trackedPeakBytes / 1048576.0 << setw(10)
+             << rss << setw(10) << s.words << setw(10)
+             << (sum == reference && s.words == referenceWords ? "yes" : "no") << "\n";
+    }
+}
+
+// Hash used to partition the keys of the generic engine and, for string keys,
+// to index its tables.
+inline uint64_t hashKey(string_view key) { return hashBytes(key); }
+
+inline uint64_t hashKey(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    key *= 0xC4CEB9FE1A85EC53ULL;
+    return key ^ (key >> 33);
+}
+
+// Aggregation table for keys that are not strings: an unordered_map behind the
+// part of the BasicFlatStringMap interface the engine uses.
+template <typename Key, typename Value>
+class HashPartitionTable {
+public:
+    explicit HashPartitionTable(size_t expected = 0, bool = false) { table.reserve(expected); }
+
+    size_t size() const { return table.size(); }
+
+    Value &valueFor(const Key &key, uint64_t) { return table[key]; }
+
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        for (const pair<const Key, Value> &entry : table) {
+            fn(entry.first, entry.second);
+        }
+    }
+
+    template <typename Fn>
+    void forEachHashed(Fn fn) {
+        for (pair<const Key, Value> &entry : table) {
+            fn(entry.first, hashKey(entry.first), entry.second);
+        }
+    }
+
+    void clear() { table.clear(); }
+
+private:
+    unordered_map<Key, Value> table;
+};
+
+// Table type per key type, chosen at compile time: string keys (views into
+// the mapped input) go into the flat map, everything else into unordered_map.
+template <typename Key, typename Value>
+struct PartitionTable {
+    typedef HashPartitionTable<Key, Value> type;
+};
+
+template <typename Value>
+struct PartitionTable<string_view, Value> {
+    typedef BasicFlatStringMap<Value> type;
+};
+
+// The parallel pipeline of ParallelWordCount with the job plugged in as
+// template parameters, so every call below is resolved and inlined at compile
+// time:
+//   mapper(split, emit)      split is a run of whole lines of the input; the
+//                            mapper calls emit(key, value) for every pair
+//   combiner(acc, value)     folds a value into an accumulator; Value() must
+//                            be its identity. It runs in the mappers (when
+//                            combinerCapacity > 0) and in the reducers.
+//   reducer(key, value)      called once per key with its combined value,
+//                            on the reducer's own copy of `reducer`
+// Keys and string views inside values point into the mapped input and are
+// only valid until run() returns, so a reducer copies what it keeps.
+template <typename Key, typename Value, typename Mapper, typename Combiner, typename Reducer>
+class MapReduceEngine {
+public:
+    struct Record {
+        Key key;
+        uint64_t hash;
+        Value value;
+    };
+
+    typedef vector<Record> RecordBatch;
+    typedef typename PartitionTable<Key, Value>::type Table;
+
+    struct Result {
+        vector<Reducer> reducers;  // reducer r has seen every key of partition r
+        long long emitted;         // pairs emitted by the mappers
+        long long shuffled;        // pairs sent to the reducers
+        long long bytes;
+        double wallMs;
+    };
+
+    MapReduceEngine(int mappers, int reducers, size_t combinerCapacity, Mapper mapper, Combiner combiner,
+                    Reducer reducer)
+        : mappers(mappers), reducers(reducers), combinerCapacity(combinerCapacity), mapper(mapper),
+          combiner(combiner), reducer(reducer) {}
+
+    Result run(const string &path) {
+        auto start = chrono::steady_clock::now();
+        MappedFile file(path);
+        string_view data = file.data();
+        long long size = data.size();
+
+        vector<unique_ptr<BasicPartitionQueue<RecordBatch> > > queues;
+        for (int r = 0; r < reducers; r++) {
+            queues.emplace_back(new BasicPartitionQueue<RecordBatch>(4 * mappers, mappers));
+        }
+        Result result;
+        result.reducers.assign(reducers, reducer);
+        vector<long long> emitted(mappers, 0), shuffled(mappers, 0);
+
+        vector<thread> threads;
+        for (int r = 0; r < reducers; r++) {
+            threads.emplace_back([&, r] {
+                Combiner combine = combiner;
+                Table table;  // string keys are copied: comparing them inline beats chasing views into the input
+                RecordBatch batch;
+                while (queues[r]->pop(batch)) {
+                    for (Record &record : batch) {
+                        combine(table.valueFor(record.key, record.hash), move(record.value));
+                    }
+                }
+                table.forEach([&](const Key &key, const Value &value) { result.reducers[r](key, value); });
+            });
+        }
+        // A split starts after the first newline at or past its byte offset,
+        // so every line belongs to exactly one mapper.
+        auto lineStart = [&](long long offset) {
+            if (offset == 0) {
+                return offset;
+            }
+            const char *newline = (const char *)memchr(data.data() + offset - 1, '\n', size - offset + 1);
+            return newline ? newline - data.data() + 1 : size;
+        };
+        for (int t = 0; t < mappers; t++) {
+            long long begin = lineStart(size * t / mappers), end = lineStart(size * (t + 1) / mappers);
+            threads.emplace_back([&, t, begin, end] {
+                emitted[t] = mapSplit(data.substr(begin, max(0LL, end - begin)), queues, shuffled[t]);
+                for (int r = 0; r < reducers; r++) {
+                    queues[r]->producerDone();
+                }
+            });
+        }
+        for (thread &th : threads) {
+            th.join();
+        }
+
+        result.emitted = result.shuffled = 0;
+        for (int t = 0; t < mappers; t++) {
+            result.emitted += emitted[t];
+            result.shuffled += shuffled[t];
+        }
+        result.bytes = size;
+        result.wallMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+private:
+    long long mapSplit(string_view split, vector<unique_ptr<BasicPartitionQueue<RecordBatch> > > &queues,
+                       long long &sent) {
+        const size_t BATCH = 4096;
+        vector<RecordBatch> pending(reducers);
+        Table local(combinerCapacity, true);
+        Mapper map = mapper;
+        Combiner combine = combiner;
+        long long count = 0;
+
+        auto send = [&](const Key &key, uint64_t hash, Value &&value) {
+            int r = hash % reducers;
+            pending[r].push_back({ key, hash, move(value) });
+            if (pending[r].size() == BATCH) {
+                queues[r]->push(move(pending[r]));
+                pending[r] = RecordBatch();
+                pending[r].reserve(BATCH);
+            }
+            sent++;
+        };
+        auto flush = [&]() {
+            local.forEachHashed([&](const Key &key, uint64_t hash, Value &value) { send(key, hash, move(value)); });
+            local.clear();
+        };
+        auto emit = [&](const Key &key, Value value) {
+            count++;
+            uint64_t hash = hashKey(key);
+            if (combinerCapacity == 0) {
+                send(key, hash, move(value));
+                return;
+            }
+            combine(local.valueFor(key, hash), move(value));
+            if (local.size() >= combinerCapacity) {
+                flush();
+            }
+        };
+        map(split, emit);
+        flush();
+        for (int r = 0; r < reducers; r++) {
+            if (!pending[r].empty()) {
+                queues[r]->push(move(pending[r]));
+            }
+        }
+        return count;
+    }
+
+    int mappers, reducers;
+    size_t combinerCapacity;
+    Mapper mapper;
+    Combiner combiner;
+    Reducer reducer;
+};
+
+// Deduces the mapper, combiner and reducer types (usually lambdas) so only the
+// key and value types are spelled out.
+template <typename Key, typename Value, typename Mapper, typename Combiner, typename Reducer>
+MapReduceEngine<Key, Value, Mapper, Combiner, Reducer> makeMapReduceEngine(int mappers, int reducers,
+                                                                           size_t combinerCapacity, Mapper mapper,
+                                                                           Combiner combiner, Reducer reducer) {
+    return MapReduceEngine<Key, Value, Mapper, Combiner, Reducer>(mappers, reducers, combinerCapacity, mapper,
+                                                                  combiner, reducer);
+}
+
+// Calls fn(line) for every line of `text`, without its newline.
+template <typename Fn>
+void forEachLine(string_view text, Fn fn) {
+    while (!text.empty()) {
+        const char *newline = (const char *)memchr(text.data(), '\n', text.size());
+        size_t length = newline ? newline - text.data() : text.size();
+        fn(text.substr(0, length));
+        text.remove_prefix(min(length + 1, text.size()));
+    }
+}
+
+// Removes the first space-separated field from `line` and returns it.
+string_view nextField(string_view &line) {
+    size_t start = line.find_first_not_of(' ');
+    if (start == string_view::npos) {
+        line = string_view();
+        return line;
+    }
+    size_t end = line.find(' ', start);
+    string_view field = line.substr(start, end == string_view::npos ? string_view::npos : end - start);
+    line.remove_prefix(end == string_view::npos ? line.size() : end);
+    return field;
+}
+
+long long parseInteger(string_view text) {
+    long long value = 0;
+    from_chars(text.data(), text.data() + text.size(), value);
+    return value;
+}
+
+// Word count reducer that keeps an order-independent checksum instead of the
+// words, so engine and hand-written runs can be compared without sorting.
+struct WordCountChecksum {
+    long long words = 0, total = 0;
+    uint64_t mix = 0;
+
+    void operator()(string_view word, int count) {
+        words++;
+        total += count;
+        mix += hashBytes(word) * (uint64_t)count;
+    }
+
+    void add(const WordCountChecksum &other) {
+        words += other.words;
+        total += other.total;
+        mix += other.mix;
+    }
+
+    bool operator==(const WordCountChecksum &other) const {
+        return words == other.words && total == other.total && mix == other.mix;
+    }
+};
+
+// Word count as an engine job. Identical in structure to ParallelWordCount
+// except that splits end at newlines instead of at whitespace.
+auto wordCountMapper = [](string_view split, auto &emit) {
+    scanTokens(split.data(), split.data() + split.size(), [&](string_view word) { emit(word, 1); });
+};
+auto sumCombiner = [](int &acc, int value) { acc += value; };
+
+// Job: count, sum, minimum and maximum of the readings of every sensor.
+// Input lines are "<sensor id> <value>" with integer ids and values.
+struct ReadingStats {
+    long long count = 0, sum = 0;
+    long long minimum = LLONG_MAX, maximum = LLONG_MIN;
+
+    void add(const ReadingStats &other) {
+        count += other.count;
+        sum += other.sum;
+        minimum = min(minimum, other.minimum);
+        maximum = max(maximum, other.maximum);
+    }
+
+    bool operator==(const ReadingStats &other) const {
+        return count == other.count && sum == other.sum && minimum == other.minimum && maximum == other.maximum;
+    }
+};
+
+struct SensorStatsCollector {
+    map<uint64_t, ReadingStats> sensors;
+    void operator()(uint64_t sensor, const ReadingStats &stats) { sensors[sensor] = stats; }
+};
+
+// Job: number of distinct visitors of every page. Input lines are
+// "<page> <visitor>". Visitors are kept as 64-bit hashes of their names and
+// deduplicated lazily: sets grow by appending and are sorted and made unique
+// whenever they have doubled since the last time.
+struct VisitorSet {
+    vector<uint64_t> ids;
+    size_t unique = 0;  // size after the last deduplication
+
+    void add(const VisitorSet &other) {
+        ids.insert(ids.end(), other.ids.begin(), other.ids.end());
+        if (ids.size() > 2 * unique + 16) {
+            deduplicate();
+        }
+    }
+
+    void deduplicate() {
+        sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        unique = ids.size();
+    }
+};
+
+struct DistinctVisitorCollector {
+    map<string, size_t> pages;
+
+    void operator()(string_view page, const VisitorSet &visitors) {
+        VisitorSet set = visitors;
+        set.deduplicate();
+        pages[string(page)] = set.ids.size();
+    }
+};
+
+// Job: reduce-side inner join of customers with their orders, summing order
+// amounts per country. Input lines are "C <customer> <country>" or
+// "O <customer> <amount>"; the key is the customer, and the value collects
+// both sides until the reducer pairs them up.
+struct JoinGroup {
+    vector<string_view> countries;  // customer rows (normally one)
+    vector<long long> amounts;      // order rows
+
+    void add(const JoinGroup &other) {
+        countries.insert(countries.end(), other.countries.begin(), other.countries.end());
+        amounts.insert(amounts.end(), other.amounts.begin(), other.amounts.end());
+    }
+};
+
+struct CountryRevenue {
+    long long orders = 0, revenue = 0;
+    bool operator==(const CountryRevenue &other) const {
+        return orders == other.orders && revenue == other.revenue;
+    }
+};
+
+struct JoinCollector {
+    map<string, CountryRevenue> countries;
+
+    void operator()(string_view, const JoinGroup &group) {
+        for (string_view country : group.countries) {
+            CountryRevenue &total = countries[string(country)];
+            for (long long amount : group.amounts) {
+                total.orders++;
+                total.revenue += amount;
+            }
+        }
+    }
+};
+
+// Writes the inputs of the three example jobs, `megabytes` MB each, into
+// `directory`: readings.txt, visits.txt and orders.txt.
+void generateJobInputs(const string &directory, long long megabytes, uint32_t seed) {
+    static const char *COUNTRIES[] = { "at", "be", "br", "ca", "ch", "cn", "de", "es", "fr", "gb",
+                                       "in", "it", "jp", "kr", "mx", "nl", "pl", "se", "us", "za" };
+    mt19937_64 rng(seed);
+    long long target = megabytes << 20;
+    auto write = [&](const string &name, function<void(string &)> line) {
+        ofstream out(directory + "/" + name, ios::binary);
+        string buffer;
+        for (long long written = 0; written < target; ) {
+            buffer.clear();
+            while (buffer.size() < (1 << 20)) {
+                line(buffer);
+            }
+            out.write(buffer.data(), buffer.size());
+            written += buffer.size();
+        }
+    };
+    write("readings.txt", [&](string &out) {
+        out += to_string(rng() % 10000) + " " + to_string((long long)(rng() % 2001) - 1000) + "\n";
+    });
+    // Page popularity is skewed (the square of a uniform variable picks low ids more often).
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    write("visits.txt", [&](string &out) {
+        double u = uniform(rng);
+        out += "p" + to_string((long long)(u * u * 5000)) + " u" + to_string(rng() % 200000) + "\n";
+    });
+    long long customers = 0;
+    write("orders.txt", [&](string &out) {
+        if (customers < 100000 && rng() % 10 == 0) {
+            out += "C c" + to_string(customers++) + " " + COUNTRIES[rng() % 20] + "\n";
+        } else {
+            out += "O c" + to_string(rng() % 110000) + " " + to_string(rng() % 10000) + "\n";
+        }
+    });
+}
+
+double sinceMs(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// Times the word count on the engine against the hand-written
+// ParallelWordCount (best of three each, with and without a combiner), then
+// runs the three example jobs on the engine and checks each against a
+// single-threaded hand-written loop over the same mapped file.
+void benchmarkMapReduceEngine(const string &corpus, int threads, const string &directory, long long megabytes) {
+    generateJobInputs(directory, megabytes, 7);
+    cout << "\n" << setw(24) << "job" << setw(14) << "engine ms" << setw(13) << "engine MB/s" << setw(16)
+         << "hand-written ms" << setw(10) << "MB/s" << setw(12) << "emitted" << setw(12) << "shuffled" << setw(10)
+         << "matches" << "\n";
+    auto report = [&](const string &job, double engineMs, double handMs, double bytes, long long emitted,
+                      long long shuffled, bool matches) {
+        double mb = bytes / 1048576.0;
+        cout << setw(24) << job << setw(14) << fixed << setprecision(1) << engineMs << setw(13)
+             << mb / (engineMs / 1000) << setw(16) << handMs << setw(10) << mb / (handMs / 1000) << setw(12)
+             << emitted << setw(12) << shuffled << setw(10) << (matches ? "yes" : "no") << "\n";
+    };
+
+    for (size_t capacity : { (size_t)0, (size_t)65536 }) {
+        double engineMs = 1e18, handMs = 1e18;
+        WordCountChecksum engineSum, handSum;
+        long long bytes = 0, emitted = 0, shuffled = 0;
+        for (int attempt = 0; attempt < 3; attempt++) {
+            auto engine = makeMapReduceEngine<string_view, int>(threads, threads, capacity, wordCountMapper,
+                                                                sumCombiner, WordCountChecksum());
+            auto r = engine.run(corpus);
+            engineMs = min(engineMs, r.wallMs);
+            engineSum = WordCountChecksum();
+            for (const WordCountChecksum &part : r.reducers) {
+                engineSum.add(part);
+            }
+            bytes = r.bytes;
+            emitted = r.emitted;
+            shuffled = r.shuffled;
+
+            ParallelWordCount counter(threads, threads, capacity);
+            ParallelCountResult h = counter.run(corpus);
+            handMs = min(handMs, h.wallMs);
+            handSum = WordCountChecksum();
+            for (const FlatStringMap &part : h.partitions) {
+                part.forEach([&](string_view word, int count) { handSum(word, count); });
+            }
+        }
+        report(capacity ? "word count + combiner" : "word count", engineMs, handMs, bytes, emitted, shuffled,
+               engineSum == handSum);
+    }
+
+    {
+        string path = directory + "/readings.txt";
+        auto engine = makeMapReduceEngine<uint64_t, ReadingStats>(
+            threads, threads, 16384,
+            [](string_view split, auto &emit) {
+                forEachLine(split, [&](string_view line) {
+                    uint64_t sensor = parseInteger(nextField(line));
+                    long long value = parseInteger(nextField(line));
+                    ReadingStats reading;
+                    reading.count = 1;
+                    reading.sum = reading.minimum = reading.maximum = value;
+                    emit(sensor, reading);
+                });
+            },
+            [](ReadingStats &acc, const ReadingStats &value) { acc.add(value); }, SensorStatsCollector());
+        auto r = engine.run(path);
+        map<uint64_t, ReadingStats> merged;
+        for (const SensorStatsCollector &part : r.reducers) {
+            merged.insert(part.sensors.begin(), part.sensors.end());
+        }
+
+        auto start = chrono::steady_clock::now();
+        MappedFile file(path);
+        unordered_map<uint64_t, ReadingStats> hand;
+        forEachLine(file.data(), [&](string_view line) {
+            ReadingStats &stats = hand[parseInteger(nextField(line))];
+            long long value = parseInteger(nextField(line));
+            stats.count++;
+            stats.sum += value;
+            stats.minimum = min(stats.minimum, value);
+            stats.maximum = max(stats.maximum, value);
+        });
+        double handMs = sinceMs(start);
+        report("sensor sum/min/max", r.wallMs, handMs, r.bytes, r.emitted, r.shuffled,
+               merged == map<uint64_t, ReadingStats>(hand.begin(), hand.end()));
+    }
+
+    {
+        string path = directory + "/visits.txt";
+        auto engine = makeMapReduceEngine<string_view, VisitorSet>(
+            threads, threads, 16384,
+            [](string_view split, auto &emit) {
+                forEachLine(split, [&](string_view line) {
+                    string_view page = nextField(line);
+                    VisitorSet visitor;
+                    visitor.ids.push_back(hashBytes(nextField(line)));
+                    emit(page, move(visitor));
+                });
+            },
+            [](VisitorSet &acc, const VisitorSet &value) { acc.add(value); }, DistinctVisitorCollector());
+        auto r = engine.run(path);
+        map<string, size_t> merged;
+        for (const DistinctVisitorCollector &part : r.reducers) {
+            merged.insert(part.pages.begin(), part.pages.end());
+        }
+
+        auto start = chrono::steady_clock::now();
+        MappedFile file(path);
+        unordered_map<string, unordered_set<uint64_t> > hand;
+        forEachLine(file.data(), [&](string_view line) {
+            string page(nextField(line));
+            hand[page].insert(hashBytes(nextField(line)));
+        });
+        map<string, size_t> handCounts;
+        for (const pair<const string, unordered_set<uint64_t> > &entry : hand) {
+            handCounts[entry.first] = entry.second.size();
+        }
+        double handMs = sinceMs(start);
+        report("distinct visitors/page", r.wallMs, handMs, r.bytes, r.emitted, r.shuffled, merged == handCounts);
+    }
+
+    {
+        string path = directory + "/orders.txt";
+        auto engine = makeMapReduceEngine<string_view, JoinGroup>(
+            threads, threads, 0,
+            [](string_view split, auto &emit) {
+                forEachLine(split, [&](string_view line) {
+                    string_view type = nextField(line), customer = nextField(line), field = nextField(line);
+                    JoinGroup side;
+                    if (type == "C") {
+                        side.countries.push_back(field);
+                    } else {
+                        side.amounts.push_back(parseInteger(field));
+                    }
+                    emit(customer, move(side));
+                });
+            },
+            [](JoinGroup &acc, const JoinGroup &value) { acc.add(value); }, JoinCollector());
+        auto r = engine.run(path);
+        map<string, CountryRevenue> merged;
+        for (const JoinCollector &part : r.reducers) {
+            for (const pair<const string, CountryRevenue> &entry : part.countries) {
+                merged[entry.first].orders += entry.second.orders;
+                merged[entry.first].revenue += entry.second.revenue;
+            }
+        }
+
+        // Hand-written hash join: build the customer table, then probe it with
+        // the orders (all lines are read twice).
+        auto start = chrono::steady_clock::now();
+        MappedFile file(path);
+        unordered_multimap<string_view, string_view> customers;
+        forEachLine(file.data(), [&](string_view line) {
+            if (nextField(line) == "C") {
+                string_view customer = nextField(line);
+                customers.emplace(customer, nextField(line));
+            }
+        });
+        map<string, CountryRevenue> hand;
+        forEachLine(file.data(), [&](string_view line) {
+            if (nextField(line) == "O") {
+                auto range = customers.equal_range(nextField(line));
+                long long amount = parseInteger(nextField(line));
+                for (auto it = range.first; it != range.second; ++it) {
+                    CountryRevenue &total = hand[string(it->second)];
+                    total.orders++;
+                    total.revenue += amount;
+                }
+            }
+        });
+        double handMs = sinceMs(start);
+        report("join orders/customers", r.wallMs, handMs, r.bytes, r.emitted, r.shuffled, merged == hand);
+    }
+}
+
+// Multi-process word count. A coordinator forks worker processes and hands
+// them tasks over Unix seqpacket sockets; map outputs and reduce outputs are
+// POSIX shared-memory segments, so only task numbers cross the sockets.
+//
+// A segment holds `parts` lists of (word, count) records behind a header of
+// parts + 1 byte offsets. A record is a 32-bit key length, a 32-bit count and
+// the key bytes. Map task m writes one list per reducer; reduce task r reads
+// list r of every map output and writes a single list.
+string segmentName(pid_t coordinator, char kind, int task, int attempt) {
+    return "/wordcount-" + to_string(coordinator) + "-" + kind + to_string(task) + "-" + to_string(attempt);
+}
+
+// Writes the entries of `table` to a new segment, entry to list hash % parts.
+bool writeSegment(const string &name, int parts, const FlatStringMap &table) {
+    vector<uint64_t> offsets(parts + 1, 0);
+    table.forEachHashed([&](string_view key, uint64_t hash, int) { offsets[hash % parts + 1] += 8 + key.size(); });
+    offsets[0] = (parts + 1) * sizeof(uint64_t);
+    for (int p = 0; p < parts; p++) {
+        offsets[p + 1] += offsets[p];
+    }
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    size_t size = offsets[parts];
+    void *p = ftruncate(fd, size) == 0 ? mmap(nullptr, size, PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    char *base = static_cast<char *>(p);
+    memcpy(base, offsets.data(), offsets[0]);
+    vector<uint64_t> cursor(offsets.begin(), offsets.end() - 1);
+    table.forEachHashed([&](string_view key, uint64_t hash, int count) {
+        char *record = base + cursor[hash % parts];
+        uint32_t length = key.size();
+        memcpy(record, &length, 4);
+        memcpy(record + 4, &count, 4);
+        memcpy(record + 8, key.data(), length);
+        cursor[hash % parts] += 8 + length;
+    });
+    munmap(base, size);
+    return true;
+}
+
+// Read-only mapping of a segment written by writeSegment.
+class SharedSegment {
+public:
+    explicit SharedSegment(const string &name) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) {
+                base = static_cast<const char *>(p);
+                length = st.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    ~SharedSegment() {
+        if (base) {
+            munmap(const_cast<char *>(base), length);
+        }
+    }
+
+    SharedSegment(const SharedSegment &) = delete;
+    SharedSegment &operator=(const SharedSegment &) = delete;
+
+    bool valid() const { return base != nullptr; }
+    size_t size() const { return length; }
+
+    // Calls fn(key, count) for every record of list `part`.
+    template <typename Fn>
+    void forEach(int part, Fn fn) const {
+        uint64_t begin, end;
+        memcpy(&begin, base + part * sizeof(uint64_t), 8);
+        memcpy(&end, base + (part + 1) * sizeof(uint64_t), 8);
+        while (begin < end) {
+            uint32_t keyLength;
+            int count;
+            memcpy(&keyLength, base + begin, 4);
+            memcpy(&count, base + begin + 4, 4);
+            fn(string_view(base + begin + 8, keyLength), count);
+            begin += 8 + keyLength;
+        }
+    }
+
+private:
+    const char *base = nullptr;
+    size_t length = 0;
+};
+
+// Messages are vectors of int64: {kind, task, attempt, ...}. A seqpacket
+// socket keeps each one whole, so no framing is needed.
+bool sendMessage(int fd, const vector<long long> &message) {
+    return send(fd, message.data(), message.size() * sizeof(long long), MSG_NOSIGNAL) ==
+           (ssize_t)(message.size() * sizeof(long long));
+}
+
+bool receiveMessage(int fd, vector<long long> &message) {
+    message.resize(1 << 16);
+    ssize_t n = recv(fd, message.data(), message.size() * sizeof(long long), 0);
+    if (n <= 0) {
+        return false;
+    }
+    message.resize(n / sizeof(long long));
+    return true;
+}
+
+struct MultiProcessStats {
+    int mapTasks, reduceTasks;
+    int attempts;     // task attempts started, including re-executions
+    int crashes;      // workers that died during a task
+    int failedTasks;  // tasks given up after MAX_ATTEMPTS crashes
+    long long tokens;
+    double segmentMB;  // shared memory written by successful attempts
+    double wallMs;
+    WordCountChecksum result;
+};
+
+// Coordinator of the multi-process word count. The input is cut into
+// `mapTasks` splits (several per worker, so a re-executed split is small)
+// and the words into `reducers` partitions. Reduce tasks start once every
+// map task has finished or been given up.
+//
+// A worker that dies (crash, kill, bad input) closes its socket; the
+// coordinator reaps it, forks a replacement and re-runs the task it held
+// under a new attempt number. Outputs are named by attempt, and reducers are
+// told which attempt of each map task succeeded, so a half-written segment of
+// a dead attempt is never read. Finished map outputs live in shared memory,
+// not in the worker, so they survive the worker's death. `crashRate` makes
+// each attempt kill its worker with that probability, to exercise this path.
+class MultiProcessWordCount {
+public:
+    MultiProcessWordCount(int workers, int reducers, int mapTasks, double crashRate)
+        : workers(workers), reducers(reducers), mapTasks(mapTasks), crashRate(crashRate) {}
+
+    MultiProcessStats run(const string &path) {
+        auto start = chrono::steady_clock::now();
+        MappedFile file(path);
+        data = file.data();
+        coordinator = getpid();
+
+        MultiProcessStats stats = MultiProcessStats();
+        stats.mapTasks = mapTasks;
+        stats.reduceTasks = reducers;
+        vector<int> mapAttempt(mapTasks, 0), reduceAttempt(reducers, 0);  // attempts started per task
+        vector<int> mapDone(mapTasks, -1), reduceDone(reducers, -1);      // successful attempt, or -1
+        deque<pair<char, int> > pending;
+        for (int m = 0; m < mapTasks; m++) {
+            pending.emplace_back('M', m);
+        }
+        int mapsLeft = mapTasks, reducesLeft = reducers;
+
+        vector<Worker> pool(workers);
+        for (int w = 0; w < workers; w++) {
+            spawn(pool, w);
+        }
+        auto finish = [&](char kind, bool failed) {
+            if (kind == 'M' && --mapsLeft == 0) {
+                for (int r = 0; r < reducers; r++) {
+                    pending.emplace_back('R', r);
+                }
+            } else if (kind == 'R') {
+                reducesLeft--;
+            }
+            stats.failedTasks += failed;
+        };
+
+        vector<long long> message;
+        while (mapsLeft > 0 || reducesLeft > 0) {
+            for (Worker &worker : pool) {
+                if (worker.task >= 0 || pending.empty()) {
+                    continue;
+                }
+                worker.kind = pending.front().first;
+                worker.task = pending.front().second;
+                pending.pop_front();
+                worker.attempt = (worker.kind == 'M' ? mapAttempt : reduceAttempt)[worker.task]++;
+                stats.attempts++;
+                message = { worker.kind, worker.task, worker.attempt };
+                if (worker.kind == 'R') {
+                    message.insert(message.end(), mapDone.begin(), mapDone.end());
+                }
+                sendMessage(worker.fd, message);  // a dead worker shows up as EOF below
+            }
+
+            vector<pollfd> fds(workers);
+            for (int w = 0; w < workers; w++) {
+                fds[w] = { pool[w].fd, POLLIN, 0 };
+            }
+            if (poll(fds.data(), workers, -1) < 0) {
+                continue;
+            }
+            for (int w = 0; w < workers; w++) {
+                if (!(fds[w].revents & (POLLIN | POLLHUP | POLLERR))) {
+                    continue;
+                }
+                Worker &worker = pool[w];
+                if (receiveMessage(worker.fd, message)) {
+                    (worker.kind == 'M' ? mapDone : reduceDone)[worker.task] = worker.attempt;
+                    stats.tokens += worker.kind == 'M' ? message[3] : 0;
+                    stats.segmentMB += message[4] / 1048576.0;
+                    finish(worker.kind, false);
+                    worker.task = -1;
+                    continue;
+                }
+                close(worker.fd);
+                waitpid(worker.pid, nullptr, 0);
+                if (worker.task >= 0) {
+                    stats.crashes++;
+                    int attempts = (worker.kind == 'M' ? mapAttempt : reduceAttempt)[worker.task];
+                    if (attempts < MAX_ATTEMPTS) {
+                        pending.emplace_front(worker.kind, worker.task);
+                    } else {
+                        finish(worker.kind, true);
+                    }
+                }
+                spawn(pool, w);
+            }
+        }
+        for (Worker &worker : pool) {
+            sendMessage(worker.fd, { 'X', 0, 0 });
+            close(worker.fd);
+            waitpid(worker.pid, nullptr, 0);
+        }
+
+        for (int r = 0; r < reducers; r++) {
+            if (reduceDone[r] >= 0) {
+                SharedSegment segment(segmentName(coordinator, 'R', r, reduceDone[r]));
+                segment.forEach(0, [&](string_view word, int count) { stats.result(word, count); });
+            }
+        }
+        for (int m = 0; m < mapTasks; m++) {
+            for (int a = 0; a < mapAttempt[m]; a++) {
+                shm_unlink(segmentName(coordinator, 'M', m, a).c_str());
+            }
+        }
+        for (int r = 0; r < reducers; r++) {
+            for (int a = 0; a < reduceAttempt[r]; a++) {
+                shm_unlink(segmentName(coordinator, 'R', r, a).c_str());
+            }
+        }
+        stats.wallMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+
+private:
+    static const int MAX_ATTEMPTS = 4;
+
+    struct Worker {
+        pid_t pid = -1;
+        int fd = -1;  // coordinator's end of the socket
+        char kind = 0;
+        int task = -1, attempt = 0;  // task = -1 when idle
+    };
+
+    void spawn(vector<Worker> &pool, int w) {
+        int ends[2];
+        socketpair(AF_UNIX, SOCK_SEQPACKET, 0, ends);
+        cout.flush();
+        pid_t pid = fork();
+        if (pid == 0) {
+            for (const Worker &other : pool) {
+                if (other.fd >= 0) {
+                    close(other.fd);
+                }
+            }
+            close(ends[0]);
+            serve(ends[1]);
+            _exit(0);
+        }
+        close(ends[1]);
+        pool[w] = Worker();
+        pool[w].pid = pid;
+        pool[w].fd = ends[0];
+    }
+
+    // Worker process: runs tasks until the coordinator says 'X' or goes away.
+    void serve(int fd) {
+        vector<long long> message;
+        while (receiveMessage(fd, message) && message[0] != 'X') {
+            char kind = message[0];
+            int task = message[1], attempt = message[2];
+            if (crashRate > 0 && (hashKey((uint64_t)task * 64 + attempt * 2 + (kind == 'R')) % 1000000) <
+                                     crashRate * 1000000) {
+                raise(SIGKILL);
+            }
+            FlatStringMap table;
+            long long tokens = 0;
+            if (kind == 'M') {
+                long long size = data.size();
+                string_view range = wordRange(data, size * task / mapTasks, size * (task + 1) / mapTasks);
+                scanTokens(range.data(), range.data() + range.size(), [&](string_view word) {
+                    tokens++;
+                    table.add(word);
+                });
+            } else {
+                for (int m = 0; m < mapTasks; m++) {
+                    if (message[3 + m] < 0) {
+                        continue;
+                    }
+                    SharedSegment segment(segmentName(coordinator, 'M', m, message[3 + m]));
+                    if (segment.valid()) {
+                        segment.forEach(task, [&](string_view word, int count) { table.add(word, count); });
+                    }
+                }
+            }
+            string name = segmentName(coordinator, kind, task, attempt);
+            if (!writeSegment(name, kind == 'M' ? reducers : 1, table)) {
+                _exit(1);
+            }
+            SharedSegment written(name);
+            if (!sendMessage(fd, { kind, task, attempt, tokens, (long long)written.size() })) {
+                break;
+            }
+        }
+    }
+
+    int workers, reducers, mapTasks;
+    double crashRate;
+    string_view data;
+    pid_t coordinator = 0;
+};
+
+// Runs the threaded pipeline and the multi-process one with the same number
+// of workers and compares wall time and results, first without and then with
+// injected worker crashes.
+void benchmarkMultiProcess(const string &path, int workers, int reducers, double crashRate) {
+    WordCountChecksum reference;
+    ParallelWordCount counter(workers, reducers, 65536);
+    ParallelCountResult threaded = counter.run(path);
+    for (const FlatStringMap &part : threaded.partitions) {
+        part.forEach([&](string_view word, int count) { reference(word, count); });
+    }
+    double megabytes = threaded.bytes / 1048576.0;
+    cout << "\n" << setw(22) << "mode" << setw(10) << "wall ms" << setw(9) << "MB/s" << setw(8) << "tasks"
+         << setw(10) << "attempts" << setw(9) << "crashes" << setw(8) << "failed" << setw(11) << "shared MB"
+         << setw(10) << "matches" << "\n";
+    cout << setw(22) << "threads + combiner" << setw(10) << fixed << setprecision(1) << threaded.wallMs << setw(9)
+         << megabytes / (threaded.wallMs / 1000) << setw(8) << "-" << setw(10) << "-" << setw(9) << "-" << setw(8)
+         << "-" << setw(11) << "-" << setw(10) << "yes" << "\n";
+    vector<double> rates = { 0.0 };
+    if (crashRate > 0) {
+        rates.push_back(crashRate);
+    }
+    for (double rate : rates) {
+        MultiProcessWordCount job(workers, reducers, 4 * workers, rate);
+        MultiProcessStats s = job.run(path);
+        string mode = rate > 0 ? "processes, crash " + to_string((int)(rate * 100)) + "%" : "processes";
+        cout << setw(22) << mode << setw(10) << s.wallMs << setw(9) << megabytes / (s.wallMs / 1000) << setw(8)
+             << s.mapTasks + s.reduceTasks << setw(10) << s.attempts << setw(9) << s.crashes << setw(8)
+             << s.failedTasks << setw(11) << s.segmentMB << setw(10) << (s.result == reference ? "yes" : "no")
+             << "\n";
+    }
+}
+
+// Task pool with one deque per worker thread. A worker takes tasks from the
+// back of its own deque and, when that is empty, steals from the front of
+// another worker's deque, so an idle worker relieves the busiest one instead
+// of waiting for the phase to end.
+class WorkStealingPool {
+public:
+    typedef function<void(int worker)> Task;
+
+    WorkStealingPool(int threads, bool stealing) : stealing(stealing) {
+        for (int w = 0; w < threads; w++) {
+            queues.emplace_back(new Queue());
+        }
+    }
+
+    // Tasks are dealt round-robin, so without stealing worker w runs tasks
+    // w, w + threads, ... (a static split).
+    void submit(Task task) {
+        Queue &q = *queues[next++ % queues.size()];
+        lock_guard<mutex> lock(q.m);
+        q.tasks.push_back(move(task));
+    }
+
+    // Runs the submitted tasks on the worker threads until done() holds.
+    // When a worker has nothing to pop or steal it calls idle(worker), which
+    // may run extra work (e.g. a speculative copy) and returns true if it did.
+    void run(function<bool()> done, function<bool(int)> idle) {
+        vector<thread> threads;
+        for (int w = 0; w < (int)queues.size(); w++) {
+            threads.emplace_back([&, w] {
+                mt19937 rng(w);
+                Task task;
+                while (!done()) {
+                    if (take(w, task) || (stealing && steal(w, rng, task))) {
+                        task(w);
+                    } else if (!idle(w)) {
+                        this_thread::sleep_for(chrono::microseconds(200));
+                    }
+                }
+            });
+        }
+        for (thread &th : threads) {
+            th.join();
+        }
+    }
+
+    long long steals() const { return stolen; }
+
+private:
+    struct Queue {
+        mutex m;
+        deque<Task> tasks;
+    };
+
+    bool take(int w, Task &task) {
+        Queue &q = *queues[w];
+        lock_guard<mutex> lock(q.m);
+        if (q.tasks.empty()) {
+            return false;
+        }
+        task = move(q.tasks.back());
+        q.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(int w, mt19937 &rng, Task &task) {
+        int n = queues.size();
+        for (int i = 0, start = rng() % n; i < n; i++) {
+            int victim = (start + i) % n;
+            if (victim == w) {
+                continue;
+            }
+            Queue &q = *queues[victim];
+            lock_guard<mutex> lock(q.m);
+            if (!q.tasks.empty()) {
+                task = move(q.tasks.front());
+                q.tasks.pop_front();
+                stolen++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    vector<unique_ptr<Queue> > queues;
+    bool stealing;
+    size_t next = 0;
+    atomic<long long> stolen{ 0 };
+};
+
+struct SchedulingOptions {
+    bool stealing;       // otherwise a static split: each worker runs only its own tasks
+    int tasksPerThread;  // map tasks per thread; reduce tasks are a quarter of that (at least one)
+    bool splitHotKeys;
+    bool speculate;
+    double slowFactor;   // worker 0 takes this many times as long per task (1 = no straggler)
+};
+
+struct SchedulingStats {
+    double mapMs, reduceMs, mergeMs, makespanMs;
+    vector<double> mapTaskMs, reduceTaskMs;  // first start to commit, per task
+    long long steals;
+    int backups, backupWins, hotKeys;
+    map<string, int> result;
+};
+
+// Word count built from the original mapFunction and shuffleAndSort, run as
+// map and reduce phases of small tasks on a WorkStealingPool.
+//
+// Hot keys: a sample of the input picks the words whose share of the tokens
+// is more than half a reducer's fair share. Their pairs are dealt round-robin
+// to all reducers instead of hash(word) % reducers, and the final merge sums
+// the partial counts, so one frequent word no longer makes one reduce task
+// much longer than the others.
+//
+// Speculation: once a task of the phase has committed, an idle worker starts
+// a second attempt of any task that has run for more than twice the median
+// task time. Attempts write private output and the first to finish commits it;
+// the loser notices and drops its output.
+class StealingWordCount {
+public:
+    StealingWordCount(int threads, SchedulingOptions options) : threads(threads), options(options) {}
+
+    SchedulingStats run(const string &path) {
+        MappedFile file(path);
+        string_view data = file.data();
+        int mapTasks = threads * options.tasksPerThread;
+        reducers = threads * max(1, options.tasksPerThread / 4);
+        SchedulingStats stats = SchedulingStats();
+        if (options.splitHotKeys) {
+            hotHashes = sampleHotKeys(data);
+        }
+        stats.hotKeys = hotHashes.size();
+
+        // Chunk c is the lines starting in [size * c / mapTasks, size * (c + 1) / mapTasks).
+        vector<size_t> bounds(mapTasks + 1);
+        for (int c = 0; c <= mapTasks; c++) {
+            size_t offset = data.size() * c / mapTasks;
+            if (offset > 0 && offset < data.size()) {
+                const char *newline = (const char *)memchr(data.data() + offset - 1, '\n', data.size() - offset + 1);
+                offset = newline ? newline - data.data() + 1 : data.size();
+            }
+            bounds[c] = offset;
+        }
+
+        typedef vector<vector<pair<string, int> > > Buckets;  // one per reducer
+        vector<Buckets> mapOutput(mapTasks);
+        auto start = chrono::steady_clock::now();
+        stats.mapTaskMs = runPhase(mapTasks, stats, [&](int c, const atomic<bool> &committed, function<bool()> commit) {
+            Buckets buckets(reducers);
+            size_t salt = c;
+            forEachLine(data.substr(bounds[c], bounds[c + 1] - bounds[c]), [&](string_view line) {
+                vector<pair<string, int> > pairs = mapFunction(string(line));
+                for (pair<string, int> &entry : pairs) {
+                    uint64_t hash = hashBytes(entry.first);
+                    bool hot = binary_search(hotHashes.begin(), hotHashes.end(), hash);
+                    buckets[hot ? salt++ % reducers : hash % reducers].push_back(move(entry));
+                }
+            });
+            if (!committed && commit()) {
+                mapOutput[c] = move(buckets);
+            }
+        });
+        stats.mapMs = sinceMs(start);
+
+        vector<map<string, int> > partial(reducers);
+        start = chrono::steady_clock::now();
+        stats.reduceTaskMs = runPhase(reducers, stats, [&](int r, const atomic<bool> &committed, function<bool()> commit) {
+            vector<pair<string, int> > mappedData;
+            for (int c = 0; c < mapTasks; c++) {
+                mappedData.insert(mappedData.end(), mapOutput[c][r].begin(), mapOutput[c][r].end());
+            }
+            map<string, int> sortedData = shuffleAndSort(mappedData);
+            if (!committed && commit()) {
+                partial[r] = move(sortedData);
+            }
+        });
+        stats.reduceMs = sinceMs(start);
+
+        start = chrono::steady_clock::now();
+        for (map<string, int> &part : partial) {
+            for (const pair<const string, int> &entry : part) {
+                stats.result[entry.first] += entry.second;
+            }
+        }
+        stats.mergeMs = sinceMs(start);
+        stats.makespanMs = stats.mapMs + stats.reduceMs + stats.mergeMs;
+        return stats;
+    }
+
+private:
+    // Hashes of the words whose sampled share of the tokens exceeds
+    // 1 / (2 * reducers). The sample is 16 windows of 256 KB spread over the
+    // input.
+    vector<uint64_t> sampleHotKeys(string_view data) {
+        FlatStringMap counts;
+        long long tokens = 0;
+        const size_t WINDOW = 256 << 10;
+        for (int i = 0; i < 16; i++) {
+            size_t begin = data.size() * i / 16, end = min(data.size(), begin + WINDOW);
+            while (begin < end && !isWordSpace(data[begin])) {
+                begin++;  // skip a partial first word
+            }
+            while (end > begin && !isWordSpace(data[end - 1])) {
+                end--;
+            }
+            scanTokens(data.data() + begin, data.data() + end, [&](string_view word) {
+                counts.add(word);
+                tokens++;
+            });
+        }
+        vector<uint64_t> hot;
+        counts.forEachHashed([&](string_view, uint64_t hash, int count) {
+            if ((long long)count * 2 * reducers > tokens) {
+                hot.push_back(hash);
+            }
+        });
+        sort(hot.begin(), hot.end());
+        return hot;
+    }
+
+    struct TaskState {
+        atomic<int> attempts{ 0 };
+        atomic<bool> committed{ false };
+        atomic<long long> startNs{ 0 };
+    };
+
+    // Runs tasks 0..n-1 of one phase and returns their times. body(task,
+    // committed, commit) does one attempt; it calls commit() when its output
+    // is ready and publishes the output only if commit() returns true.
+    template <typename Body>
+    vector<double> runPhase(int n, SchedulingStats &stats, Body body) {
+        unique_ptr<TaskState[]> tasks(new TaskState[n]);
+        vector<double> taskMs(n, 0);
+        vector<double> finished;  // times of committed tasks, for the speculation threshold
+        mutex finishedLock;
+        atomic<int> committedCount{ 0 }, backups{ 0 }, backupWins{ 0 };
+        auto phaseStart = chrono::steady_clock::now();
+        auto nowNs = [&] {
+            return (long long)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - phaseStart)
+                .count();
+        };
+
+        auto attempt = [&](int i, int worker, bool backup) {
+            long long begin = nowNs();
+            long long unset = 0;
+            tasks[i].startNs.compare_exchange_strong(unset, begin);
+            bool won = false;
+            auto commit = [&]() {
+                // The straggler (worker 0) is slowed by sleeping in short
+                // slices before it commits, so a faster copy can still win.
+                if (worker == 0 && options.slowFactor > 1) {
+                    long long until = nowNs() + (long long)((options.slowFactor - 1) * (nowNs() - begin));
+                    while (nowNs() < until && !tasks[i].committed) {
+                        this_thread::sleep_for(chrono::microseconds(500));
+                    }
+                }
+                bool expected = false;
+                won = tasks[i].committed.compare_exchange_strong(expected, true);
+                return won;
+            };
+            body(i, tasks[i].committed, commit);
+            if (won) {
+                double ms = (nowNs() - tasks[i].startNs) / 1e6;
+                taskMs[i] = ms;
+                {
+                    lock_guard<mutex> lock(finishedLock);
+                    finished.push_back(ms);
+                }
+                backupWins += backup;
+                committedCount++;
+            }
+        };
+
+        WorkStealingPool pool(threads, options.stealing);
+        for (int i = 0; i < n; i++) {
+            pool.submit([&, i](int worker) {
+                tasks[i].attempts++;
+                attempt(i, worker, false);
+            });
+        }
+        pool.run([&] { return committedCount == n; },
+                 [&](int worker) {
+                     if (!options.speculate) {
+                         return false;
+                     }
+                     double median;
+                     {
+                         lock_guard<mutex> lock(finishedLock);
+                         if (finished.empty()) {
+                             return false;
+                         }
+                         vector<double> sorted = finished;
+                         nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+                         median = sorted[sorted.size() / 2];
+                     }
+                     for (int i = 0; i < n; i++) {
+                         int one = 1;
+                         long long started = tasks[i].startNs;
+                         if (!tasks[i].committed && started > 0 && (nowNs() - started) / 1e6 > 2 * median &&
+                             tasks[i].attempts.compare_exchange_strong(one, 2)) {
+                             backups++;
+                             attempt(i, worker, true);
+                             return true;
+                         }
+                     }
+                     return false;
+                 });
+        stats.backups += backups;
+        stats.backupWins += backupWins;
+        stats.steals += pool.steals();
+        return taskMs;
+    }
+
+    int threads, reducers = 1;
+    SchedulingOptions options;
+    vector<uint64_t> hotHashes;
+};
+
+double percentile(vector<double> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    sort(values.begin(), values.end());
+    return values[min(values.size() - 1, (size_t)(p * values.size()))];
+}
+
+// Runs the same skewed input under a static split, work stealing, work
+// stealing with hot-key splitting, and all of that plus speculation, with
+// worker 0 slowed down by `slowFactor`.
+void benchmarkScheduling(const string &path, int threads, double slowFactor) {
+    struct Config {
+        const char *name;
+        SchedulingOptions options;
+    };
+    vector<Config> configs = {
+        { "static split", { false, 1, false, false, slowFactor } },
+        { "work stealing", { true, 16, false, false, slowFactor } },
+        { "+ hot-key split", { true, 16, true, false, slowFactor } },
+        { "+ speculation", { true, 16, true, true, slowFactor } },
+    };
+    // Checked against the mmap pipeline, which shares no code with these
+    // runs beyond the tokenizer's definition of whitespace.
+    map<string, int> reference = mergePartitions(ParallelWordCount(threads, threads).run(path).partitions);
+    cout << "\n" << setw(16) << "scheduler" << setw(11) << "makespan" << setw(9) << "map ms" << setw(11)
+         << "reduce ms" << setw(10) << "merge ms" << setw(13) << "map p99/max" << setw(16) << "reduce p99/max"
+         << setw(8) << "steals" << setw(7) << "hot" << setw(12) << "backups/won" << setw(9) << "matches" << "\n";
+    for (const Config &config : configs) {
+        StealingWordCount counter(threads, config.options);
+        SchedulingStats s = counter.run(path);
+        ostringstream mapTail, reduceTail, backups;
+        mapTail << fixed << setprecision(0) << percentile(s.mapTaskMs, 0.99) << "/" << percentile(s.mapTaskMs, 1);
+        reduceTail << fixed << setprecision(0) << percentile(s.reduceTaskMs, 0.99) << "/"
+                   << percentile(s.reduceTaskMs, 1);
+        backups << s.backups << "/" << s.backupWins;
+        cout << setw(16) << config.name << setw(11) << fixed << setprecision(0) << s.makespanMs << setw(9) << s.mapMs
+             << setw(11) << s.reduceMs << setw(10) << s.mergeMs << setw(13) << mapTail.str() << setw(16)
+             << reduceTail.str() << setw(8) << s.steals << setw(7) << s.hotKeys << setw(12) << backups.str()
+             << setw(9) << (s.result == reference ? "yes" : "no") << "\n";
+    }
+}
+
+// Row layout shared by the two sketches: `depth` rows of `width` counters,
+// width a power of two. Row i of a key uses bucket (h1 + i * h2) mod width
+// (double hashing from one 64-bit hash), so all row indices come from one
+// branch-free loop the compiler vectorizes.
+struct SketchShape {
+    static constexpr int MAX_DEPTH = 16;
+    size_t width;
+    int depth;
+
+    // Width e / epsilon and depth ln(1 / delta), the Count-Min bounds.
+    SketchShape(double epsilon, double delta) {
+        width = 1;
+        while (width < exp(1.0) / epsilon) {
+            width *= 2;
+        }
+        depth = max(1, min(MAX_DEPTH, (int)ceil(log(1 / delta))));
+    }
+
+    void indices(uint64_t hash, uint32_t *index) const {
+        uint32_t h1 = hash, h2 = (hash >> 32) | 1, mask = width - 1;
+        for (int i = 0; i < depth; i++) {
+            index[i] = ((h1 + i * h2) & mask) + i * width;
+        }
+    }
+};
+
+// Count-Min sketch: estimates never undercount, and overcount by more than
+// epsilon * N (N = total count added) with probability at most delta.
+// Sketches with the same shape merge by adding their counters. Each row's
+// counters add up to N, so they are 64-bit: a hot word's bucket would wrap a
+// 32-bit counter after about 4.3e9 tokens.
+class CountMinSketch {
+public:
+    CountMinSketch(double epsilon, double delta) : shape(epsilon, delta), counters(shape.width * shape.depth, 0) {}
+
+    void add(uint64_t hash, uint64_t count = 1) {
+        uint32_t index[SketchShape::MAX_DEPTH];
+        shape.indices(hash, index);
+        for (int i = 0; i < shape.depth; i++) {
+            counters[index[i]] += count;
+        }
+    }
+
+    long long estimate(uint64_t hash) const {
+        uint32_t index[SketchShape::MAX_DEPTH];
+        shape.indices(hash, index);
+        uint64_t best = UINT64_MAX;
+        for (int i = 0; i < shape.depth; i++) {
+            best = min(best, counters[index[i]]);
+        }
+        return best;
+    }
+
+    long long upperBound(uint64_t hash) const { return estimate(hash); }
+
+    void merge(const CountMinSketch &other) {
+        for (size_t i = 0; i < counters.size(); i++) {
+            counters[i] += other.counters[i];
+        }
+    }
+
+    size_t memoryBytes() const { return counters.size() * sizeof(uint64_t); }
+
+private:
+    SketchShape shape;
+    vector<uint64_t> counters;
+};
+
+// Count Sketch: like Count-Min, but each row adds +count or -count (the sign
+// is one more bit of the hash) and the estimate is the median of the rows.
+// It is unbiased, may undercount, and its error scales with the L2 norm of
+// the counts rather than their sum, which is much smaller on skewed text.
+// Counters are 64-bit for the same reason as in CountMinSketch.
+class CountSketch {
+public:
+    CountSketch(double epsilon, double delta) : shape(epsilon, delta), counters(shape.width * shape.depth, 0) {}
+
+    void add(uint64_t hash, int64_t count = 1) {
+        uint32_t index[SketchShape::MAX_DEPTH];
+        shape.indices(hash, index);
+        uint32_t signs = hash >> 40;
+        for (int i = 0; i < shape.depth; i++) {
+            counters[index[i]] += (signs >> i & 1) ? count : -count;
+        }
+    }
+
+    long long estimate(uint64_t hash) const {
+        uint32_t index[SketchShape::MAX_DEPTH];
+        shape.indices(hash, index);
+        uint32_t signs = hash >> 40;
+        int64_t values[SketchShape::MAX_DEPTH];
+        for (int i = 0; i < shape.depth; i++) {
+            values[i] = (signs >> i & 1) ? counters[index[i]] : -counters[index[i]];
+        }
+        nth_element(values, values + shape.depth / 2, values + shape.depth);
+        return max<int64_t>(0, values[shape.depth / 2]);
+    }
+
+    // Count Sketch estimates can be low, so they give no upper bound.
+    long long upperBound(uint64_t) const { return LLONG_MAX; }
+
+    void merge(const CountSketch &other) {
+        for (size_t i = 0; i < counters.size(); i++) {
+            counters[i] += other.counters[i];
+        }
+    }
+
+    size_t memoryBytes() const { return counters.size() * sizeof(int64_t); }
+
+private:
+    SketchShape shape;
+    vector<int64_t> counters;
+};
+
+// Space-Saving summary of the most frequent keys with `capacity` counters.
+// A new key replaces the key with the smallest count and inherits that count
+// as its error, so every count is an upper bound that is at most N / capacity
+// too high, and every key more frequent than N / capacity is present.
+//
+// Counters form a min-heap on count; an open-addressing index (linear
+// probing, backward-shift deletion) maps keys to heap positions. Keys are
+// borrowed views that must outlive the summary.
+class SpaceSaving {
+public:
+    struct Counter {
+        string_view key;
+        uint64_t hash;
+        long long count, error;
+        uint32_t slot;  // position in `index`
+    };
+
+    explicit SpaceSaving(size_t capacity) : capacity(capacity) {
+        size_t slots = 4;
+        while (slots < 2 * capacity) {
+            slots *= 2;
+        }
+        index.assign(slots, EMPTY);
+        heap.reserve(capacity);
+    }
+
+    // `bound` is an upper bound on the key's total count so far, if one is
+    // known (e.g. from a Count-Min sketch that already includes this update).
+    // A missing key whose bound does not exceed the minimum is left out:
+    // keys outside the summary still count at most the minimum, so the
+    // guarantees hold, and the costly replacement of the minimum is skipped
+    // for most of the long tail.
+    void add(string_view key, uint64_t hash, long long count = 1, long long bound = LLONG_MAX) {
+        size_t mask = index.size() - 1, s = hash & mask;
+        for (; index[s] != EMPTY; s = (s + 1) & mask) {
+            Counter &c = heap[index[s]];
+            if (c.hash == hash && c.key == key) {
+                c.count += count;
+                siftDown(index[s]);
+                return;
+            }
+        }
+        if (heap.size() < capacity) {
+            index[s] = heap.size();
+            heap.push_back({ key, hash, count, 0, (uint32_t)s });
+            siftUp(heap.size() - 1);
+            return;
+        }
+        // Replace the minimum. Its index slot is freed first, which may move
+        // other slots, so the probe for the new key is repeated.
+        long long floor = heap[0].count;
+        if (bound <= floor) {
+            return;
+        }
+        erase(heap[0].slot);
+        for (s = hash & mask; index[s] != EMPTY; s = (s + 1) & mask) {
+        }
+        index[s] = 0;
+        heap[0] = { key, hash, min(floor + count, bound), floor, (uint32_t)s };
+        siftDown(0);
+    }
+
+    // Smallest count once the summary is full (the error bound of any key
+    // not in it), else 0.
+    long long minimum() const { return heap.size() < capacity ? 0 : heap[0].count; }
+
+    const vector<Counter> &counters() const { return heap; }
+
+    size_t memoryBytes() const { return heap.capacity() * sizeof(Counter) + index.size() * sizeof(uint32_t); }
+
+private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    void place(size_t i) { index[heap[i].slot] = i; }
+
+    void siftUp(size_t i) {
+        while (i > 0 && heap[(i - 1) / 2].count > heap[i].count) {
+            swap(heap[i], heap[(i - 1) / 2]);
+            place(i);
+            i = (i - 1) / 2;
+        }
+        place(i);
+    }
+
+    void siftDown(size_t i) {
+        for (;;) {
+            size_t smallest = i, left = 2 * i + 1, right = left + 1;
+            if (left < heap.size() && heap[left].count < heap[smallest].count) {
+                smallest = left;
+            }
+            if (right < heap.size() && heap[right].count < heap[smallest].count) {
+                smallest = right;
+            }
+            if (smallest == i) {
+                break;
+            }
+            swap(heap[i], heap[smallest]);
+            place(i);
+            i = smallest;
+        }
+        place(i);
+    }
 
-    // Traditional loop to iterate through the map (sortedData)
-    for (map<string, int>::const_iterator it = sortedData.begin(); it != sortedData.end(); ++it) {
-        cout << it->first << ": " << it->second << endl;  // Print word and its count
+    // Frees index slot `s` and shifts later entries of its probe run back.
+    void erase(size_t s) {
+        size_t mask = index.size() - 1;
+        index[s] = EMPTY;
+        for (size_t next = (s + 1) & mask; index[next] != EMPTY; next = (next + 1) & mask) {
+            size_t home = heap[index[next]].hash & mask;
+            // The entry may move into the hole if its home is not in (s, next].
+            if (((next - home) & mask) >= ((next - s) & mask)) {
+                index[s] = index[next];
+                heap[index[s]].slot = s;
+                index[next] = EMPTY;
+                s = next;
+            }
+        }
+    }
+
+    size_t capacity;
+    vector<Counter> heap;
+    vector<uint32_t> index;
+};
+
+struct ApproximateResult {
+    vector<pair<string, long long> > top;  // estimated counts, highest first
+    long long tokens;
+    size_t memoryBytes;  // sketches and summaries of all threads
+    double wallMs;
+};
+
+// Approximate top-k word count. Every thread scans its byte range into its
+// own sketch (Count-Min or Count Sketch) and Space-Saving summary, with no
+// shared state and nothing per distinct word beyond the summary's counters.
+// As in the exact pipeline, a small borrowed-key combiner sums repeated words
+// first, so the sketch and the summary take one weighted update per word per
+// flush instead of one per token. The sketches are then added together and the
+// summaries merged: a key missing from one summary is charged that summary's
+// minimum, as an upper bound. The candidates are ranked by their estimate
+// (for Count-Min the smaller of the two upper bounds, for Count Sketch the
+// sketch's median estimate).
+//
+// Memory is fixed by the error bounds: epsilon * N is the Count-Min error and
+// each summary has max(2k, 1 / epsilon) counters.
+template <typename Sketch>
+ApproximateResult approximateTopWords(const string &path, int threads, size_t k, double epsilon, double delta) {
+    const size_t COMBINER = 65536;
+    auto start = chrono::steady_clock::now();
+    MappedFile file(path);
+    string_view data = file.data();
+    size_t capacity = max(2 * k, (size_t)ceil(1 / epsilon));
+    vector<Sketch> sketches(threads, Sketch(epsilon, delta));
+    vector<SpaceSaving> summaries(threads, SpaceSaving(capacity));
+    vector<long long> tokens(threads, 0);
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            string_view range = wordRange(data, data.size() * t / threads, data.size() * (t + 1) / threads);
+            FlatStringMap combiner(COMBINER, true);
+            auto flush = [&]() {
+                combiner.forEachHashed([&](string_view word, uint64_t hash, int count) {
+                    sketches[t].add(hash, count);
+                    summaries[t].add(word, hash, count, sketches[t].upperBound(hash));
+                });
+                combiner.clear();
+            };
+            scanTokens(range.data(), range.data() + range.size(), [&](string_view word) {
+                combiner.add(word);
+                tokens[t]++;
+                if (combiner.size() >= COMBINER) {
+                    flush();
+                }
+            });
+            flush();
+        });
+    }
+    for (thread &th : workers) {
+        th.join();
+    }
+
+    ApproximateResult result;
+    result.tokens = 0;
+    result.memoryBytes = 0;
+    for (int t = 0; t < threads; t++) {
+        result.tokens += tokens[t];
+        result.memoryBytes += sketches[t].memoryBytes() + summaries[t].memoryBytes() + COMBINER * 40;
+        if (t > 0) {
+            sketches[0].merge(sketches[t]);
+        }
+    }
+    unordered_map<string_view, pair<uint64_t, long long> > merged;  // key -> (hash, upper bound)
+    long long minimums = 0;
+    for (const SpaceSaving &summary : summaries) {
+        minimums += summary.minimum();
+    }
+    for (const SpaceSaving &summary : summaries) {
+        for (const SpaceSaving::Counter &c : summary.counters()) {
+            auto inserted = merged.emplace(c.key, make_pair(c.hash, minimums));
+            inserted.first->second.second += c.count - summary.minimum();
+        }
+    }
+    vector<pair<long long, string_view> > ranked;
+    for (const auto &entry : merged) {
+        long long sketched = sketches[0].estimate(entry.second.first);
+        bool upperBound = is_same<Sketch, CountMinSketch>::value;
+        ranked.emplace_back(upperBound ? min(sketched, entry.second.second) : sketched, entry.first);
+    }
+    size_t n = min(k, ranked.size());
+    partial_sort(ranked.begin(), ranked.begin() + n, ranked.end(),
+                 [](const pair<long long, string_view> &a, const pair<long long, string_view> &b) {
+                     return a.first != b.first ? a.first > b.first : a.second < b.second;
+                 });
+    for (size_t i = 0; i < n; i++) {
+        result.top.emplace_back(string(ranked[i].second), ranked[i].first);
+    }
+    result.wallMs = sinceMs(start);
+    return result;
+}
+
+// Compares the exact parallel count (then its top k) with the two
+// approximate modes: throughput, memory and accuracy against the exact
+// counts. Recall is the share of the true top k that was returned; the
+// errors are over the returned words, relative to their true counts and as
+// a fraction of all tokens (to compare with epsilon).
+void benchmarkApproximate(const string &path, int threads, size_t k, double epsilon, double delta) {
+    resetPeakRss();
+    double baseline = peakRssMB();
+    ParallelWordCount counter(threads, threads, 65536);
+    ParallelCountResult exact = counter.run(path);
+    double exactRss = peakRssMB() - baseline;
+    unordered_map<string, long long> truth;
+    size_t exactBytes = 0;
+    vector<pair<long long, string> > exactTop;
+    for (const FlatStringMap &part : exact.partitions) {
+        exactBytes += part.memoryBytes();
+        part.forEach([&](string_view word, int count) {
+            truth.emplace(string(word), count);
+            exactTop.emplace_back(count, string(word));
+        });
+    }
+    size_t n = min(k, exactTop.size());
+    partial_sort(exactTop.begin(), exactTop.begin() + n, exactTop.end(),
+                 [](const pair<long long, string> &a, const pair<long long, string> &b) {
+                     return a.first != b.first ? a.first > b.first : a.second < b.second;
+                 });
+    unordered_set<string> exactSet;
+    for (size_t i = 0; i < n; i++) {
+        exactSet.insert(exactTop[i].second);
+    }
+    double megabytes = exact.bytes / 1048576.0;
+
+    cout << "\n" << exact.tokens << " tokens, " << truth.size() << " distinct words, top " << n << ", epsilon "
+         << epsilon << " (" << (long long)(epsilon * exact.tokens) << " tokens), delta " << delta << "\n";
+    cout << setw(18) << "mode" << setw(10) << "wall ms" << setw(9) << "MB/s" << setw(13) << "structure MB"
+         << setw(10) << "RSS +MB" << setw(9) << "recall" << setw(14) << "mean rel err" << setw(12) << "max err/N"
+         << "\n";
+    cout << setw(18) << "exact" << setw(10) << fixed << setprecision(1) << exact.wallMs << setw(9)
+         << megabytes / (exact.wallMs / 1000) << setw(13) << exactBytes / 1048576.0 << setw(10) << exactRss
+         << setw(9) << "1.000" << setw(14) << "0" << setw(12) << "0" << "\n";
+
+    auto report = [&](const char *name, const ApproximateResult &r, double rss) {
+        size_t hits = 0;
+        double relative = 0, worst = 0;
+        for (const pair<string, long long> &entry : r.top) {
+            hits += exactSet.count(entry.first);
+            long long actual = truth.count(entry.first) ? truth[entry.first] : 0;
+            relative += fabs((double)entry.second - actual) / max(1LL, actual);
+            worst = max(worst, fabs((double)entry.second - actual));
+        }
+        cout << setw(18) << name << setw(10) << setprecision(1) << r.wallMs << setw(9)
+             << megabytes / (r.wallMs / 1000) << setw(13) << r.memoryBytes / 1048576.0 << setw(10) << rss << setw(9)
+             << setprecision(3) << (double)hits / max((size_t)1, n) << setw(14) << setprecision(5)
+             << relative / max((size_t)1, r.top.size()) << setw(12) << setprecision(7) << worst / r.tokens << "\n";
+    };
+    // The exact run's maps are freed before measuring the sketches.
+    exact = ParallelCountResult();
+    truth.rehash(0);
+    resetPeakRss();
+    baseline = peakRssMB();
+    ApproximateResult cms = approximateTopWords<CountMinSketch>(path, threads, k, epsilon, delta);
+    report("count-min + SS", cms, peakRssMB() - baseline);
+    resetPeakRss();
+    baseline = peakRssMB();
+    ApproximateResult cs = approximateTopWords<CountSketch>(path, threads, k, epsilon, delta);
+    report("count sketch + SS", cs, peakRssMB() - baseline);
+}
+
+// One occurrence of a term for the index builder. Documents are the lines of
+// the corpus (docId = line number) and positions count tokens within a line.
+struct TermOccurrence {
+    string_view term;
+    uint64_t hash;
+    uint32_t doc, position;
+};
+
+// Map function for indexing: like mapFunction, but emits (term, docId,
+// position) for every token of one document instead of (word, 1).
+void mapFunction(string_view document, uint32_t docId, vector<TermOccurrence> &out) {
+    uint32_t position = 0;
+    scanTokens(document.data(), document.data() + document.size(), [&](string_view term) {
+        out.push_back({ term, hashBytes(term), docId, position++ });
+    });
+}
+
+void appendVarint(string &out, uint64_t v) {
+    while (v >= 0x80) {
+        out += char(v | 0x80);
+        v >>= 7;
+    }
+    out += char(v);
+}
+
+inline uint64_t readVarint(const uint8_t *&p) {
+    uint64_t v = 0;
+    for (int shift = 0; ; shift += 7) {
+        uint8_t byte = *p++;
+        v |= uint64_t(byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            return v;
+        }
+    }
+}
+
+// On-disk index, laid out to be used straight from an mmap:
+//   header      IndexHeader
+//   postings    per term, in term order: the doc section, then the positions
+//   dictionary  one IndexTerm per term, sorted by term (binary search)
+//   strings     the term bytes
+// A doc section is a skip table (one IndexSkip per block of SKIP_BLOCK
+// documents, only when there is more than one block) followed by a varint
+// per document: the doc delta shifted left by one, with the low bit set when
+// the term frequency is one; otherwise the frequency follows as a varint. Deltas run across blocks; a
+// block's skip entry holds its last doc and its byte offset, so a
+// reader can jump to a block without decoding the ones before it. The
+// positions section holds, for every document in order, the varint deltas of
+// the term's positions in it. Zero bytes pad the postings of a term with a
+// skip table to a multiple of alignof(IndexSkip) and the dictionary to a
+// multiple of alignof(IndexTerm), so both are read in place from the mapping.
+struct IndexHeader {
+    char magic[8];
+    uint64_t terms, documents, tokens, dictionaryOffset, stringsOffset;
+};
+
+struct IndexTerm {
+    uint64_t stringOffset;
+    uint32_t length, documents;
+    uint64_t postingsOffset;
+    uint32_t docBytes, positionBytes;  // sizes of the doc section (with skips) and the positions
+};
+
+struct IndexSkip {
+    uint32_t lastDoc;  // last doc of the block
+    uint32_t offset;   // byte offset of the block after the skip table
+};
+
+const uint32_t SKIP_BLOCK = 128;
+const char INDEX_MAGIC[8] = { 'W', 'C', 'I', 'D', 'X', '0', '0', '2' };
+
+// Appends the doc and position sections of one term to `out`. `occurrences`
+// are (doc << 32 | position), sorted.
+void encodePostings(const vector<uint64_t> &occurrences, string &out, uint32_t &documents, uint32_t &docBytes,
+                    uint32_t &positionBytes) {
+    vector<pair<uint32_t, uint32_t> > docs;  // (doc, term frequency)
+    string positions;
+    uint32_t previousPosition = 0;
+    for (uint64_t occurrence : occurrences) {
+        uint32_t doc = occurrence >> 32, position = occurrence;
+        if (docs.empty() || docs.back().first != doc) {
+            docs.emplace_back(doc, 0);
+            previousPosition = 0;
+        }
+        docs.back().second++;
+        appendVarint(positions, position - previousPosition);
+        previousPosition = position;
+    }
+    size_t blocks = (docs.size() + SKIP_BLOCK - 1) / SKIP_BLOCK;
+    vector<IndexSkip> skips;
+    string section;
+    uint32_t previous = 0;
+    for (size_t i = 0; i < docs.size(); i++) {
+        if (i % SKIP_BLOCK == 0) {
+            skips.push_back({ 0, (uint32_t)section.size() });
+        }
+        // The low bit flags a term frequency of one, the common case, which
+        // then takes no varint of its own.
+        uint64_t delta = docs[i].first - previous;
+        appendVarint(section, delta << 1 | (docs[i].second == 1));
+        if (docs[i].second != 1) {
+            appendVarint(section, docs[i].second);
+        }
+        previous = docs[i].first;
+        skips.back().lastDoc = previous;
+    }
+    size_t start = out.size();
+    if (blocks > 1) {
+        out.append(reinterpret_cast<const char *>(skips.data()), skips.size() * sizeof(IndexSkip));
+    }
+    out += section;
+    documents = docs.size();
+    docBytes = out.size() - start;
+    out += positions;
+    positionBytes = positions.size();
+}
+
+struct IndexBuildStats {
+    long long tokens, documents, terms, indexBytes, bytes;
+    double wallMs;
+};
+
+// Builds the index with the map/shuffle/reduce pipeline: mappers call the
+// indexing mapFunction on each line of their range and send the occurrences
+// to reducer hash(term) % reducers; each reducer collects the occurrences of
+// its terms and encodes their postings; the writer lays the terms out in
+// sorted order.
+IndexBuildStats buildInvertedIndex(const string &corpus, const string &indexPath, int mappers, int reducers) {
+    auto start = chrono::steady_clock::now();
+    MappedFile file(corpus);
+    string_view data = file.data();
+    long long size = data.size();
+
+    // Document ids are global line numbers, so each mapper first counts the
+    // lines before its range.
+    vector<long long> bounds(mappers + 1);
+    for (int t = 0; t <= mappers; t++) {
+        long long offset = size * t / mappers;
+        if (offset > 0 && offset < size) {
+            const char *newline = (const char *)memchr(data.data() + offset - 1, '\n', size - offset + 1);
+            offset = newline ? newline - data.data() + 1 : size;
+        }
+        bounds[t] = offset;
+    }
+    vector<long long> firstDoc(mappers + 1, 0);
+    {
+        vector<thread> counters;
+        for (int t = 0; t < mappers; t++) {
+            counters.emplace_back([&, t] {
+                firstDoc[t + 1] = count(data.data() + bounds[t], data.data() + bounds[t + 1], '\n');
+            });
+        }
+        for (thread &th : counters) {
+            th.join();
+        }
+        for (int t = 0; t < mappers; t++) {
+            firstDoc[t + 1] += firstDoc[t];
+        }
+        if (size > 0 && data[size - 1] != '\n') {
+            firstDoc[mappers]++;
+        }
+    }
+
+    typedef vector<TermOccurrence> OccurrenceBatch;
+    vector<unique_ptr<BasicPartitionQueue<OccurrenceBatch> > > queues;
+    for (int r = 0; r < reducers; r++) {
+        queues.emplace_back(new BasicPartitionQueue<OccurrenceBatch>(4 * mappers, mappers));
+    }
+    struct EncodedTerm {
+        string_view term;
+        int reducer;
+        uint64_t offset;
+        uint32_t documents, docBytes, positionBytes;
+    };
+    vector<BasicFlatStringMap<vector<uint64_t> > > tables(reducers);
+    vector<string> blobs(reducers);
+    vector<vector<EncodedTerm> > encoded(reducers);
+    vector<long long> tokens(mappers, 0);
+
+    vector<thread> threads;
+    for (int r = 0; r < reducers; r++) {
+        threads.emplace_back([&, r] {
+            OccurrenceBatch batch;
+            while (queues[r]->pop(batch)) {
+                for (const TermOccurrence &o : batch) {
+                    tables[r].valueFor(o.term, o.hash).push_back((uint64_t)o.doc << 32 | o.position);
+                }
+            }
+            tables[r].forEachHashed([&](string_view term, uint64_t, vector<uint64_t> &occurrences) {
+                if (!is_sorted(occurrences.begin(), occurrences.end())) {
+                    sort(occurrences.begin(), occurrences.end());  // batches of different mappers interleave
+                }
+                EncodedTerm e = { term, r, blobs[r].size(), 0, 0, 0 };
+                encodePostings(occurrences, blobs[r], e.documents, e.docBytes, e.positionBytes);
+                encoded[r].push_back(e);
+                vector<uint64_t>().swap(occurrences);
+            });
+        });
+    }
+    for (int t = 0; t < mappers; t++) {
+        threads.emplace_back([&, t] {
+            const size_t BATCH = 4096;
+            vector<OccurrenceBatch> pending(reducers);
+            vector<TermOccurrence> occurrences;
+            uint32_t doc = firstDoc[t];
+            forEachLine(data.substr(bounds[t], bounds[t + 1] - bounds[t]), [&](string_view line) {
+                occurrences.clear();
+                mapFunction(line, doc++, occurrences);
+                for (const TermOccurrence &o : occurrences) {
+                    int r = o.hash % reducers;
+                    pending[r].push_back(o);
+                    if (pending[r].size() == BATCH) {
+                        queues[r]->push(move(pending[r]));
+                        pending[r] = OccurrenceBatch();
+                        pending[r].reserve(BATCH);
+                    }
+                }
+                tokens[t] += occurrences.size();
+            });
+            for (int r = 0; r < reducers; r++) {
+                if (!pending[r].empty()) {
+                    queues[r]->push(move(pending[r]));
+                }
+                queues[r]->producerDone();
+            }
+        });
+    }
+    for (thread &th : threads) {
+        th.join();
+    }
+
+    vector<EncodedTerm> terms;
+    for (vector<EncodedTerm> &part : encoded) {
+        terms.insert(terms.end(), part.begin(), part.end());
+    }
+    sort(terms.begin(), terms.end(), [](const EncodedTerm &a, const EncodedTerm &b) { return a.term < b.term; });
+
+    IndexBuildStats stats = IndexBuildStats();
+    stats.terms = terms.size();
+    stats.documents = firstDoc[mappers];
+    stats.bytes = size;
+    for (long long n : tokens) {
+        stats.tokens += n;
+    }
+    IndexHeader header;
+    memcpy(header.magic, INDEX_MAGIC, 8);
+    header.terms = terms.size();
+    header.documents = stats.documents;
+    header.tokens = stats.tokens;
+    ofstream out(indexPath, ios::binary);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    vector<IndexTerm> dictionary(terms.size());
+    uint64_t offset = sizeof(header), stringOffset = 0;
+    auto align = [&](size_t alignment) {
+        static const char zeros[16] = {};
+        size_t padding = (alignment - offset % alignment) % alignment;
+        out.write(zeros, padding);
+        offset += padding;
+    };
+    for (size_t i = 0; i < terms.size(); i++) {
+        const EncodedTerm &e = terms[i];
+        if (e.documents > SKIP_BLOCK) {
+            align(alignof(IndexSkip));
+        }
+        size_t length = e.docBytes + e.positionBytes;
+        out.write(blobs[e.reducer].data() + e.offset, length);
+        dictionary[i] = { stringOffset, (uint32_t)e.term.size(), e.documents, offset, e.docBytes, e.positionBytes };
+        offset += length;
+        stringOffset += e.term.size();
+    }
+    align(alignof(IndexTerm));
+    header.dictionaryOffset = offset;
+    out.write(reinterpret_cast<const char *>(dictionary.data()), dictionary.size() * sizeof(IndexTerm));
+    header.stringsOffset = offset + dictionary.size() * sizeof(IndexTerm);
+    for (const EncodedTerm &e : terms) {
+        out.write(e.term.data(), e.term.size());
+    }
+    stats.indexBytes = header.stringsOffset + stringOffset;
+    out.seekp(0);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.close();
+    stats.wallMs = sinceMs(start);
+    return stats;
+}
+
+// Iterates the documents of one term in increasing order. advanceTo uses the
+// skip table to jump over whole blocks.
+class PostingCursor {
+public:
+    PostingCursor(const uint8_t *section, uint32_t documents) : documents(documents) {
+        blocks = (documents + SKIP_BLOCK - 1) / SKIP_BLOCK;
+        skips = reinterpret_cast<const IndexSkip *>(section);
+        data = p = section + (blocks > 1 ? blocks * sizeof(IndexSkip) : 0);
+        if (blocks <= 1) {
+            skips = nullptr;
+        }
+    }
+
+    uint32_t doc() const { return current; }
+
+    // Moves to the next document; false at the end.
+    bool next() {
+        if (index == documents) {
+            return false;
+        }
+        uint64_t word = readVarint(p);
+        current += word >> 1;
+        if (!(word & 1)) {
+            readVarint(p);  // term frequency
+        }
+        index++;
+        return true;
+    }
+
+    // Moves to the first document >= target; false if there is none.
+    bool advanceTo(uint32_t target) {
+        if (index > 0 && current >= target) {
+            return true;
+        }
+        if (skips) {
+            uint32_t block = index == 0 ? 0 : (index - 1) / SKIP_BLOCK;
+            if (skips[block].lastDoc < target) {
+                uint32_t b = block + 1;
+                while (b < blocks && skips[b].lastDoc < target) {
+                    b++;
+                }
+                if (b == blocks) {
+                    index = documents;
+                    return false;
+                }
+                current = skips[b - 1].lastDoc;
+                p = data + skips[b].offset;
+                index = b * SKIP_BLOCK;
+            }
+        }
+        while (next()) {
+            if (current >= target) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    const IndexSkip *skips;
+    const uint8_t *data, *p;
+    uint32_t documents, blocks, index = 0, current = 0;
+};
+
+// Read-only view of an index file built by buildInvertedIndex.
+class InvertedIndex {
+public:
+    explicit InvertedIndex(const string &path) : file(path) {
+        string_view bytes = file.data();
+        if (bytes.size() < sizeof(IndexHeader) || memcmp(bytes.data(), INDEX_MAGIC, 8) != 0) {
+            return;
+        }
+        memcpy(&header, bytes.data(), sizeof(header));
+        base = reinterpret_cast<const uint8_t *>(bytes.data());
+        dictionary = reinterpret_cast<const IndexTerm *>(base + header.dictionaryOffset);
+    }
+
+    bool valid() const { return base != nullptr; }
+    const IndexHeader &info() const { return header; }
+
+    string_view term(size_t i) const {
+        return string_view(reinterpret_cast<const char *>(base + header.stringsOffset + dictionary[i].stringOffset),
+                           dictionary[i].length);
+    }
+
+    const IndexTerm &entry(size_t i) const { return dictionary[i]; }
+
+    // Dictionary index of `word`, or -1.
+    long long find(string_view word) const {
+        size_t lo = 0, hi = header.terms;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (term(mid) < word) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo < header.terms && term(lo) == word ? (long long)lo : -1;
+    }
+
+    PostingCursor cursor(size_t i) const {
+        return PostingCursor(base + dictionary[i].postingsOffset, dictionary[i].documents);
+    }
+
+    // Documents that contain every word. The rarest term drives the loop and
+    // the others are advanced to each of its documents.
+    vector<uint32_t> intersect(const vector<string> &words) const {
+        vector<uint32_t> result;
+        vector<size_t> ids;
+        for (const string &w : words) {
+            long long id = find(w);
+            if (id < 0) {
+                return result;
+            }
+            ids.push_back(id);
+        }
+        if (ids.empty()) {
+            return result;
+        }
+        sort(ids.begin(), ids.end(),
+             [&](size_t a, size_t b) { return dictionary[a].documents < dictionary[b].documents; });
+        vector<PostingCursor> cursors;
+        for (size_t id : ids) {
+            cursors.push_back(cursor(id));
+        }
+        while (cursors[0].next()) {
+            uint32_t doc = cursors[0].doc();
+            bool all = true;
+            for (size_t i = 1; i < cursors.size() && all; i++) {
+                if (!cursors[i].advanceTo(doc)) {
+                    return result;
+                }
+                all = cursors[i].doc() == doc;
+            }
+            if (all) {
+                result.push_back(doc);
+            }
+        }
+        return result;
+    }
+
+private:
+    MappedFile file;
+    IndexHeader header = IndexHeader();
+    const uint8_t *base = nullptr;
+    const IndexTerm *dictionary = nullptr;
+};
+
+// Builds the index, checks it against a direct scan of the corpus for a few
+// terms and queries, and times AND queries of three kinds.
+void benchmarkInvertedIndex(const string &corpus, const string &indexPath, int threads, int queries) {
+    IndexBuildStats s = buildInvertedIndex(corpus, indexPath, threads, threads);
+    cout << "\nBuilt " << indexPath << " in " << fixed << setprecision(1) << s.wallMs << " ms ("
+         << s.bytes / 1048576.0 / (s.wallMs / 1000) << " MB/s): " << s.documents << " documents, " << s.tokens
+         << " tokens, " << s.terms << " terms\n";
+    cout << "Index size " << s.indexBytes / 1048576.0 << " MB = " << setprecision(2)
+         << 100.0 * s.indexBytes / max(1LL, s.bytes) << "% of the input, " << 8.0 * s.indexBytes / max(1LL, s.tokens)
+         << " bits per occurrence\n";
+
+    InvertedIndex index(indexPath);
+    if (!index.valid() || index.info().terms == 0) {
+        cout << "Cannot read the index.\n";
+        return;
+    }
+    size_t terms = index.info().terms;
+    vector<size_t> byFrequency(terms);
+    for (size_t i = 0; i < terms; i++) {
+        byFrequency[i] = i;
+    }
+    sort(byFrequency.begin(), byFrequency.end(),
+         [&](size_t a, size_t b) { return index.entry(a).documents > index.entry(b).documents; });
+    mt19937 rng(5);
+    auto frequent = [&] { return string(index.term(byFrequency[rng() % min<size_t>(100, terms)])); };
+    // Rare terms are drawn from below the 100 most frequent; an index with
+    // fewer terms than that uses its least frequent one.
+    size_t rareBase = min<size_t>(100, terms - 1), rareCount = terms > 100 ? terms - 100 : 1;
+    auto rare = [&] { return string(index.term(byFrequency[rareBase + rng() % rareCount])); };
+
+    // Direct scan: documents of the corpus containing every word.
+    auto scan = [&](const vector<string> &words) {
+        MappedFile file(corpus);
+        vector<uint32_t> docs;
+        uint32_t doc = 0;
+        forEachLine(file.data(), [&](string_view line) {
+            vector<bool> seen(words.size(), false);
+            scanTokens(line.data(), line.data() + line.size(), [&](string_view token) {
+                for (size_t i = 0; i < words.size(); i++) {
+                    seen[i] = seen[i] || token == words[i];
+                }
+            });
+            if (find(seen.begin(), seen.end(), false) == seen.end()) {
+                docs.push_back(doc);
+            }
+            doc++;
+        });
+        return docs;
+    };
+    bool matches = true;
+    for (const vector<string> &query : { vector<string>{ rare() }, vector<string>{ frequent(), rare() },
+                                         vector<string>{ frequent(), frequent() } }) {
+        matches = matches && index.intersect(query) == scan(query);
+    }
+    cout << "Checked against a scan of the corpus: " << (matches ? "yes" : "no") << "\n";
+
+    cout << "\n" << setw(24) << "query" << setw(9) << "queries" << setw(13) << "avg results" << setw(10) << "p50 us"
+         << setw(10) << "p99 us" << setw(10) << "max us" << "\n";
+    struct Kind {
+        const char *name;
+        function<vector<string>()> make;
+    };
+    vector<Kind> kinds = {
+        { "rare AND frequent", [&] { return vector<string>{ rare(), frequent() }; } },
+        { "frequent AND frequent", [&] { return vector<string>{ frequent(), frequent() }; } },
+        { "3 terms, one rare", [&] { return vector<string>{ frequent(), frequent(), rare() }; } },
+    };
+    for (const Kind &kind : kinds) {
+        vector<double> micros;
+        long long results = 0;
+        for (int q = 0; q < queries; q++) {
+            vector<string> words = kind.make();
+            auto begin = chrono::steady_clock::now();
+            results += index.intersect(words).size();
+            micros.push_back(sinceMs(begin) * 1000);
+        }
+        cout << setw(24) << kind.name << setw(9) << queries << setw(13) << setprecision(1)
+             << (double)results / max(1, queries) << setw(10) << percentile(micros, 0.5) << setw(10)
+             << percentile(micros, 0.99) << setw(10) << percentile(micros, 1) << "\n";
+    }
+}
+
+// Query tool: reads lines of space-separated words and prints the documents
+// containing all of them.
+int runIndexQueries(const string &indexPath) {
+    InvertedIndex index(indexPath);
+    if (!index.valid()) {
+        cout << "Cannot read the index " << indexPath << ". Exiting...\n";
+        return 1;
+    }
+    cout << index.info().documents << " documents, " << index.info().terms << " terms\n";
+    cout << "Enter words to search for, one query per line (type 'DONE' to finish):\n";
+    string line;
+    while (getline(cin, line) && line != "DONE") {
+        istringstream words(line);
+        vector<string> query((istream_iterator<string>(words)), istream_iterator<string>());
+        if (query.empty()) {
+            continue;
+        }
+        auto begin = chrono::steady_clock::now();
+        vector<uint32_t> docs = index.intersect(query);
+        double micros = sinceMs(begin) * 1000;
+        cout << docs.size() << " documents (" << fixed << setprecision(1) << micros << " us)";
+        for (size_t i = 0; i < docs.size() && i < 10; i++) {
+            cout << (i == 0 ? ": " : ", ") << docs[i];
+        }
+        cout << (docs.size() > 10 ? ", ...\n" : "\n");
+    }
+    return 0;
+}
+
+// Binary result file: the sorted (word, count) result in a form downstream
+// jobs can mmap and search without parsing text.
+//   header   ResultHeader
+//   counts   one count per word, in key order (a column: count i is at a
+//            fixed offset), 4 bytes wide if every count fits, else 8
+//   keys     blocks of RESULT_BLOCK keys; the first key of a block is stored
+//            whole (varint length, bytes), the others as (shared prefix
+//            length, suffix length, suffix bytes) against the previous key
+//   blocks   one uint64 offset per key block, for binary search over the
+//            blocks' first keys
+struct ResultHeader {
+    char magic[8];
+    uint64_t keys, blocks, keysOffset, blocksOffset, countBytes;
+};
+
+const uint32_t RESULT_BLOCK = 16;
+const char RESULT_MAGIC[8] = { 'W', 'C', 'R', 'E', 'S', '0', '0', '1' };
+
+// Writes a result file from keys added in increasing order. Keys go through a
+// BufferedWriter; the counts and block offsets are kept in memory and written
+// behind them, then the header is filled in.
+class ResultFileWriter {
+public:
+    explicit ResultFileWriter(const string &path) : path(path), keysPath(path + ".keys"), keys(keysPath) {}
+
+    void add(string_view key, long long count) {
+        if (counts.size() % RESULT_BLOCK == 0) {
+            blocks.push_back(keys.bytesWritten());
+            putVarint(key.size());
+            keys << key;
+        } else {
+            size_t shared = 0, limit = min(key.size(), previous.size());
+            while (shared < limit && key[shared] == previous[shared]) {
+                shared++;
+            }
+            putVarint(shared);
+            putVarint(key.size() - shared);
+            keys << key.substr(shared);
+        }
+        previous.assign(key.data(), key.size());
+        counts.push_back(count);
     }
+
+    // Returns the file size, or -1 on failure.
+    long long close() {
+        keys.flush();
+        if (!keys.ok()) {
+            return -1;
+        }
+        long long keyBytes = keys.bytesWritten();
+        ResultHeader header;
+        memcpy(header.magic, RESULT_MAGIC, 8);
+        header.keys = counts.size();
+        header.blocks = blocks.size();
+        bool narrow = all_of(counts.begin(), counts.end(), [](int64_t c) { return c >= 0 && c <= UINT32_MAX; });
+        header.countBytes = narrow ? 4 : 8;
+        header.keysOffset = sizeof(header) + counts.size() * header.countBytes;
+        header.blocksOffset = header.keysOffset + keyBytes;
+
+        BufferedWriter out(path);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        if (narrow) {
+            for (int64_t c : counts) {
+                uint32_t v = c;
+                out.write(reinterpret_cast<const char *>(&v), 4);
+            }
+        } else {
+            out.write(reinterpret_cast<const char *>(counts.data()), counts.size() * sizeof(int64_t));
+        }
+        {
+            // Key bytes are copied from the side file in big reads.
+            int fd = open(keysPath.c_str(), O_RDONLY);
+            vector<char> chunk(1 << 20);
+            ssize_t n;
+            while (fd >= 0 && (n = read(fd, chunk.data(), chunk.size())) > 0) {
+                out.write(chunk.data(), n);
+            }
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        unlink(keysPath.c_str());
+        out.write(reinterpret_cast<const char *>(blocks.data()), blocks.size() * sizeof(uint64_t));
+        out.flush();
+        return out.ok() ? out.bytesWritten() : -1;
+    }
+
+private:
+    void putVarint(uint64_t v) {
+        char bytes[10];
+        int n = 0;
+        while (v >= 0x80) {
+            bytes[n++] = char(v | 0x80);
+            v >>= 7;
+        }
+        bytes[n++] = char(v);
+        keys.write(bytes, n);
+    }
+
+    string path, keysPath;
+    BufferedWriter keys;
+    vector<int64_t> counts;
+    vector<uint64_t> blocks;
+    string previous;
+};
+
+// Read-only view of a result file.
+class ResultFile {
+public:
+    explicit ResultFile(const string &path) : file(path) {
+        string_view bytes = file.data();
+        if (bytes.size() >= sizeof(ResultHeader) && memcmp(bytes.data(), RESULT_MAGIC, 8) == 0) {
+            memcpy(&header, bytes.data(), sizeof(header));
+            base = reinterpret_cast<const uint8_t *>(bytes.data());
+        }
+    }
+
+    bool valid() const { return base != nullptr; }
+    size_t size() const { return header.keys; }
+
+    // Looks `key` up with a binary search over the blocks' first keys and a
+    // scan of one block; returns false if it is absent.
+    bool find(string_view key, long long &count) const {
+        size_t lo = 0, hi = header.blocks;  // first block whose first key is > key
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (firstKey(mid) <= key) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo == 0) {
+            return false;
+        }
+        size_t block = lo - 1;
+        bool found = false;
+        scanBlock(block, [&](string_view k, size_t i) {
+            if (k == key) {
+                count = counts(i);
+                found = true;
+            }
+            return k < key;  // keep going while the keys are smaller
+        });
+        return found;
+    }
+
+    // Calls fn(key, count) for every entry in key order.
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        for (size_t b = 0; b < header.blocks; b++) {
+            scanBlock(b, [&](string_view k, size_t i) {
+                fn(k, counts(i));
+                return true;
+            });
+        }
+    }
+
+private:
+    long long counts(size_t i) const {
+        const uint8_t *p = base + sizeof(ResultHeader) + i * header.countBytes;
+        if (header.countBytes == 4) {
+            uint32_t v;
+            memcpy(&v, p, 4);
+            return v;
+        }
+        int64_t v;
+        memcpy(&v, p, 8);
+        return v;
+    }
+
+    const uint8_t *blockStart(size_t b) const {
+        uint64_t offset;
+        memcpy(&offset, base + header.blocksOffset + b * sizeof(uint64_t), 8);
+        return base + header.keysOffset + offset;
+    }
+
+    string_view firstKey(size_t b) const {
+        const uint8_t *p = blockStart(b);
+        size_t length = readVarint(p);
+        return string_view(reinterpret_cast<const char *>(p), length);
+    }
+
+    // Decodes block b, calling fn(key, index) until it returns false.
+    template <typename Fn>
+    void scanBlock(size_t b, Fn fn) const {
+        const uint8_t *p = blockStart(b);
+        size_t first = b * RESULT_BLOCK, last = min<size_t>(first + RESULT_BLOCK, header.keys);
+        string key;
+        for (size_t i = first; i < last; i++) {
+            size_t shared = i == first ? 0 : readVarint(p);
+            size_t suffix = readVarint(p);
+            key.resize(shared);
+            key.append(reinterpret_cast<const char *>(p), suffix);
+            p += suffix;
+            if (!fn(string_view(key), i)) {
+                return;
+            }
+        }
+    }
+
+    MappedFile file;
+    ResultHeader header = ResultHeader();
+    const uint8_t *base = nullptr;
+};
+
+// Writes the same sorted result four ways and reports MB/s: text with endl
+// (a flush per line, as reduceFunction used to), text through ofstream with
+// '\n', text through BufferedWriter, and the binary result file. Then looks
+// up every word, and every word with '~' appended (normally absent), in the
+// result file.
+void benchmarkOutput(const string &path, int threads, const string &outputDirectory) {
+    ParallelWordCount counter(threads, threads, 65536);
+    ParallelCountResult r = counter.run(path);
+    vector<pair<string_view, int> > sorted;
+    for (const FlatStringMap &part : r.partitions) {
+        part.forEach([&](string_view word, int count) { sorted.emplace_back(word, count); });
+    }
+    sort(sorted.begin(), sorted.end());
+    cout << "\n" << sorted.size() << " distinct words\n";
+    cout << setw(26) << "output" << setw(12) << "MB" << setw(12) << "ms" << setw(10) << "MB/s" << "\n";
+    auto report = [&](const char *name, long long bytes, double ms) {
+        cout << setw(26) << name << setw(12) << fixed << setprecision(1) << bytes / 1048576.0 << setw(12) << ms
+             << setw(10) << bytes / 1048576.0 / (ms / 1000) << "\n";
+    };
+    auto fileBytes = [](const string &file) {
+        struct stat st;
+        return stat(file.c_str(), &st) == 0 ? (long long)st.st_size : -1LL;
+    };
+
+    string text = outputDirectory + "/wordcount.txt", binary = outputDirectory + "/wordcount.res";
+    auto start = chrono::steady_clock::now();
+    {
+        ofstream out(text);
+        for (const pair<string_view, int> &entry : sorted) {
+            out << entry.first << ": " << entry.second << endl;
+        }
+    }
+    report("text, endl per line", fileBytes(text), sinceMs(start));
+    start = chrono::steady_clock::now();
+    {
+        ofstream out(text);
+        for (const pair<string_view, int> &entry : sorted) {
+            out << entry.first << ": " << entry.second << '\n';
+        }
+    }
+    report("text, ofstream + '\\n'", fileBytes(text), sinceMs(start));
+    start = chrono::steady_clock::now();
+    {
+        BufferedWriter out(text);
+        for (const pair<string_view, int> &entry : sorted) {
+            out << entry.first << ": " << entry.second << '\n';
+        }
+    }
+    report("text, BufferedWriter", fileBytes(text), sinceMs(start));
+    start = chrono::steady_clock::now();
+    long long bytes;
+    {
+        ResultFileWriter out(binary);
+        for (const pair<string_view, int> &entry : sorted) {
+            out.add(entry.first, entry.second);
+        }
+        bytes = out.close();
+    }
+    report("binary result file", bytes, sinceMs(start));
+
+    ResultFile result(binary);
+    start = chrono::steady_clock::now();
+    bool matches = result.valid() && result.size() == sorted.size();
+    long long count;
+    for (size_t i = 0; i < sorted.size() && matches; i++) {
+        matches = result.find(sorted[i].first, count) && count == sorted[i].second;
+    }
+    double hitMs = sinceMs(start);
+    start = chrono::steady_clock::now();
+    string absent;
+    for (size_t i = 0; i < sorted.size() && matches; i++) {
+        absent.assign(sorted[i].first.data(), sorted[i].first.size());
+        absent += '~';  // normally not a word of the corpus; checked below
+        auto it = lower_bound(sorted.begin(), sorted.end(), absent,
+                              [](const pair<string_view, int> &e, const string &k) { return e.first < k; });
+        matches = result.find(absent, count) == (it != sorted.end() && it->first == absent);
+    }
+    double missMs = sinceMs(start);
+    cout << "\nLookups: " << setprecision(0) << hitMs * 1e6 / max<size_t>(1, sorted.size()) << " ns per present word, "
+         << missMs * 1e6 / max<size_t>(1, sorted.size()) << " ns per absent word; all counts match: "
+         << (matches ? "yes" : "no") << "\n";
+    unlink(text.c_str());
+    unlink(binary.c_str());
 }
 
-int main() {
+int runInteractiveWordCount() {
     string line;
     vector<pair<string, int> > mappedData;
 
@@ -73,7 +3943,334 @@ int main() {
     return 0;
 }
 
+// Inputs much smaller than the number of mappers leave most ranges empty or
+// inside one word. Each must give the same counts as the sequential path.
+bool checkTinyInputs() {
+    const char *inputs[] = { "", "ab\n", "abcdefghijklmnop", "  a  bb\tccc\n\n dddd ", "x y x y x" };
+    const string path = "/tmp/wordcount_tiny_" + to_string(getpid()) + ".txt";
+    bool ok = true;
+    for (const char *input : inputs) {
+        ofstream(path) << input;
+        long long tokens;
+        map<string, int> expected = sequentialWordCount(path, tokens);
+        for (int mappers : { 1, 3, 8, 16 }) {
+            ParallelCountResult r = ParallelWordCount(mappers, 2).run(path);
+            ok = ok && r.tokens == tokens && mergePartitions(r.partitions) == expected;
+        }
+    }
+    remove(path.c_str());
+    return ok;
+}
+
+// --bench corpus=PATH mb=64 vocab=100000 skew=1.0 threads=4 combiner=65536:
+// the hand-written parallel word count and the same job on the generic engine.
+// Without a corpus a synthetic one is generated once under /tmp and reused by
+// later runs. Work is counted in input bytes.
+int runBenchmarks(int argc, char **argv) {
+    BenchmarkParams params(argc, argv, 2);
+    long long megabytes = params.integer("mb", 64);
+    int vocabulary = params.integer("vocab", 100000);
+    double skew = params.real("skew", 1.0);
+    string corpus = params.text("corpus", "");
+    int threads = params.integer("threads", 4);
+    size_t capacity = params.integer("combiner", 65536);
+    if (threads < 1 || megabytes < 1 || vocabulary < 1) {
+        cerr << "Invalid parameters\n";
+        return 1;
+    }
+    if (corpus.empty()) {
+        ostringstream name;
+        name << "/tmp/bench_corpus_" << megabytes << "_" << vocabulary << "_" << skew << ".txt";
+        corpus = name.str();
+        struct stat st;
+        if (stat(corpus.c_str(), &st) != 0) {
+            generateCorpus(corpus, megabytes, vocabulary, skew, 42);
+        }
+    }
+
+    if (!checkTinyInputs()) {
+        cerr << "Word count of a tiny input differs from the sequential count\n";
+        return 1;
+    }
+
+    WordCountChecksum handSum, engineSum;
+    runBenchmark("6_hadoop", "word_count", params, "bytes", [&]() {
+        ParallelWordCount counter(threads, threads, capacity);
+        ParallelCountResult r = counter.run(corpus);
+        for (const FlatStringMap &part : r.partitions) {
+            part.forEach([&](string_view word, int count) { handSum(word, count); });
+        }
+        return r.bytes;
+    });
+    runBenchmark("6_hadoop", "engine_word_count", params, "bytes", [&]() {
+        auto engine = makeMapReduceEngine<string_view, int>(threads, threads, capacity, wordCountMapper,
+                                                            sumCombiner, WordCountChecksum());
+        auto r = engine.run(corpus);
+        for (const WordCountChecksum &part : r.reducers) {
+            engineSum.add(part);
+        }
+        return r.bytes;
+    });
+    if (!(handSum == engineSum)) {
+        cerr << "Engine and hand-written word counts differ\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (benchmarkRequested(argc, argv)) {
+        return runBenchmarks(argc, argv);
+    }
+
+    int mode;
+    cout << "Select mode:\n";
+    cout << "1. Interactive word count\n";
+    cout << "2. Generate a synthetic corpus file\n";
+    cout << "3. Parallel word count benchmark\n";
+    cout << "4. Map-side combiner: memory and throughput\n";
+    cout << "5. Aggregation: std::map vs unordered_map vs flat hash map\n";
+    cout << "6. Tokenizer: getline + stringstream vs mmap scanners\n";
+    cout << "7. Streaming word count with windows\n";
+    cout << "8. Streaming ingest latency under load\n";
+    cout << "9. External sort shuffle with a memory budget\n";
+    cout << "10. Generic MapReduce engine: word count and example jobs\n";
+    cout << "11. Multi-process workers with a shared-memory shuffle\n";
+    cout << "12. Work stealing, hot-key splitting and speculation on skewed input\n";
+    cout << "13. Approximate top-k words with sketches\n";
+    cout << "14. Build an inverted index and benchmark queries\n";
+    cout << "15. Query an inverted index\n";
+    cout << "16. Result output: text vs buffered vs binary result file\n";
+    cout << "Enter choice: ";
+    cin >> mode;
+
+    if (mode == 1) {
+        string rest;
+        getline(cin, rest);
+        return runInteractiveWordCount();
+    } else if (mode == 2) {
+        string path;
+        long long megabytes;
+        int vocabulary;
+        double skew;
+        cout << "Enter the output path: ";
+        cin >> path;
+        cout << "Enter the size in MB, the vocabulary size and the Zipf exponent (e.g. 1024 100000 1.0): ";
+        cin >> megabytes >> vocabulary >> skew;
+        if (megabytes < 1 || vocabulary < 1) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        generateCorpus(path, megabytes, vocabulary, skew, 42);
+    } else if (mode == 3) {
+        string path;
+        int maxThreads;
+        cout << "Enter the corpus path: ";
+        cin >> path;
+        cout << "Enter the largest number of mapper/reducer threads (0 = all cores): ";
+        cin >> maxThreads;
+        if (maxThreads <= 0) {
+            maxThreads = max(1u, thread::hardware_concurrency());
+        }
+        if (!ifstream(path)) {
+            cout << "Cannot open " << path << ". Exiting...\n";
+            return 1;
+        }
+        if (!checkTinyInputs()) {
+            cout << "Word count of a tiny input differs from the sequential count. Exiting...\n";
+            return 1;
+        }
+        benchmarkParallelWordCount(path, maxThreads);
+    } else if (mode == 4) {
+        string path;
+        int threads, count;
+        cout << "Enter the corpus path: ";
+        cin >> path;
+        cout << "Enter the number of mapper/reducer threads: ";
+        cin >> threads;
+        cout << "Enter the number of combiner capacities to try, then each capacity (distinct words per mapper): ";
+        cin >> count;
+        if (threads < 1 || count < 0 || !ifstream(path)) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        vector<size_t> capacities(count);
+        for (size_t &c : capacities) {
+            cin >> c;
+        }
+        benchmarkCombiner(path, threads, capacities);
+    } else if (mode == 5) {
+        string path;
+        long long maxMegabytes;
+        cout << "Enter the corpus path: ";
+        cin >> path;
+        cout << "Enter how many MB of it to load: ";
+        cin >> maxMegabytes;
+        if (maxMegabytes < 1 || !ifstream(path)) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        benchmarkAggregation(path, maxMegabytes);
+    } else if (mode == 6) {
+        string path;
+        cout << "Enter the corpus path: ";
+        cin >> path;
+        if (!ifstream(path)) {
+            cout << "Cannot open " << path << ". Exiting...\n";
+            return 1;
+        }
+        benchmarkTokenizer(path);
+    } else if (mode == 7) {
+        long long windowMs, slideMs;
+        size_t maxKeys;
+        cout << "Enter the window and the slide in ms (equal for tumbling windows): ";
+        cin >> windowMs >> slideMs;
+        cout << "Enter the maximum number of words kept per pane: ";
+        cin >> maxKeys;
+        if (windowMs < 1 || slideMs < 1 || slideMs > windowMs || maxKeys < 2) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        string rest;
+        getline(cin, rest);
+        return runStreamingWordCount(windowMs, slideMs, maxKeys);
+    } else if (mode == 8) {
+        string path;
+        long long windowMs, slideMs;
+        size_t maxKeys;
+        double seconds;
+        int count;
+        cout << "Enter the corpus path: ";
+        cin >> path;
+        cout << "Enter the window and the slide in ms (equal for tumbling windows): ";
+        cin >> windowMs >> slideMs;
+        cout << "Enter the maximum number of words kept per pane and the seconds per rate: ";
+        cin >> maxKeys >> seconds;
+        cout << "Enter the number of rates to try, then each rate in lines per second: ";
+        cin >> count;
+        if (windowMs < 1 || slideMs < 1 || slideMs > windowMs || maxKeys < 2 || count < 1 || !ifstream(path)) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        vector<double> rates(count);
+        for (double &r : rates) {
+            cin >> r;
+        }
+        benchmarkStreaming(path, windowMs, slideMs, maxKeys, seconds, rates);
+        if (!checkStreamingMemory(maxKeys)) {
+            return 1;
+        }
+    } else if (mode == 9) {
+        string path, spillDirectory;
+        int mappers, count;
+        cout << "Enter the corpus path: ";
+        cin >> path;
+        cout << "Enter the number of mapper threads and the directory for run files: ";
+        cin >> mappers >> spillDirectory;
+        cout << "Enter the number of memory budgets to try, then each budget in MB: ";
+        cin >> count;
+        if (mappers < 1 || count < 1 || !ifstream(path)) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        vector<double> budgets(count);
+        for (double &b : budgets) {
+            cin >> b;
+        }
+        benchmarkExternalSort(path, mappers, spillDirectory, budgets);
+    } else if (mode == 10) {
+        string path, directory;
+        int threads;
+        long long megabytes;
+        cout << "Enter the corpus path: ";
+        cin >> path;
+        cout << "Enter the number of mapper/reducer threads: ";
+        cin >> threads;
+        cout << "Enter the directory for the job inputs and their size in MB each: ";
+        cin >> directory >> megabytes;
+        if (threads < 1 || megabytes < 1 || !ifstream(path)) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        benchmarkMapReduceEngine(path, threads, directory, megabytes);
+    } else if (mode == 11) {
+        string path;
+        int workers, reducers;
+        double crashPercent;
+        cout << "Enter the corpus path: ";
+        cin >> path;
+        cout << "Enter the number of worker processes, reduce partitions and the injected crash rate in % per "
+                "task attempt (e.g. 4 4 10): ";
+        cin >> workers >> reducers >> crashPercent;
+        if (workers < 1 || reducers < 1 || crashPercent < 0 || crashPercent >= 100 || !ifstream(path)) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        benchmarkMultiProcess(path, workers, reducers, crashPercent / 100);
+    } else if (mode == 12) {
+        string path;
+        int threads;
+        double slowFactor;
+        cout << "Enter the corpus path (e.g. generated with a Zipf exponent of 1.0 or more): ";
+        cin >> path;
+        cout << "Enter the number of worker threads and how many times slower worker 0 is (1 = none): ";
+        cin >> threads >> slowFactor;
+        if (threads < 1 || slowFactor < 1 || !ifstream(path)) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        benchmarkScheduling(path, threads, slowFactor);
+    } else if (mode == 13) {
+        string path;
+        int threads;
+        size_t k;
+        double epsilon, delta;
+        cout << "Enter the corpus path: ";
+        cin >> path;
+        cout << "Enter the number of threads, k, epsilon and delta (e.g. 4 1000 0.0001 0.01): ";
+        cin >> threads >> k >> epsilon >> delta;
+        if (threads < 1 || k < 1 || epsilon <= 0 || epsilon >= 1 || delta <= 0 || delta >= 1 || !ifstream(path)) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        benchmarkApproximate(path, threads, k, epsilon, delta);
+    } else if (mode == 14) {
+        string path, indexPath;
+        int threads, queries;
+        cout << "Enter the corpus path (one document per line) and the index path: ";
+        cin >> path >> indexPath;
+        cout << "Enter the number of mapper/reducer threads and the number of queries per kind: ";
+        cin >> threads >> queries;
+        if (threads < 1 || queries < 1 || !ifstream(path)) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        benchmarkInvertedIndex(path, indexPath, threads, queries);
+    } else if (mode == 15) {
+        string indexPath, rest;
+        cout << "Enter the index path: ";
+        cin >> indexPath;
+        getline(cin, rest);
+        return runIndexQueries(indexPath);
+    } else if (mode == 16) {
+        string path, directory;
+        int threads;
+        cout << "Enter the corpus path, the number of threads and the directory for output files: ";
+        cin >> path >> threads >> directory;
+        if (threads < 1 || !ifstream(path)) {
+            cout << "Invalid parameters. Exiting...\n";
+            return 1;
+        }
+        benchmarkOutput(path, threads, directory);
+    } else {
+        cout << "Invalid choice. Exiting...\n";
+        return 1;
+    }
+    return 0;
+}
+
 /*
+Enter choice: 1
 Enter text (type 'DONE' to finish input):
 hello world hello map reduce hello world
 this is a test hello test world
@@ -151,8 +4348,9 @@ The **Reduce Phase** processes the grouped data from the Shuffle & Sort Phase an
 
 ```cpp
 void reduceFunction(const map<string, int> &sortedData) {
+    BufferedWriter out(STDOUT_FILENO);
     for (map<string, int>::const_iterator it = sortedData.begin(); it != sortedData.end(); ++it) {
-        cout << it->first << ": " << it->second << endl;
+        out << it->first << ": " << it->second << '\n';
     }
 }
 ```
@@ -236,6 +4434,148 @@ world: 3
 
 ---
 
+### **Parallel Pipeline (`ParallelWordCount`)**
+- Mode 2 writes a synthetic corpus of a given size (Zipf-distributed words over a fixed vocabulary); mode 3 benchmarks the parallel pipeline on any text file, from 1 thread up to all cores.
+- The file is cut into M byte ranges, one per mapper thread. A word belongs to the range its first byte is in, so no word is split or counted twice (`wordRange`).
+- Before the benchmark, mode 3 counts a few tiny inputs (empty, one short line, one word, mixed whitespace) with 1, 3, 8 and 16 mappers against `sequentialWordCount`. With that many mappers most ranges are empty or lie inside a single word.
+- Each mapper sends `(word, 1)` to reducer `hash(word) % R` in batches of 4096 through a bounded `PartitionQueue`, so the shuffle holds a few batches per reducer instead of one pair per token of the whole input.
+- The R reducer threads aggregate their partitions while the mappers are still running. Partitions share no keys, so the result is the union of the R maps; every run is checked against the single-thread result.
+- Reported: tokens, distinct words, wall time and MB/s.
+
+---
+
+### **Map-Side Combiner**
+- `ParallelWordCount` takes an optional combiner capacity. Each mapper then sums its counts in a local hash table of at most that many words and sends `(word, count)` pairs only when the table is full and at the end of its range.
+- The shuffle carries about one pair per distinct word per flush instead of one per token, and memory is bounded by the table size, not by the input.
+- Mode 4 compares the original path (every pair in `mappedData`, only run for inputs up to 256 MB), the pipeline without a combiner and the pipeline with each given capacity. It reports pairs sent, MB/s and peak RSS (`VmHWM`, reset between runs).
+
+---
+
+### **Flat Hash Aggregation (`FlatStringMap.h`)**
+- The combiner and the reducers aggregate into `FlatStringMap`, an open-addressing table whose slots sit in one array with a control byte each. A lookup compares sixteen control bytes at once with SSE2 and only looks at slots whose 7-bit tag matches.
+- Keys of up to 16 bytes are stored in the slot itself; longer keys are copied once into an arena. Every slot keeps the full hash, so growing the table never hashes a string again.
+- Keys stay unordered while counting. `sortedItems()` sorts the final key array, and `mergePartitions` builds the sorted result only when it is printed or checked.
+- Mode 5 times aggregation of tokens already in memory with `std::map` (as in `shuffleAndSort`), `unordered_map` and `FlatStringMap`, with and without the final sort, and checks all of them against `std::map`.
+
+---
+
+### **Zero-Copy Input (`MappedFile`, `scanTokens`)**
+- The pipeline memory-maps the input file instead of reading it through streams. `scanTokens` classifies sixteen bytes at a time with SSE2 into a whitespace bit mask and yields `string_view` tokens that point into the mapping; it splits exactly like `stringstream >> word`.
+- Shuffle batches carry these views with their hash, and the combiner only borrows them (`FlatStringMap` with `borrowKeys`). A key is copied once, when a reducer first inserts it, so there is no allocation per token.
+- Mapped pages of the input count towards resident memory, so the peak RSS of mode 4 now includes the part of the file that has been read.
+- Mode 6 compares `getline` + `mapFunction`, the mapped file with a byte-at-a-time scanner and with the SSE2 scanner, against the speed of just reading the mapped bytes.
+
+---
+
+### **Streaming Word Count (`StreamingWordCount`)**
+- Mode 7 counts lines as they are typed instead of waiting for `DONE`. Time is cut into panes of one slide; a window is the last window/slide panes, so equal window and slide give tumbling windows and a shorter slide gives sliding ones. Each time a pane closes, the top ten words of the window ending there are printed.
+- The window's counts are updated per word and the expiring pane is subtracted, so a snapshot only ranks the window instead of merging all its panes.
+- Memory is bounded per pane: when a pane reaches its word limit, the long tail (words at or below a doubling threshold, until at least half are gone) is evicted and optionally spilled to a file. Counts in snapshots are then lower bounds. Evicted words are dropped from the window as well once they make up half of it, so a long pane does not keep every word it has seen.
+- Mode 8 is an open-loop load test. Line i is due at start + i / rate, and its latency runs from when it was due until it has been counted. It reports achieved lines/s, MB/s, p50/p99/p99.9/max latency, snapshots and evicted words for each rate. It then feeds a single pane 4, 16 and 64 times as many distinct words as the limit (at least 250k) and checks that the peak RSS growth stays flat.
+
+---
+
+### **External Sort Shuffle (`ExternalSortWordCount`)**
+- Mode 9 counts vocabularies larger than memory. Each mapper counts its slice into a `FlatStringMap` until its share of the budget (table, sort array and the mapped input pages it has read) is used, then sorts the table, writes it to disk as a run and starts again on the same table. Read input pages are released with `madvise(MADV_DONTNEED)`.
+- Runs are sorted `(word, count)` records, front-coded against the previous word, with varint lengths and counts, written through a 64 KB buffer.
+- A loser tree merges all runs and streams each word with its total count, in order, to the caller, so the full result is never held in memory. Run files are deleted afterwards.
+- For each budget it reports runs, spilled MB, map and merge time, MB/s, the mappers' peak buffer memory, resident set growth over the baseline and whether the result matches the in-memory count.
+
+---
+
+### **Generic Engine (`MapReduceEngine`)**
+- The parallel pipeline is also available as a template over the key, the value, the mapper, the combiner and the reducer. `makeMapReduceEngine<Key, Value>(mappers, reducers, combinerCapacity, mapper, combiner, reducer)` deduces the functor types, so the job's calls are inlined and there is no virtual dispatch or `std::function` per record.
+- A mapper receives a split of whole lines and calls `emit(key, value)`. The combiner folds a value into an accumulator whose `Value()` is the identity; it runs in the mappers (up to `combinerCapacity` keys) and in the reducers. Each reducer gets its own copy of the reducer and calls it once per key with the combined value.
+- The table type is picked per key type at compile time: `string_view` keys (views into the mapped input) use `BasicFlatStringMap<Value>`, the value-generic form of `FlatStringMap`; other keys use `unordered_map`. `PartitionQueue` is likewise `BasicPartitionQueue` over the batch type.
+- Mode 10 times word count on the engine against the hand-written `ParallelWordCount`, with and without a combiner, and checks both with the same checksum. It then generates inputs for three example jobs and runs each against a single-threaded hand-written loop:
+  - per-sensor count, sum, minimum and maximum (integer keys)
+  - distinct visitors per page
+  - a reduce-side join of customers and orders, giving revenue per country
+
+---
+
+### **Multi-Process Mode (`MultiProcessWordCount`)**
+- Mode 11 runs the job in separate processes, so a crash in one task does not take down the whole job. The coordinator forks the workers and sends them task numbers over `SOCK_SEQPACKET` Unix sockets. There are four map tasks per worker plus one reduce task per partition.
+- Data goes through POSIX shared memory (`shm_open`), never through the sockets. A map task counts its split and writes one list of `(word, count)` records per reducer into a segment. A reduce task maps list r of every map output, sums the counts and writes its own segment, which the coordinator reads at the end.
+- A dead worker shows up as EOF on its socket. The coordinator then:
+  - reaps the worker and forks a replacement
+  - re-queues the task the worker held, under a new attempt number
+  - gives the task up after four failed attempts, and reports it as failed
+- Segments are named by task and attempt, and reducers are told which attempt of each map task succeeded, so a half-written output is never read. Finished map outputs survive the death of the worker that wrote them. All segments are unlinked when the job ends.
+- The benchmark compares the threaded pipeline (with a combiner) against the process mode, with and without an injected crash rate per task attempt. It reports attempts, crashes, failed tasks, the shared MB written and whether the result matches.
+
+---
+
+### **Skew-Aware Scheduling (`WorkStealingPool`, `StealingWordCount`)**
+- Mode 12 runs `mapFunction` per line in the map tasks and `shuffleAndSort` per partition in the reduce tasks. Both kinds of task are scheduled on a pool with one deque per worker: a worker pops its own deque from the back and steals from the front of another worker's deque when its own is empty. This makes 16 map tasks per thread and 4 reduce tasks per thread worthwhile.
+- Hot keys: before the map phase, a sample of sixteen 256 KB windows finds the words with more than half a reducer's fair share of the tokens. Their pairs are dealt round-robin to all reducers, and the final merge sums the partial counts. One hot word therefore no longer makes one reduce task the longest.
+- Speculation: an idle worker starts a second attempt of any task that has run for more than twice the median task time of the phase. Each attempt writes private output, and the first to commit wins; the other drops its output.
+- Worker 0 can be made a straggler that takes a given factor longer per task. The benchmark then compares four setups:
+  - a static split (one map task and one reducer per thread, no stealing)
+  - work stealing
+  - work stealing with hot-key splitting
+  - all of the above with speculation
+- For each setup it reports the makespan, the time of each phase, p99 and maximum task times, steals, hot keys and backups launched/won, and whether the result matches an independent count by `ParallelWordCount`.
+
+---
+
+### **Approximate Top-k (`CountMinSketch`, `CountSketch`, `SpaceSaving`)**
+- Mode 13 finds the k most frequent words in memory that depends on the error bounds, not on the vocabulary. Each thread scans its range through a small combiner into its own sketch and its own Space-Saving summary, and the threads share nothing until the end.
+- Sketches have width e/epsilon (rounded up to a power of two) and depth ln(1/delta). All row indices of a key come from one 64-bit hash by double hashing, in a loop the compiler vectorizes. Sketches merge by adding their counters, which are 64-bit so a hot word's bucket does not wrap on billions of tokens.
+  - Count-Min never undercounts, and it overcounts by more than epsilon·N with probability at most delta.
+  - Count Sketch adds signed counts and takes the median across rows. It is unbiased, but it may undercount.
+- Space-Saving keeps max(2k, 1/epsilon) counters in a min-heap with an open-addressing index. A new word replaces the minimum.
+  - With Count-Min, a missing word whose sketch estimate does not exceed the minimum is left out. This keeps the guarantees and skips most of the long tail.
+  - Summaries merge by charging each missing word the minimum of the summary that lacks it.
+- Final candidates are ranked by the smaller of the two upper bounds (Count-Min) or by the sketch estimate (Count Sketch).
+- The benchmark compares both modes with the exact parallel count. It reports:
+  - MB/s
+  - structure MB
+  - peak RSS growth, which includes the pages of the mapped input
+  - recall of the true top k
+  - mean relative error, and maximum error as a fraction of the tokens (to compare with epsilon)
+
+---
+
+### **Inverted Index (`buildInvertedIndex`, `InvertedIndex`)**
+- An overload of `mapFunction` takes a document and its id and emits `(term, docId, position)` for every token. Mode 14 treats each line of the corpus as a document. The mappers number the lines after counting the newlines before their ranges in parallel, and they send the occurrences to reducer `hash(term) % R` as in the word count.
+- Each reducer gathers the occurrences of its terms, sorts them by (doc, position) and encodes each posting list as:
+  - a doc section of varint doc deltas. The low bit marks a term frequency of one; any other frequency follows as its own varint.
+  - a skip entry (last doc, byte offset) per block of 128 documents
+  - a positions section of varint position deltas per document
+- The file holds a header, the posting lists in term order, a fixed-size dictionary sorted by term, and the term strings. It is used directly from an `mmap`, and terms are found by binary search.
+- `InvertedIndex::intersect` answers AND queries. It walks the rarest term's documents, and `PostingCursor::advanceTo` moves the other cursors forward, using the skip entries to jump over whole blocks.
+- Mode 14 reports:
+  - build time and MB/s
+  - index size, as a share of the input and in bits per occurrence
+  - a check of a few queries against a direct scan of the corpus
+  - p50, p99 and maximum latency for rare AND frequent, frequent AND frequent, and three-term queries
+- Mode 15 is the query tool: it reads one query per line and prints the number of matching documents, the time and the first document ids.
+
+---
+
+### **Result Output (`BufferedWriter`, `ResultFileWriter`, `ResultFile`)**
+- `reduceFunction` now writes through `BufferedWriter`, which collects output in a 1 MB buffer and calls `write(2)` only when the buffer is full. Before, `endl` flushed after every word.
+- `ResultFileWriter` writes the sorted result as a binary file that downstream jobs can `mmap` and search without parsing text:
+  - the counts as a fixed-width column (4 bytes when they fit, else 8)
+  - the keys in blocks of 16. The first key of a block is stored whole and the others as (shared prefix, suffix) against the previous key.
+  - an offset per block
+- `ResultFile::find` binary-searches the first keys of the blocks and decodes one block.
+- Mode 16 counts a corpus, then writes the result as text with `endl`, as text through `ofstream` with `'\n'`, through `BufferedWriter`, and as a result file. It reports MB and MB/s for each, then looks up every word (and a normally absent variant) in the result file and checks the counts.
+
+---
+
+### **Benchmark Mode (`--bench`)**
+- `./6_hadoop --bench mb=64 vocab=100000 skew=1.0 threads=4 combiner=65536 [corpus=PATH]` skips the menu and prints two JSON lines:
+  - `word_count`: `ParallelWordCount`
+  - `engine_word_count`: the same job on `MapReduceEngine`
+- Each line has wall time, input bytes, bytes per second and the hardware counters (`BenchmarkHarness.h`).
+- Without `corpus`, a synthetic corpus is generated once as `/tmp/bench_corpus_<mb>_<vocab>_<skew>.txt` and reused, so repeated runs measure only the count.
+- Before timing anything it counts a few tiny inputs (empty, one short line, one word, mixed whitespace) with 1, 3, 8 and 16 mappers against `sequentialWordCount`. With that many mappers most ranges are empty or lie inside a single word.
+- The run exits with status 1 if a tiny input is miscounted or the two word counts differ. `BenchmarkDriver.cpp` runs it with the other programs and flags regressions against a saved baseline.
+
+---
+
 ### **Key Features**
 1. **Decoupled Phases:**
    - Each phase (Map, Shuffle & Sort, Reduce) is modular and handles a specific responsibility.
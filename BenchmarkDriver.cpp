@@ -0,0 +1,413 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <unistd.h>
+#include <sys/wait.h>
+using namespace std;
+
+// One program of the suite. The binary is looked up in the bin directory
+// under each of its candidate names (the source names contain spaces, so
+// builds name them differently); args are the --bench parameters.
+struct SuiteEntry {
+    string program;
+    vector<string> candidates;
+    vector<string> args;
+};
+
+vector<SuiteEntry> defaultSuite() {
+    return {
+        { "1_Cannon", { "1_Cannon_MatrixMultiplication", "1_Cannon" }, { "n=256" } },
+        { "2_Lamport", { "2_Lamport" }, { "n=1000", "messages=1000" } },
+        { "3_DIN", { "3_DIN [WO CRONO]", "3_DIN__WO_CRONO_", "3_DIN" }, { "meals=2000" } },
+        { "4_RING", { "4_RING" }, { "n=100000", "sim_n=20000" } },
+        { "5_BULLY", { "5_BULLY" }, { "n=8000", "sim_n=1000" } },
+        { "6_hadoop", { "6_hadoop cpp", "6_hadoop_cpp", "6_hadoop" }, { "mb=64" } },
+    };
+}
+
+// One JSON line printed by a program in --bench mode. Only the fields the
+// driver needs are pulled out; `line` keeps the rest.
+struct Record {
+    string key;  // program/bench/params, identifies the measurement across runs
+    string line;
+    double wallMs = 0;
+    double throughput = 0;
+    long long instructions = -1;
+};
+
+// Raw text of the value of "field" in a flat JSON object: a number, null, a
+// quoted string (with its quotes) or a {...} object without nested braces.
+string jsonField(const string &line, const string &field) {
+    string tag = "\"" + field + "\":";
+    size_t at = line.find(tag);
+    if (at == string::npos) {
+        return "";
+    }
+    size_t begin = at + tag.size(), end = begin;
+    if (begin < line.size() && line[begin] == '{') {
+        end = line.find('}', begin) + 1;
+    } else if (begin < line.size() && line[begin] == '"') {
+        end = begin + 1;
+        while (end < line.size() && line[end] != '"') {
+            end += line[end] == '\\' ? 2 : 1;
+        }
+        end++;
+    } else {
+        while (end < line.size() && line[end] != ',' && line[end] != '}') {
+            end++;
+        }
+    }
+    return line.substr(begin, end - begin);
+}
+
+// "program/bench" without quotes and parameters, for the tables.
+string displayName(const string &key) {
+    string name = key.substr(0, key.find('/', key.find('/') + 1));
+    name.erase(remove(name.begin(), name.end(), '"'), name.end());
+    return name;
+}
+
+bool parseRecord(const string &line, Record &r) {
+    if (line.empty() || line[0] != '{') {
+        return false;
+    }
+    string program = jsonField(line, "program"), bench = jsonField(line, "bench"), wall = jsonField(line, "wall_ms");
+    if (program.empty() || bench.empty() || wall.empty()) {
+        return false;
+    }
+    r.key = program + "/" + bench + "/" + jsonField(line, "params");
+    r.line = line;
+    r.wallMs = atof(wall.c_str());
+    r.throughput = atof(jsonField(line, "throughput").c_str());
+    string instructions = jsonField(line, "instructions");
+    r.instructions = instructions.empty() || instructions == "null" ? -1 : atoll(instructions.c_str());
+    return true;
+}
+
+// Runs the binary with --bench and the given arguments and returns the lines
+// it printed on stdout; stderr passes through. ok is false if it could not be
+// started or did not exit with status 0.
+vector<string> runProgram(const string &path, const vector<string> &args, bool &ok) {
+    vector<string> lines;
+    ok = false;
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return lines;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        vector<char *> argv;
+        argv.push_back(const_cast<char *>(path.c_str()));
+        argv.push_back(const_cast<char *>("--bench"));
+        for (const string &a : args) {
+            argv.push_back(const_cast<char *>(a.c_str()));
+        }
+        argv.push_back(nullptr);
+        execv(path.c_str(), argv.data());
+        _exit(127);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        return lines;
+    }
+    string output;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        output.append(buffer, n);
+    }
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    istringstream in(output);
+    string line;
+    while (getline(in, line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+// The record with the median wall time among repeated runs of one
+// measurement, with the spread of the runs added to its JSON line.
+Record medianRecord(vector<Record> runs) {
+    sort(runs.begin(), runs.end(), [](const Record &a, const Record &b) { return a.wallMs < b.wallMs; });
+    Record r = runs[runs.size() / 2];
+    ostringstream extra;
+    extra << fixed << setprecision(3) << ",\"runs\":" << runs.size() << ",\"wall_ms_min\":" << runs.front().wallMs
+          << ",\"wall_ms_max\":" << runs.back().wallMs << "}";
+    r.line = r.line.substr(0, r.line.rfind('}')) + extra.str();
+    return r;
+}
+
+vector<Record> loadResults(const string &path) {
+    vector<Record> records;
+    ifstream in(path);
+    string line;
+    while (getline(in, line)) {
+        size_t first = line.find('{');
+        if (first == string::npos || line.find("\"program\"") == string::npos) {
+            continue;
+        }
+        line = line.substr(first);
+        while (!line.empty() && (line.back() == ',' || line.back() == ' ' || line.back() == '\r')) {
+            line.pop_back();
+        }
+        Record r;
+        if (parseRecord(line, r)) {
+            records.push_back(r);
+        }
+    }
+    return records;
+}
+
+// Compares every measurement with the baseline run of the same key. Wall time
+// flags a regression when it grows by more than `threshold` percent; so does
+// the instruction count when both runs have one, since it is far less noisy
+// than time on a shared machine. Returns the number of regressions.
+int compareWithBaseline(const vector<Record> &current, const vector<Record> &baseline, double threshold) {
+    map<string, Record> base;
+    for (const Record &r : baseline) {
+        base[r.key] = r;
+    }
+    int regressions = 0;
+    cout << "\n" << left << setw(44) << "benchmark" << right << setw(12) << "base ms" << setw(12) << "now ms"
+         << setw(10) << "time %" << setw(10) << "instr %" << "  verdict\n";
+    for (const Record &r : current) {
+        string name = displayName(r.key);
+        auto it = base.find(r.key);
+        if (it == base.end()) {
+            cout << left << setw(44) << name << right << setw(12) << "-" << setw(12) << fixed << setprecision(1)
+                 << r.wallMs << setw(10) << "-" << setw(10) << "-" << "  new\n";
+            continue;
+        }
+        const Record &b = it->second;
+        double timeChange = b.wallMs > 0 ? (r.wallMs - b.wallMs) / b.wallMs * 100 : 0;
+        bool haveInstructions = r.instructions > 0 && b.instructions > 0;
+        double instrChange = haveInstructions ? (double)(r.instructions - b.instructions) / b.instructions * 100 : 0;
+        string verdict = "ok";
+        if (timeChange > threshold || instrChange > threshold) {
+            verdict = "REGRESSION";
+            regressions++;
+        } else if (timeChange < -threshold) {
+            verdict = "faster";
+        }
+        cout << left << setw(44) << name << right << setw(12) << fixed << setprecision(1) << b.wallMs << setw(12)
+             << r.wallMs << setw(9) << showpos << timeChange << "%" << noshowpos;
+        if (haveInstructions) {
+            cout << setw(9) << showpos << instrChange << "%" << noshowpos;
+        } else {
+            cout << setw(10) << "n/a";
+        }
+        cout << "  " << verdict << "\n";
+    }
+    return regressions;
+}
+
+void usage(const char *self) {
+    cout << "usage: " << self << " [--bin DIR] [--repeat R] [--out FILE] [--baseline FILE] [--threshold PCT]\n"
+         << "       [--only PROGRAM] [--param PROGRAM:key=value ...]\n"
+         << "Runs every program in --bench mode R times (median kept), writes the results as JSON and\n"
+         << "flags regressions against a baseline results file. Exits with 1 on a regression or failure.\n";
+}
+
+int main(int argc, char **argv) {
+    string binDir = ".", outPath = "benchmark_results.json", baselinePath, only;
+    int repeat = 3;
+    double threshold = 10.0;
+    vector<SuiteEntry> suite = defaultSuite();
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--bin" && hasValue) {
+            binDir = argv[++i];
+        } else if (arg == "--repeat" && hasValue) {
+            repeat = max(1, atoi(argv[++i]));
+        } else if (arg == "--out" && hasValue) {
+            outPath = argv[++i];
+        } else if (arg == "--baseline" && hasValue) {
+            baselinePath = argv[++i];
+        } else if (arg == "--threshold" && hasValue) {
+            threshold = atof(argv[++i]);
+        } else if (arg == "--only" && hasValue) {
+            only = argv[++i];
+        } else if (arg == "--param" && hasValue) {
+            // PROGRAM:key=value; a later value of the same key wins in the program.
+            string spec = argv[++i];
+            size_t colon = spec.find(':');
+            bool found = false;
+            for (SuiteEntry &e : suite) {
+                if (colon != string::npos && e.program == spec.substr(0, colon)) {
+                    e.args.push_back(spec.substr(colon + 1));
+                    found = true;
+                }
+            }
+            if (!found) {
+                cout << "Unknown program in --param " << spec << "\n";
+                return 1;
+            }
+        } else {
+            usage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    vector<Record> results;
+    bool failed = false;
+    for (const SuiteEntry &entry : suite) {
+        if (!only.empty() && entry.program != only) {
+            continue;
+        }
+        string path;
+        for (const string &name : entry.candidates) {
+            string candidate = binDir + "/" + name;
+            if (access(candidate.c_str(), X_OK) == 0) {
+                path = candidate;
+                break;
+            }
+        }
+        if (path.empty()) {
+            cout << entry.program << ": no binary in " << binDir << ", skipped\n";
+            continue;
+        }
+
+        map<string, vector<Record>> runs;
+        vector<string> order;
+        for (int rep = 0; rep < repeat; rep++) {
+            bool ok;
+            vector<string> lines = runProgram(path, entry.args, ok);
+            if (!ok) {
+                cout << entry.program << ": run " << rep + 1 << " failed\n";
+                failed = true;
+                break;
+            }
+            for (const string &line : lines) {
+                Record r;
+                if (parseRecord(line, r)) {
+                    if (runs[r.key].empty()) {
+                        order.push_back(r.key);
+                    }
+                    runs[r.key].push_back(r);
+                }
+            }
+        }
+        for (const string &key : order) {
+            Record r = medianRecord(runs[key]);
+            cout << left << setw(44) << displayName(key) << right << fixed
+                 << setprecision(1) << setw(12) << r.wallMs << " ms" << setw(14) << setprecision(4)
+                 << defaultfloat << r.throughput << " /s\n";
+            results.push_back(r);
+        }
+    }
+
+    ofstream out(outPath);
+    out << "{\"results\":[\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        out << results[i].line << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]}\n";
+    out.close();
+    cout << "Wrote " << results.size() << " results to " << outPath << "\n";
+
+    int regressions = 0;
+    if (!baselinePath.empty()) {
+        vector<Record> baseline = loadResults(baselinePath);
+        if (baseline.empty()) {
+            cout << "No results in baseline " << baselinePath << "\n";
+            return 1;
+        }
+        regressions = compareWithBaseline(results, baseline, threshold);
+        cout << regressions << " regression(s) beyond " << threshold << "%\n";
+    }
+    return failed || regressions > 0 ? 1 : 0;
+}
+
+
+/*
+
+This program is the benchmark driver for the six programs of the repository. Each of them has a
+non-interactive mode, `<program> --bench key=value ...`, that skips the menu, runs its workload with
+the given sizes and prints one JSON line per measurement (see `BenchmarkHarness.h`). The driver runs
+them, keeps the median of repeated runs, writes one results file and compares it with an earlier one.
+
+---
+
+### **Usage**
+
+```
+g++ -std=c++17 -O2 -pthread 1_Cannon_MatrixMultiplication.cpp -o bin/1_Cannon_MatrixMultiplication
+...                                  (one binary per program, any of the names in defaultSuite())
+g++ -std=c++17 -O2 BenchmarkDriver.cpp -o bin/BenchmarkDriver
+
+bin/BenchmarkDriver --bin bin --out base.json                 # record a baseline
+bin/BenchmarkDriver --bin bin --out now.json --baseline base.json --threshold 10
+bin/BenchmarkDriver --bin bin --only 1_Cannon --param 1_Cannon:n=512
+```
+
+- `--repeat R` (default 3): every program runs R times; the median wall time is kept, with
+  `wall_ms_min`/`wall_ms_max` recording the spread.
+- `--param PROGRAM:key=value` overrides one size of the default suite.
+- The exit status is 1 if a program fails or a regression is found, so the driver can gate a build.
+
+---
+
+### **What Each Program Measures**
+
+| program | bench | work unit | default parameters |
+|---|---|---|---|
+| 1_Cannon | `cannon`, `naive`, `spgemm`, `summa`, `summa_2_5d` | flops (2n³), partial products | `n=256 sparse_n=2000 density=0.01 threads=1 dist_n=512 workers=16 layers=2` |
+| 2_Lamport | `simulation`, `snapshots` | simulator events, messages | `n=1000 messages=1000 link=2 partitions=1 snap_n=200 snap_messages=20000 ledger_kb=256 interval_us=2000` |
+| 3_DIN | `meals` | meals | `meals=2000 eat_us=0 hold_us=0 think_us=0` |
+| 4_RING | `election`, `chang_roberts` | messages, events | `n=100000 elections=50 sim_n=20000` |
+| 5_BULLY | `election`, `simulated` | messages, events | `n=8000 threads=1 sim_n=1000` |
+| 6_hadoop | `word_count`, `engine_word_count` | input bytes | `mb=64 vocab=100000 skew=1 threads=4 combiner=65536` |
+
+Every program also checks its own result (Cannon against the triple loop, SpGEMM against `A (B x)`, the snapshots, the elected leaders, the
+engine's word count against the hand-written one) and exits non-zero if it is wrong, which the driver
+reports as a failure.
+
+---
+
+### **Results File**
+
+```
+{"results":[
+{"program":"1_Cannon","bench":"cannon","params":{"n":256},"wall_ms":42.994,"work":33554432,"unit":"flops",
+ "throughput":7.80447e+08,"cycles":null,"instructions":null,"cache_misses":null,"branch_misses":null,
+ "runs":3,"wall_ms_min":41.870,"wall_ms_max":44.120},
+...
+]}
+```
+
+One measurement per line, so the comparison needs no JSON library: the driver reads the fields of each
+line with `jsonField()`. A measurement is identified by program, bench and the full parameter object,
+so results taken with different sizes are never compared with each other.
+
+---
+
+### **Regression Check**
+
+- Wall time more than `--threshold` percent above the baseline is a regression; more than that below
+  is reported as `faster`.
+- When both runs have hardware counters, an instruction count more than `--threshold` percent higher is
+  also a regression. Instructions retired hardly vary between runs, so they catch a slower code path
+  that timing noise on a shared machine would hide.
+- Counters are `null` where `perf_event_open` has no hardware events (containers, VMs without a PMU,
+  `perf_event_paranoid` above 2); the check then falls back to wall time alone.
+
+---
+
+*/
@@ -0,0 +1,227 @@
+#ifndef BENCHMARK_HARNESS_H
+#define BENCHMARK_HARNESS_H
+
+// Non-interactive benchmark mode shared by all six programs. Started as
+//
+//     <program> --bench [key=value ...]
+//
+// a program skips its menu, runs its workload with the given sizes and prints
+// one JSON object per measurement on stdout, e.g.
+//
+//     {"program":"4_RING","bench":"election","params":{"n":100000},
+//      "wall_ms":12.5,"work":200000,"unit":"messages","throughput":1.6e7,
+//      "cycles":null,"instructions":null,"cache_misses":null,"branch_misses":null}
+//
+// Hardware counters come from perf_event_open and are null where the kernel
+// or the machine does not provide them (containers, VMs without a PMU,
+// perf_event_paranoid > 2). BenchmarkDriver.cpp runs the programs, keeps the
+// median of repeated runs and compares them against a saved baseline.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Cycles, instructions, cache misses and branch misses of the calling thread
+// and the threads it creates after the constructor ran: the counters are
+// inherited by new threads only, so threads that already exist (e.g. a pool
+// built earlier) are not counted. Each counter is opened on its own, so a
+// machine that lacks one still reports the others; counters that were
+// multiplexed are scaled by enabled/running time.
+class PerfCounters {
+public:
+    static const int COUNT = 4;
+
+    PerfCounters() {
+#ifdef __linux__
+        static const uint64_t configs[COUNT] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                 PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+        for (int i = 0; i < COUNT; i++) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+#else
+        for (int i = 0; i < COUNT; i++) {
+            fds[i] = -1;
+        }
+#endif
+    }
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int i = 0; i < COUNT; i++) {
+            if (fds[i] >= 0) {
+                close(fds[i]);
+            }
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    void start() {
+#ifdef __linux__
+        for (int i = 0; i < COUNT; i++) {
+            if (fds[i] >= 0) {
+                ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    // Stops counting and stores the totals; a counter that could not be
+    // opened or never ran reads as -1.
+    void stop() {
+        for (int i = 0; i < COUNT; i++) {
+            values[i] = -1;
+#ifdef __linux__
+            if (fds[i] < 0) {
+                continue;
+            }
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t raw[3];
+            if (read(fds[i], raw, sizeof(raw)) == (ssize_t)sizeof(raw) && raw[2] > 0) {
+                values[i] = (long long)((double)raw[0] * raw[1] / raw[2]);
+            }
+#endif
+        }
+    }
+
+    long long value(int i) const { return values[i]; }
+
+    static const char *name(int i) {
+        static const char *names[COUNT] = { "cycles", "instructions", "cache_misses", "branch_misses" };
+        return names[i];
+    }
+
+private:
+    int fds[COUNT];
+    long long values[COUNT] = { -1, -1, -1, -1 };
+};
+
+// The key=value arguments after --bench. Lookups of absent keys return the
+// default and record it, so the JSON lists every parameter the run used.
+class BenchmarkParams {
+public:
+    BenchmarkParams(int argc, char **argv, int first) {
+        for (int i = first; i < argc; i++) {
+            std::string arg = argv[i];
+            size_t eq = arg.find('=');
+            if (eq == std::string::npos) {
+                std::cerr << "ignoring benchmark argument " << arg << " (expected key=value)\n";
+                continue;
+            }
+            given[arg.substr(0, eq)] = arg.substr(eq + 1);
+        }
+    }
+
+    long long integer(const std::string &key, long long fallback) {
+        auto it = given.find(key);
+        long long v = it == given.end() ? fallback : std::atoll(it->second.c_str());
+        used[key] = std::to_string(v);
+        return v;
+    }
+
+    double real(const std::string &key, double fallback) {
+        auto it = given.find(key);
+        double v = it == given.end() ? fallback : std::atof(it->second.c_str());
+        std::ostringstream s;
+        s << v;
+        used[key] = s.str();
+        return v;
+    }
+
+    std::string text(const std::string &key, const std::string &fallback) {
+        auto it = given.find(key);
+        std::string v = it == given.end() ? fallback : it->second;
+        used[key] = quote(v);
+        return v;
+    }
+
+    // The parameters read so far as a JSON object, keys in sorted order.
+    std::string json() const {
+        std::string s = "{";
+        for (auto &kv : used) {
+            if (s.size() > 1) {
+                s += ",";
+            }
+            s += quote(kv.first) + ":" + kv.second;
+        }
+        return s + "}";
+    }
+
+    static std::string quote(const std::string &v) {
+        std::string s = "\"";
+        for (char c : v) {
+            if (c == '"' || c == '\\') {
+                s += '\\';
+            }
+            s += c;
+        }
+        return s + "\"";
+    }
+
+private:
+    std::map<std::string, std::string> given;
+    std::map<std::string, std::string> used;
+};
+
+// True if the program was started with --bench as its first argument.
+inline bool benchmarkRequested(int argc, char **argv) {
+    return argc > 1 && std::strcmp(argv[1], "--bench") == 0;
+}
+
+// Runs fn once under the wall clock and the hardware counters and prints the
+// JSON line. fn returns the amount of work it did in `unit`s (messages,
+// bytes, flops...), which gives the throughput. The counters are opened just
+// before fn runs, so fn must start any worker threads it uses itself.
+inline void runBenchmark(const std::string &program, const std::string &bench, const BenchmarkParams &params,
+                         const std::string &unit, const std::function<long long()> &fn) {
+    PerfCounters counters;
+    counters.start();
+    auto start = std::chrono::steady_clock::now();
+    long long work = fn();
+    double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    counters.stop();
+
+    char number[64];
+    std::string line = "{\"program\":" + BenchmarkParams::quote(program) + ",\"bench\":" +
+                       BenchmarkParams::quote(bench) + ",\"params\":" + params.json();
+    std::snprintf(number, sizeof(number), "%.3f", wallMs);
+    line += std::string(",\"wall_ms\":") + number + ",\"work\":" + std::to_string(work) +
+            ",\"unit\":" + BenchmarkParams::quote(unit);
+    std::snprintf(number, sizeof(number), "%.6g", wallMs > 0 ? work / wallMs * 1000 : 0.0);
+    line += std::string(",\"throughput\":") + number;
+    for (int i = 0; i < PerfCounters::COUNT; i++) {
+        long long v = counters.value(i);
+        line += std::string(",\"") + PerfCounters::name(i) + "\":" + (v < 0 ? "null" : std::to_string(v));
+    }
+    std::cout << line << "}" << std::endl;
+}
+
+#endif
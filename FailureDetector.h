@@ -0,0 +1,461 @@
+#ifndef FAILURE_DETECTOR_H
+#define FAILURE_DETECTOR_H
+
+// Heartbeat failure detection and leader leases on an in-process simulated
+// network. Shared by the Ring (4_RING.cpp) and Bully (5_BULLY.cpp) programs so
+// an election can start when the leader is suspected instead of when someone
+// types in an initiator.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Hierarchical timer wheel with one-millisecond ticks: four levels of 256
+// slots cover 2^32 ms. A timer sits on the coarsest level that can still tell
+// its slot apart and is cascaded one level down each time the finer level
+// wraps, so scheduling and expiry are O(1) per timer.
+class HierarchicalTimerWheel {
+public:
+    struct Entry {
+        long long deadline;
+        int target;
+        int kind;
+        long long data;
+    };
+
+    HierarchicalTimerWheel() : now(0), count(0) {}
+
+    long long time() const { return now; }
+    size_t size() const { return count; }
+
+    void schedule(Entry e) {
+        if (e.deadline <= now) {
+            e.deadline = now + 1;
+        }
+        place(e);
+        count++;
+    }
+
+    // Advances one tick and moves every timer due at the new time into `due`.
+    void advance(std::vector<Entry> &due) {
+        now++;
+        for (int level = LEVELS - 1; level >= 1; level--) {
+            long long span = 1LL << (BITS * level);
+            if ((now & (span - 1)) == 0) {
+                std::vector<Entry> moving;
+                moving.swap(slots[level][(now >> (BITS * level)) & (SLOTS - 1)]);
+                for (const Entry &e : moving) {
+                    place(e);
+                }
+            }
+        }
+        std::vector<Entry> &slot = slots[0][now & (SLOTS - 1)];
+        count -= slot.size();
+        due.insert(due.end(), slot.begin(), slot.end());
+        slot.clear();
+    }
+
+private:
+    static const int LEVELS = 4;
+    static const int BITS = 8;
+    static const int SLOTS = 1 << BITS;
+
+    void place(const Entry &e) {
+        long long delta = e.deadline - now;
+        int level = 0;
+        while (level < LEVELS - 1 && delta >= (1LL << (BITS * (level + 1)))) {
+            level++;
+        }
+        slots[level][(e.deadline >> (BITS * level)) & (SLOTS - 1)].push_back(e);
+    }
+
+    std::vector<Entry> slots[LEVELS][SLOTS];
+    long long now;
+    size_t count;
+};
+
+// Lease held by the leader. Every heartbeat the monitor receives from the
+// leader extends the lease to `durationMs` after the heartbeat was sent. The
+// leader stops acting as leader `driftMs` before the lease runs out and the
+// others only take over `driftMs` after it, which covers clock drift.
+struct LeaderLease {
+    long long durationMs;
+    long long driftMs;
+    long long expiresAtMs;
+
+    LeaderLease(long long durationMs = 0, long long driftMs = 0)
+        : durationMs(durationMs), driftMs(driftMs), expiresAtMs(-1) {}
+
+    void renew(long long sentAtMs) { expiresAtMs = std::max(expiresAtMs, sentAtMs + durationMs); }
+    bool heldBy(long long nowMs) const { return nowMs < expiresAtMs - driftMs; }
+    long long safeTakeoverMs() const { return expiresAtMs + driftMs; }
+};
+
+// Every node sends a heartbeat each intervalMs; a heartbeat is lost with
+// probability lossRate and otherwise takes baseDelayMs plus an exponentially
+// distributed delay with mean tailDelayMs.
+struct HeartbeatNetwork {
+    int nodes;
+    int intervalMs;
+    double baseDelayMs;
+    double tailDelayMs;
+    double lossRate;
+};
+
+enum DetectorKind { FIXED_TIMEOUT, PHI_ACCRUAL };
+
+// FIXED_TIMEOUT suspects a node timeoutMs after its last heartbeat.
+// PHI_ACCRUAL suspects it once phi = -log10(P(next heartbeat is this late))
+// reaches phiThreshold, with the inter-arrival times modelled as a normal
+// distribution whose mean and variance are exponentially weighted over about
+// `window` heartbeats.
+struct DetectorConfig {
+    DetectorKind kind;
+    double timeoutMs;
+    double phiThreshold;
+    int window;
+};
+
+struct DetectorStats {
+    long long heartbeatsSent;
+    long long heartbeatsLost;
+    long long heartbeatsCoalesced;  // second heartbeat of a node in the same tick
+    long long batches;              // per-tick arrival batches processed
+    long long crashesDetected;
+    long long falsePositives;
+    double meanDetectionMs;
+    double p99DetectionMs;
+    double falsePositivesPerNodeHour;
+    double wallMs;
+};
+
+// One monitor watching every node. Heartbeats are batched: all nodes in the
+// same send phase go out as one timer entry, and the heartbeats of a batch
+// that arrive in the same tick travel as one arrival entry. Each node has at
+// most one suspicion check in the wheel; a heartbeat only moves the node's
+// deadline and the check reschedules itself when it fires early, so 100k nodes
+// cost one check per node per timeout period rather than one per heartbeat.
+class HeartbeatMonitor {
+public:
+    typedef std::function<void(int node, long long nowMs)> SuspectCallback;
+
+    HeartbeatMonitor(const HeartbeatNetwork &net, const DetectorConfig &cfg, uint64_t seed)
+        : net(net), cfg(cfg), rng(seed), nodes(net.nodes) {
+        phiZ = cfg.kind == PHI_ACCRUAL ? tailQuantile(std::pow(10.0, -cfg.phiThreshold)) : 0.0;
+        alpha = 1.0 / std::max(cfg.window, 1);
+        for (NodeState &s : nodes) {
+            s.meanMs = net.intervalMs;
+            s.varMs = (net.intervalMs / 4.0) * (net.intervalMs / 4.0);
+        }
+        for (int phase = 0; phase < net.intervalMs; phase++) {
+            wheel.schedule({ phase + 1, phase, SEND_BATCH, 0 });
+        }
+    }
+
+    // The node stops sending heartbeats at the given time.
+    void crash(int node, long long atMs) { nodes[node].crashAtMs = atMs; }
+
+    // The leader's heartbeats renew this lease.
+    void trackLease(int leader, LeaderLease *lease) {
+        leaseHolder = leader;
+        this->lease = lease;
+    }
+
+    long long now() const { return wheel.time(); }
+
+    // Runs the simulation until untilMs. onSuspect is called when a node is
+    // newly suspected, whether it really crashed or not.
+    void run(long long untilMs, const SuspectCallback &onSuspect = SuspectCallback()) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<HierarchicalTimerWheel::Entry> due;
+        while (wheel.time() < untilMs) {
+            due.clear();
+            wheel.advance(due);
+            long long t = wheel.time();
+            for (const HierarchicalTimerWheel::Entry &e : due) {
+                if (e.kind == SEND_BATCH) {
+                    sendBatch(e.target, t);
+                } else if (e.kind == ARRIVAL_BATCH) {
+                    arrivalBatch(e.target, t);
+                } else {
+                    check(e.target, t, onSuspect);
+                }
+            }
+        }
+        wallMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    DetectorStats stats() const {
+        DetectorStats s = { sent, lost, coalesced, batches, (long long)detections.size(), falsePositives,
+                            0.0, 0.0, 0.0, wallMs };
+        if (!detections.empty()) {
+            std::vector<long long> sorted = detections;
+            std::sort(sorted.begin(), sorted.end());
+            double sum = 0;
+            for (long long d : sorted) {
+                sum += d;
+            }
+            s.meanDetectionMs = sum / sorted.size();
+            s.p99DetectionMs = sorted[(sorted.size() - 1) * 99 / 100];
+        }
+        double nodeHours = 0;
+        for (const NodeState &n : nodes) {
+            long long upMs = std::min(n.crashAtMs, wheel.time());
+            nodeHours += upMs / 3600000.0;
+        }
+        s.falsePositivesPerNodeHour = nodeHours > 0 ? falsePositives / nodeHours : 0.0;
+        return s;
+    }
+
+private:
+    enum EntryKind { SEND_BATCH, ARRIVAL_BATCH, CHECK };
+
+    struct NodeState {
+        long long crashAtMs = (1LL << 62);
+        long long lastArrivalMs = -1;
+        long long deadlineMs = 0;
+        double meanMs = 0, varMs = 0;
+        bool checkPending = false;
+        bool suspected = false;
+        bool detected = false;
+    };
+
+    struct Heartbeat {
+        int node;
+        long long sentMs;
+    };
+
+    // z such that P(Z > z) = p for a standard normal Z, by bisection.
+    static double tailQuantile(double p) {
+        double lo = -10.0, hi = 40.0;
+        for (int i = 0; i < 200; i++) {
+            double mid = (lo + hi) / 2;
+            if (0.5 * std::erfc(mid / std::sqrt(2.0)) > p) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    double uniform() { return (rng() >> 11) * (1.0 / 9007199254740992.0); }
+
+    int newBatch() {
+        if (!freeBatches.empty()) {
+            int id = freeBatches.back();
+            freeBatches.pop_back();
+            return id;
+        }
+        batchPool.emplace_back();
+        return batchPool.size() - 1;
+    }
+
+    void sendBatch(int phase, long long t) {
+        offsetBatch.assign(offsetBatch.size(), -1);
+        for (int node = phase; node < net.nodes; node += net.intervalMs) {
+            if (t >= nodes[node].crashAtMs) {
+                continue;
+            }
+            sent++;
+            if (uniform() < net.lossRate) {
+                lost++;
+                continue;
+            }
+            long long delay = std::max(1LL, (long long)std::llround(net.baseDelayMs - net.tailDelayMs *
+                                                                   std::log(1.0 - uniform())));
+            if ((size_t)delay >= offsetBatch.size()) {
+                offsetBatch.resize(delay + 1, -1);
+            }
+            if (offsetBatch[delay] < 0) {
+                offsetBatch[delay] = newBatch();
+                wheel.schedule({ t + delay, offsetBatch[delay], ARRIVAL_BATCH, 0 });
+            }
+            batchPool[offsetBatch[delay]].push_back({ node, t });
+        }
+        wheel.schedule({ t + net.intervalMs, phase, SEND_BATCH, 0 });
+    }
+
+    void arrivalBatch(int id, long long t) {
+        batches++;
+        for (const Heartbeat &hb : batchPool[id]) {
+            NodeState &s = nodes[hb.node];
+            if (hb.node == leaseHolder && lease) {
+                lease->renew(hb.sentMs);
+            }
+            if (s.lastArrivalMs == t) {
+                coalesced++;
+                continue;
+            }
+            if (s.lastArrivalMs >= 0) {
+                double gap = t - s.lastArrivalMs;
+                double diff = gap - s.meanMs;
+                s.meanMs += alpha * diff;
+                s.varMs = (1 - alpha) * (s.varMs + alpha * diff * diff);
+            }
+            s.lastArrivalMs = t;
+            s.suspected = false;
+            if (cfg.kind == FIXED_TIMEOUT) {
+                s.deadlineMs = t + (long long)cfg.timeoutMs;
+            } else {
+                double sd = std::max(std::sqrt(s.varMs), net.intervalMs / 10.0);
+                s.deadlineMs = t + (long long)std::ceil(s.meanMs + phiZ * sd);
+            }
+            if (!s.checkPending) {
+                s.checkPending = true;
+                wheel.schedule({ s.deadlineMs, hb.node, CHECK, 0 });
+            }
+        }
+        batchPool[id].clear();
+        freeBatches.push_back(id);
+    }
+
+    void check(int node, long long t, const SuspectCallback &onSuspect) {
+        NodeState &s = nodes[node];
+        if (s.deadlineMs > t) {
+            wheel.schedule({ s.deadlineMs, node, CHECK, 0 });  // heard from it since
+            return;
+        }
+        s.checkPending = false;
+        if (s.suspected) {
+            return;
+        }
+        s.suspected = true;
+        if (t >= s.crashAtMs) {
+            if (s.detected) {
+                return;  // a heartbeat sent before the crash arrived late
+            }
+            s.detected = true;
+            detections.push_back(t - s.crashAtMs);
+        } else {
+            falsePositives++;
+        }
+        if (onSuspect) {
+            onSuspect(node, t);
+        }
+    }
+
+    HeartbeatNetwork net;
+    DetectorConfig cfg;
+    std::mt19937_64 rng;
+    std::vector<NodeState> nodes;
+    HierarchicalTimerWheel wheel;
+    std::vector<std::vector<Heartbeat>> batchPool;
+    std::vector<int> freeBatches;
+    std::vector<int> offsetBatch;
+    double phiZ = 0.0;
+    double alpha = 0.0;
+    int leaseHolder = -1;
+    LeaderLease *lease = nullptr;
+    long long sent = 0, lost = 0, coalesced = 0, batches = 0, falsePositives = 0;
+    std::vector<long long> detections;
+    double wallMs = 0.0;
+};
+
+// How the others replaced the leader, decided only from what they observe.
+struct LeaderTakeover {
+    long long suspectedAtMs;  // suspicion that led to the takeover, -1 if none
+    long long takeoverAtMs;   // -1 if the leader was never replaced
+    int postponed;            // suspicions that came before the lease had safely run out
+    int dropped;              // postponed suspicions cleared because the lease was renewed
+};
+
+// Runs the monitor until the others may replace `leader` or untilMs passes. A
+// suspicion before the lease has safely run out is rechecked at
+// safeTakeoverMs(): if a heartbeat renewed the lease meanwhile the leader is
+// still alive and the suspicion is dropped, otherwise the others take over.
+// The monitor reports a suspicion only once, so one that comes while a recheck
+// is pending is kept and postponed again if the first one is dropped.
+inline LeaderTakeover awaitLeaderTakeover(HeartbeatMonitor &monitor, const LeaderLease &lease, int leader,
+                                          long long untilMs) {
+    LeaderTakeover r = { -1, -1, 0, 0 };
+    long long recheckAt = -1, nextSuspicion = -1;
+    auto suspect = [&](long long t) {
+        r.suspectedAtMs = t;
+        if (t < lease.safeTakeoverMs()) {
+            r.postponed++;
+            recheckAt = lease.safeTakeoverMs();
+        } else {
+            r.takeoverAtMs = t;
+        }
+    };
+    while (r.takeoverAtMs < 0 && monitor.now() < untilMs) {
+        long long step = monitor.now() + 10;
+        monitor.run(recheckAt >= 0 ? std::min(step, recheckAt) : step, [&](int node, long long t) {
+            if (node != leader || r.takeoverAtMs >= 0) {
+                return;
+            }
+            if (recheckAt >= 0) {
+                nextSuspicion = t;
+            } else {
+                suspect(t);
+            }
+        });
+        if (recheckAt >= 0 && monitor.now() >= recheckAt) {
+            if (lease.safeTakeoverMs() > recheckAt) {
+                r.dropped++;
+                r.suspectedAtMs = -1;
+                recheckAt = -1;
+                if (nextSuspicion >= 0) {
+                    suspect(nextSuspicion);
+                }
+            } else {
+                r.takeoverAtMs = recheckAt;
+                recheckAt = -1;
+            }
+            nextSuspicion = -1;
+        }
+    }
+    return r;
+}
+
+// Sweeps both detectors over a range of settings on the same network: a
+// fraction of the nodes crash at random times and the monitor runs for
+// durationMs. Prints detection latency against the false-positive rate.
+inline void benchmarkFailureDetectors(const HeartbeatNetwork &net, long long durationMs, double crashFraction,
+                                      uint64_t seed) {
+    std::vector<DetectorConfig> configs;
+    const double timeouts[] = { 1.5, 2.0, 3.0, 5.0, 10.0 };
+    const double phis[] = { 1.0, 2.0, 4.0, 8.0, 12.0 };
+    for (double k : timeouts) {
+        configs.push_back({ FIXED_TIMEOUT, k * net.intervalMs, 0.0, 0 });
+    }
+    for (double phi : phis) {
+        configs.push_back({ PHI_ACCRUAL, 0.0, phi, 100 });
+    }
+
+    std::cout << "\n" << net.nodes << " nodes, heartbeat every " << net.intervalMs << " ms, delay "
+              << net.baseDelayMs << " ms + exp(" << net.tailDelayMs << " ms), loss " << net.lossRate * 100
+              << "%, " << durationMs / 1000.0 << " s simulated\n";
+    std::cout << std::setw(14) << "detector" << std::setw(10) << "setting" << std::setw(12) << "mean det ms"
+              << std::setw(12) << "p99 det ms" << std::setw(10) << "detected" << std::setw(8) << "FPs"
+              << std::setw(14) << "FP/node-hour" << std::setw(12) << "wall ms" << std::setw(14) << "Mhb/sec"
+              << "\n";
+
+    for (const DetectorConfig &cfg : configs) {
+        HeartbeatMonitor monitor(net, cfg, seed);
+        std::mt19937_64 crashes(seed + 1);
+        int crashCount = (int)(net.nodes * crashFraction);
+        for (int i = 0; i < crashCount; i++) {
+            long long at = durationMs / 4 + crashes() % std::max(1LL, durationMs / 2);
+            monitor.crash(crashes() % net.nodes, at);
+        }
+        monitor.run(durationMs);
+        DetectorStats s = monitor.stats();
+        std::cout << std::setw(14) << (cfg.kind == FIXED_TIMEOUT ? "fixed timeout" : "phi accrual")
+                  << std::setw(10) << std::fixed << std::setprecision(1)
+                  << (cfg.kind == FIXED_TIMEOUT ? cfg.timeoutMs : cfg.phiThreshold) << std::setw(12)
+                  << s.meanDetectionMs << std::setw(12) << s.p99DetectionMs << std::setw(10) << s.crashesDetected
+                  << std::setw(8) << s.falsePositives << std::setw(14) << std::setprecision(4)
+                  << s.falsePositivesPerNodeHour << std::setw(12) << std::setprecision(1) << s.wallMs
+                  << std::setw(14) << std::setprecision(2) << s.heartbeatsSent / s.wallMs / 1000 << "\n";
+    }
+}
+
+#endif
@@ -0,0 +1,348 @@
+#ifndef FLAT_STRING_MAP_H
+#define FLAT_STRING_MAP_H
+
+// Open-addressing hash map from strings to counts, used by the MapReduce word
+// count (6_hadoop cpp.cpp) for the combiner and the reducers. The value type is
+// a template parameter (BasicFlatStringMap<Value>) so the generic MapReduce
+// engine can aggregate other values with string keys; FlatStringMap is the
+// int instantiation. Slots live in one
+// flat array with a control byte each, probed sixteen at a time with SSE2.
+// Keys of up to 16 bytes are stored inside the slot; longer keys are copied
+// once into an arena owned by the map. Every slot keeps the full hash, so
+// growing never rehashes a string and a lookup compares strings only when the
+// hashes are equal. There is no ordering; sortedItems() sorts on request.
+//
+// A map built with borrowKeys = true copies nothing: it keeps views of the
+// keys it is given, which must outlive it (e.g. tokens of a memory-mapped
+// file).
+//
+// A value is default-constructed when its key is inserted, so for the generic
+// engine Value() must be the identity of the job's combiner.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// 64-bit hash of a byte string, eight bytes per step. Short tails are read
+// with fixed-size (possibly overlapping) loads instead of a byte loop.
+inline uint64_t hashBytes(const char *data, size_t length) {
+    const uint64_t K = 0x9E3779B97F4A7C15ULL;
+    uint64_t h = length * K;
+    uint64_t word;
+    if (length >= 8) {
+        size_t i = 0;
+        for (; i + 8 < length; i += 8) {
+            std::memcpy(&word, data + i, 8);
+            h = (h ^ word) * K;
+            h ^= h >> 29;
+        }
+        std::memcpy(&word, data + length - 8, 8);
+    } else if (length >= 4) {
+        uint32_t lo, hi;
+        std::memcpy(&lo, data, 4);
+        std::memcpy(&hi, data + length - 4, 4);
+        word = lo | (uint64_t)hi << 32;
+    } else {
+        word = length == 0 ? 0
+                           : (uint8_t)data[0] | (uint64_t)(uint8_t)data[length / 2] << 8 |
+                                 (uint64_t)(uint8_t)data[length - 1] << 16;
+    }
+    h = (h ^ word) * K;
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    return h ^ (h >> 32);
+}
+
+inline uint64_t hashBytes(std::string_view key) { return hashBytes(key.data(), key.size()); }
+
+// Append-only storage for key bytes. Blocks are never moved, so views into
+// them stay valid until the arena is cleared or destroyed.
+class StringArena {
+public:
+    const char *store(std::string_view s) {
+        if (s.size() > BLOCK) {
+            big.emplace_back(new char[s.size()]);
+            std::memcpy(big.back().get(), s.data(), s.size());
+            return big.back().get();
+        }
+        if (blocks.empty() || used + s.size() > BLOCK) {
+            blocks.emplace_back(new char[BLOCK]);
+            used = 0;
+        }
+        char *p = blocks.back().get() + used;
+        std::memcpy(p, s.data(), s.size());
+        used += s.size();
+        return p;
+    }
+
+    void clear() {
+        blocks.clear();
+        big.clear();
+        used = 0;
+    }
+
+    size_t bytes() const { return blocks.size() * BLOCK; }
+
+private:
+    static constexpr size_t BLOCK = 1 << 16;
+    std::vector<std::unique_ptr<char[]>> blocks, big;
+    size_t used = 0;
+};
+
+template <typename Value>
+class BasicFlatStringMap {
+public:
+    explicit BasicFlatStringMap(size_t expected = 0, bool borrowKeys = false) : borrowKeys(borrowKeys) {
+        reset(capacityFor(expected));
+    }
+
+    BasicFlatStringMap(BasicFlatStringMap &&) = default;
+    BasicFlatStringMap &operator=(BasicFlatStringMap &&) = default;
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // Adds `delta` to the count of `key`, inserting it with `delta` if absent,
+    // and returns the new count. `hash` must be hashBytes(key); callers that
+    // already hashed the key for partitioning pass it on instead of hashing
+    // twice.
+    Value add(std::string_view key, uint64_t hash, Value delta) {
+        return valueFor(key, hash) += delta;
+    }
+
+    Value add(std::string_view key, Value delta = 1) { return add(key, hashBytes(key), delta); }
+
+    // Returns the value of `key`, inserting Value() if absent. The reference
+    // is valid until the next insertion.
+    Value &valueFor(std::string_view key, uint64_t hash) {
+        if ((count + 1) * 8 > capacity * 7) {
+            reset(capacity * 2);
+        }
+        return slots[findOrInsert(key, hash)].value;
+    }
+
+    // Returns a pointer to the value of `key`, or nullptr.
+    const Value *find(std::string_view key) const {
+        uint64_t hash = hashBytes(key);
+        size_t groups = capacity / GROUP;
+        size_t g = (hash >> 7) & (groups - 1);
+        uint8_t tag = hash & 0x7F;
+        for (size_t step = 1; ; step++) {
+            const uint8_t *ctrl = control.data() + g * GROUP;
+            for (uint32_t bits = matchTag(ctrl, tag); bits; bits &= bits - 1) {
+                const Slot &s = slots[g * GROUP + __builtin_ctz(bits)];
+                if (s.hash == hash && keyOf(s) == key) {
+                    return &s.value;
+                }
+            }
+            if (matchEmpty(ctrl)) {
+                return nullptr;
+            }
+            g = (g + step) & (groups - 1);
+        }
+    }
+
+    // Calls fn(key, count) for every entry in slot order.
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        for (size_t i = 0; i < capacity; i++) {
+            if (control[i] != EMPTY) {
+                fn(keyOf(slots[i]), slots[i].value);
+            }
+        }
+    }
+
+    // Calls fn(key, hash, value) for every entry in slot order. On a mutable
+    // map the value is passed by reference, so fn may move it out before a
+    // clear().
+    template <typename Fn>
+    void forEachHashed(Fn fn) const {
+        for (size_t i = 0; i < capacity; i++) {
+            if (control[i] != EMPTY) {
+                fn(keyOf(slots[i]), slots[i].hash, slots[i].value);
+            }
+        }
+    }
+
+    template <typename Fn>
+    void forEachHashed(Fn fn) {
+        for (size_t i = 0; i < capacity; i++) {
+            if (control[i] != EMPTY) {
+                fn(keyOf(slots[i]), slots[i].hash, slots[i].value);
+            }
+        }
+    }
+
+    // The entries sorted by key. The views point into this map.
+    std::vector<std::pair<std::string_view, Value>> sortedItems() const {
+        std::vector<std::pair<std::string_view, Value>> items;
+        items.reserve(count);
+        forEach([&](std::string_view key, const Value &value) { items.emplace_back(key, value); });
+        std::sort(items.begin(), items.end(),
+                  [](const std::pair<std::string_view, Value> &a, const std::pair<std::string_view, Value> &b) {
+                      return a.first < b.first;
+                  });
+        return items;
+    }
+
+    // Empties the map but keeps its capacity. Values that own memory are
+    // released now rather than when their slot is reused.
+    void clear() {
+        if (!std::is_trivially_destructible<Value>::value) {
+            for (size_t i = 0; i < capacity; i++) {
+                if (control[i] != EMPTY) {
+                    slots[i].value = Value();
+                }
+            }
+        }
+        std::fill(control.begin(), control.end(), EMPTY);
+        arena.clear();
+        count = 0;
+    }
+
+    size_t memoryBytes() const { return capacity * (sizeof(Slot) + 1) + arena.bytes(); }
+
+    // True if the next insertion of a new key doubles the table.
+    bool atCapacity() const { return (count + 1) * 8 > capacity * 7; }
+
+private:
+    static constexpr size_t GROUP = 16;
+    static constexpr uint8_t EMPTY = 0x80;
+    static constexpr size_t INLINE = 16;
+
+    // 32 bytes with int values: two slots per cache line.
+    struct Slot {
+        uint64_t hash;
+        Value value;
+        uint32_t length;
+        union {
+            char inlineKey[INLINE];
+            const char *external;  // arena copy of a key longer than INLINE
+        };
+    };
+
+    static size_t capacityFor(size_t expected) {
+        size_t c = GROUP;
+        while (c * 7 < expected * 8) {
+            c *= 2;
+        }
+        return c;
+    }
+
+    std::string_view keyOf(const Slot &s) const {
+        return std::string_view(s.length <= INLINE && !borrowKeys ? s.inlineKey : s.external, s.length);
+    }
+
+    // Bit i is set if control byte i of the group equals `tag`.
+    static uint32_t matchTag(const uint8_t *ctrl, uint8_t tag) {
+#ifdef __SSE2__
+        __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(tag)));
+#else
+        uint32_t bits = 0;
+        for (size_t i = 0; i < GROUP; i++) {
+            bits |= uint32_t(ctrl[i] == tag) << i;
+        }
+        return bits;
+#endif
+    }
+
+    // Empty slots have the high bit set, so movemask finds them directly.
+    static uint32_t matchEmpty(const uint8_t *ctrl) {
+#ifdef __SSE2__
+        return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl)));
+#else
+        uint32_t bits = 0;
+        for (size_t i = 0; i < GROUP; i++) {
+            bits |= uint32_t(ctrl[i] == EMPTY) << i;
+        }
+        return bits;
+#endif
+    }
+
+    // Groups are probed with triangular steps, which visit every group of a
+    // power-of-two table. Nothing is ever erased, so the first empty slot on
+    // the probe path ends the search.
+    size_t findOrInsert(std::string_view key, uint64_t hash) {
+        size_t groups = capacity / GROUP;
+        size_t g = (hash >> 7) & (groups - 1);
+        uint8_t tag = hash & 0x7F;
+        for (size_t step = 1; ; step++) {
+            uint8_t *ctrl = control.data() + g * GROUP;
+            for (uint32_t bits = matchTag(ctrl, tag); bits; bits &= bits - 1) {
+                size_t i = g * GROUP + __builtin_ctz(bits);
+                if (slots[i].hash == hash && keyOf(slots[i]) == key) {
+                    return i;
+                }
+            }
+            uint32_t empty = matchEmpty(ctrl);
+            if (empty) {
+                size_t i = g * GROUP + __builtin_ctz(empty);
+                ctrl[i - g * GROUP] = tag;
+                Slot &s = slots[i];
+                s.hash = hash;
+                s.value = Value();
+                s.length = key.size();
+                if (borrowKeys) {
+                    s.external = key.data();
+                } else if (key.size() <= INLINE) {
+                    std::memcpy(s.inlineKey, key.data(), key.size());
+                } else {
+                    s.external = arena.store(key);
+                }
+                count++;
+                return i;
+            }
+            g = (g + step) & (groups - 1);
+        }
+    }
+
+    // Moves every entry into a table of `newCapacity` slots. Long keys stay
+    // where they are in the arena.
+    void reset(size_t newCapacity) {
+        std::vector<uint8_t> oldControl(newCapacity, EMPTY);
+        std::unique_ptr<Slot[]> oldSlots(new Slot[newCapacity]);
+        oldControl.swap(control);  // control and slots are now the new, empty table
+        oldSlots.swap(slots);
+        size_t oldCapacity = capacity;
+        capacity = newCapacity;
+        size_t groups = capacity / GROUP;
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (oldControl[i] == EMPTY) {
+                continue;
+            }
+            Slot &s = oldSlots[i];
+            size_t g = (s.hash >> 7) & (groups - 1);
+            for (size_t step = 1; ; step++) {
+                uint32_t empty = matchEmpty(control.data() + g * GROUP);
+                if (empty) {
+                    size_t j = g * GROUP + __builtin_ctz(empty);
+                    control[j] = s.hash & 0x7F;
+                    slots[j] = std::move(oldSlots[i]);
+                    break;
+                }
+                g = (g + step) & (groups - 1);
+            }
+        }
+    }
+
+    std::vector<uint8_t> control;
+    std::unique_ptr<Slot[]> slots;
+    size_t capacity = 0;
+    size_t count = 0;
+    bool borrowKeys;
+    StringArena arena;
+};
+
+typedef BasicFlatStringMap<int> FlatStringMap;
+
+#endif
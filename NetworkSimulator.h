@@ -0,0 +1,550 @@
+#ifndef NETWORK_SIMULATOR_H
+#define NETWORK_SIMULATOR_H
+
+// Discrete-event network simulator shared by the Lamport (2_Lamport.cpp), Ring
+// (4_RING.cpp) and Bully (5_BULLY.cpp) programs. Nodes exchange messages over
+// a pluggable link model that decides latency, reordering and loss; events
+// are kept in a radix heap and messages come from a pool, so a single core
+// handles tens of millions of events per second. With more than one partition
+// the nodes are split across threads that advance in lockstep windows as wide
+// as the link model's minimum latency (conservative synchronization).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+struct SimMessage {
+    int type;
+    int from;
+    int to;
+    long long a;
+    long long b;
+};
+
+// Fixed-size free-list allocator for messages. Chunks are never returned to
+// the system until the pool is destroyed.
+class MessagePool {
+public:
+    SimMessage *allocate() {
+        if (freeList.empty()) {
+            chunks.emplace_back(new SimMessage[CHUNK]);
+            SimMessage *chunk = chunks.back().get();
+            for (int i = CHUNK - 1; i >= 0; i--) {
+                freeList.push_back(chunk + i);
+            }
+        }
+        SimMessage *m = freeList.back();
+        freeList.pop_back();
+        return m;
+    }
+
+    void release(SimMessage *m) { freeList.push_back(m); }
+
+private:
+    static const int CHUNK = 4096;
+    std::vector<std::unique_ptr<SimMessage[]>> chunks;
+    std::vector<SimMessage *> freeList;
+};
+
+// Monotone priority queue on 64-bit timestamps. Bucket i holds the keys whose
+// highest bit differing from the last extracted key is bit i - 1, so every
+// key moves to a lower bucket at most 64 times over its life.
+class RadixHeap {
+public:
+    struct Entry {
+        uint64_t key;
+        SimMessage *msg;
+    };
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+    void push(uint64_t key, SimMessage *msg) {
+        int b = bucketOf(key);
+        buckets[b].push_back({ key, msg });
+        count++;
+        if (b > 0 && b <= minBucket && minBucket != NO_BUCKET) {
+            minKey = b < minBucket ? key : std::min(minKey, key);
+            minBucket = b;
+        }
+    }
+
+    // Does not move `last`, so keys between the last popped key and the
+    // current minimum may still be pushed afterwards (the parallel simulator
+    // peeks past the end of a window before the other partitions' messages
+    // for the next window arrive). The minimum of the first non-empty bucket
+    // is cached until that bucket is redistributed.
+    uint64_t topKey() {
+        if (!buckets[0].empty()) {
+            return last;
+        }
+        findMinimum();
+        return minKey;
+    }
+
+    Entry pop() {
+        if (buckets[0].empty()) {
+            findMinimum();
+            last = minKey;
+            std::vector<Entry> &from = buckets[minBucket];
+            minBucket = NO_BUCKET;
+            for (const Entry &e : from) {
+                buckets[bucketOf(e.key)].push_back(e);
+            }
+            from.clear();
+        }
+        Entry e = buckets[0].back();
+        buckets[0].pop_back();
+        count--;
+        return e;
+    }
+
+private:
+    static const int NO_BUCKET = 65;
+
+    int bucketOf(uint64_t key) const { return key == last ? 0 : 64 - __builtin_clzll(key ^ last); }
+
+    void findMinimum() {
+        if (minBucket != NO_BUCKET) {
+            return;
+        }
+        int i = 1;
+        while (buckets[i].empty()) {
+            i++;
+        }
+        minBucket = i;
+        minKey = buckets[i][0].key;
+        for (const Entry &e : buckets[i]) {
+            minKey = std::min(minKey, e.key);
+        }
+    }
+
+    std::vector<Entry> buckets[65];
+    uint64_t last = 0;
+    size_t count = 0;
+    int minBucket = NO_BUCKET;  // first non-empty bucket above 0 once known
+    uint64_t minKey = 0;
+};
+
+// Last arrival time per channel, in an open-addressing table. A channel whose
+// last message has already arrived constrains nothing, so such entries are
+// dropped whenever the table grows and the table stays proportional to the
+// channels with messages in flight rather than to all pairs that ever talked.
+class ChannelTable {
+public:
+    ChannelTable() : keys(16, EMPTY), values(16, 0) {}
+
+    uint64_t &lastArrival(uint64_t channel, uint64_t now) {
+        if ((used + 1) * 2 > keys.size()) {
+            rebuild(now);
+        }
+        size_t mask = keys.size() - 1;
+        size_t i = mix(channel) & mask;
+        while (keys[i] != EMPTY && keys[i] != channel) {
+            i = (i + 1) & mask;
+        }
+        if (keys[i] == EMPTY) {
+            keys[i] = channel;
+            values[i] = 0;
+            used++;
+        }
+        return values[i];
+    }
+
+private:
+    static constexpr uint64_t EMPTY = UINT64_MAX;
+
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        return x ^ (x >> 33);
+    }
+
+    void rebuild(uint64_t now) {
+        std::vector<uint64_t> oldKeys, oldValues;
+        oldKeys.swap(keys);
+        oldValues.swap(values);
+        size_t live = 0;
+        for (size_t i = 0; i < oldKeys.size(); i++) {
+            live += oldKeys[i] != EMPTY && oldValues[i] > now;
+        }
+        size_t capacity = 16;
+        while (capacity < live * 4) {
+            capacity *= 2;
+        }
+        keys.assign(capacity, EMPTY);
+        values.assign(capacity, 0);
+        used = live;
+        for (size_t i = 0; i < oldKeys.size(); i++) {
+            if (oldKeys[i] != EMPTY && oldValues[i] > now) {
+                size_t j = mix(oldKeys[i]) & (capacity - 1);
+                while (keys[j] != EMPTY) {
+                    j = (j + 1) & (capacity - 1);
+                }
+                keys[j] = oldKeys[i];
+                values[j] = oldValues[i];
+            }
+        }
+    }
+
+    std::vector<uint64_t> keys, values;
+    size_t used = 0;
+};
+
+class SimContext;
+
+// Decides when (and whether) a message sent at `now` arrives. Returns false if
+// the message is lost. minLatencyNs() is the lookahead used by the parallel
+// mode and must be a lower bound of every delivery delay.
+class LinkModel {
+public:
+    virtual ~LinkModel() {}
+    virtual bool transmit(int from, int to, uint64_t now, SimContext &ctx, uint64_t &deliverAt) = 0;
+    virtual uint64_t minLatencyNs() const = 0;
+};
+
+class SimNode {
+public:
+    virtual ~SimNode() {}
+    virtual void onStart(SimContext &) {}
+    virtual void onMessage(SimContext &ctx, const SimMessage &msg) = 0;
+};
+
+// What a node sees while it handles an event. Each partition has its own
+// context, random stream, heap and pool, so handlers never share state.
+class SimContext {
+public:
+    uint64_t now() const { return current; }
+    int self() const { return node; }
+    std::mt19937_64 &rng() { return random; }
+
+    // Per-channel state for link models that need it (e.g. FIFO ordering).
+    // Channels are owned by the sender's partition.
+    ChannelTable &channelState() { return channels; }
+
+    void send(int to, int type, long long a = 0, long long b = 0);
+
+    // Delivers a message to the current node itself after delayNs, bypassing
+    // the link model. Used for timers.
+    void schedule(uint64_t delayNs, int type, long long a = 0, long long b = 0) {
+        SimMessage *m = pool.allocate();
+        *m = { type, node, node, a, b };
+        heap.push(current + std::max<uint64_t>(delayNs, 1), m);
+    }
+
+private:
+    friend class NetworkSimulator;
+
+    struct Remote {
+        uint64_t time;
+        SimMessage msg;
+    };
+
+    class NetworkSimulator *sim = nullptr;
+    int partition = 0;
+    int node = -1;
+    uint64_t current = 0;
+    std::mt19937_64 random;
+    ChannelTable channels;
+    RadixHeap heap;
+    MessagePool pool;
+    std::vector<std::vector<Remote>> outbox;  // per destination partition
+    uint64_t events = 0, messages = 0, dropped = 0;
+};
+
+struct SimStats {
+    uint64_t events;
+    uint64_t messages;
+    uint64_t dropped;
+    uint64_t endTimeNs;
+    double wallMs;
+};
+
+class NetworkSimulator {
+public:
+    NetworkSimulator(LinkModel &link, int partitions = 1, uint64_t seed = 1)
+        : link(link), contexts(std::max(partitions, 1)) {
+        for (size_t p = 0; p < contexts.size(); p++) {
+            contexts[p].sim = this;
+            contexts[p].partition = p;
+            contexts[p].random.seed(seed + p);
+            contexts[p].outbox.resize(contexts.size());
+        }
+    }
+
+    // Nodes are numbered in the order they are added.
+    int addNode(SimNode *node) {
+        nodes.push_back(node);
+        return nodes.size() - 1;
+    }
+
+    int size() const { return nodes.size(); }
+
+    // Calls onStart on every node at time 0, then runs until no event is left
+    // or the next event is later than untilNs.
+    SimStats run(uint64_t untilNs = UINT64_MAX) {
+        auto start = std::chrono::steady_clock::now();
+        int parts = contexts.size();
+        owner.resize(nodes.size());
+        for (size_t i = 0; i < nodes.size(); i++) {
+            owner[i] = (long long)i * parts / nodes.size();
+        }
+        if (parts == 1) {
+            runSequential(untilNs);
+        } else {
+            runParallel(untilNs);
+        }
+
+        SimStats stats = { 0, 0, 0, 0, 0.0 };
+        for (SimContext &c : contexts) {
+            stats.events += c.events;
+            stats.messages += c.messages;
+            stats.dropped += c.dropped;
+            stats.endTimeNs = std::max(stats.endTimeNs, c.current);
+        }
+        stats.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+
+private:
+    friend class SimContext;
+
+    void deliver(SimContext &c, int to, uint64_t at, const SimMessage &msg) {
+        int p = owner[to];
+        if (p == c.partition) {
+            SimMessage *m = c.pool.allocate();
+            *m = msg;
+            c.heap.push(at, m);
+        } else {
+            c.outbox[p].push_back({ at, msg });
+        }
+    }
+
+    void startNodes(SimContext &c) {
+        for (size_t i = 0; i < nodes.size(); i++) {
+            if (owner[i] == c.partition) {
+                c.node = i;
+                nodes[i]->onStart(c);
+            }
+        }
+    }
+
+    // Handles every local event earlier than windowEnd (and not after untilNs).
+    void processUntil(SimContext &c, uint64_t windowEnd, uint64_t untilNs) {
+        while (!c.heap.empty()) {
+            uint64_t t = c.heap.topKey();
+            if (t >= windowEnd || t > untilNs) {
+                break;
+            }
+            RadixHeap::Entry e = c.heap.pop();
+            c.current = e.key;
+            c.node = e.msg->to;
+            c.events++;
+            nodes[c.node]->onMessage(c, *e.msg);
+            c.pool.release(e.msg);
+        }
+    }
+
+    void runSequential(uint64_t untilNs) {
+        SimContext &c = contexts[0];
+        startNodes(c);
+        processUntil(c, UINT64_MAX, untilNs);
+    }
+
+    // Conservative windows: all partitions agree on the earliest pending event
+    // t, handle everything before t + lookahead, then swap the messages that
+    // crossed partitions. Nothing sent inside a window can land inside it.
+    void runParallel(uint64_t untilNs) {
+        int parts = contexts.size();
+        uint64_t lookahead = std::max<uint64_t>(link.minLatencyNs(), 1);
+        std::vector<uint64_t> nextEvent(parts, UINT64_MAX);
+        SpinBarrier barrier(parts);
+
+        // Two barriers per window: after the first every outbox is complete and
+        // can be drained, after the second every partition has published its
+        // next event time and nobody reads the outboxes any more.
+        auto worker = [&](int p) {
+            SimContext &c = contexts[p];
+            startNodes(c);
+            while (true) {
+                barrier.wait();
+                for (int q = 0; q < parts; q++) {
+                    for (const SimContext::Remote &r : contexts[q].outbox[p]) {
+                        SimMessage *m = c.pool.allocate();
+                        *m = r.msg;
+                        c.heap.push(r.time, m);
+                    }
+                }
+                nextEvent[p] = c.heap.empty() ? UINT64_MAX : c.heap.topKey();
+                barrier.wait();
+                for (int q = 0; q < parts; q++) {
+                    c.outbox[q].clear();
+                }
+                uint64_t earliest = *std::min_element(nextEvent.begin(), nextEvent.end());
+                if (earliest == UINT64_MAX || earliest > untilNs) {
+                    break;
+                }
+                processUntil(c, earliest + lookahead, untilNs);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (int p = 1; p < parts; p++) {
+            threads.emplace_back(worker, p);
+        }
+        worker(0);
+        for (std::thread &t : threads) {
+            t.join();
+        }
+    }
+
+    // Sense-reversing barrier that spins briefly and then yields.
+    class SpinBarrier {
+    public:
+        explicit SpinBarrier(int parties) : parties(parties), waiting(0), phase(0) {}
+
+        void wait() {
+            int current = phase.load();
+            if (waiting.fetch_add(1) + 1 == parties) {
+                waiting.store(0);
+                phase.fetch_add(1);
+                return;
+            }
+            for (int spins = 0; phase.load() == current; spins++) {
+                if (spins > 64) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+    private:
+        int parties;
+        std::atomic<int> waiting;
+        std::atomic<int> phase;
+    };
+
+    LinkModel &link;
+    std::vector<SimContext> contexts;
+    std::vector<SimNode *> nodes;
+    std::vector<int> owner;  // partition of each node
+};
+
+inline void SimContext::send(int to, int type, long long a, long long b) {
+    messages++;
+    uint64_t at;
+    if (!sim->link.transmit(node, to, current, *this, at)) {
+        dropped++;
+        return;
+    }
+    sim->deliver(*this, to, at, SimMessage{ type, node, to, a, b });
+}
+
+// Every message takes exactly latencyNs.
+class FixedLatencyLink : public LinkModel {
+public:
+    explicit FixedLatencyLink(uint64_t latencyNs) : latencyNs(latencyNs) {}
+
+    bool transmit(int, int, uint64_t now, SimContext &, uint64_t &deliverAt) override {
+        deliverAt = now + latencyNs;
+        return true;
+    }
+
+    uint64_t minLatencyNs() const override { return latencyNs; }
+
+private:
+    uint64_t latencyNs;
+};
+
+// Latency uniform in [minNs, maxNs]; messages on a channel can overtake each
+// other.
+class JitterLink : public LinkModel {
+public:
+    JitterLink(uint64_t minNs, uint64_t maxNs) : minNs(minNs), spanNs(maxNs - minNs + 1) {}
+
+    bool transmit(int, int, uint64_t now, SimContext &ctx, uint64_t &deliverAt) override {
+        deliverAt = now + minNs + ctx.rng()() % spanNs;
+        return true;
+    }
+
+    uint64_t minLatencyNs() const override { return minNs; }
+
+private:
+    uint64_t minNs, spanNs;
+};
+
+// Wraps another link and drops each message with the given probability.
+class LossyLink : public LinkModel {
+public:
+    LossyLink(LinkModel &inner, double lossRate) : inner(inner), lossRate(lossRate) {}
+
+    bool transmit(int from, int to, uint64_t now, SimContext &ctx, uint64_t &deliverAt) override {
+        if ((ctx.rng()() >> 11) * (1.0 / 9007199254740992.0) < lossRate) {
+            return false;
+        }
+        return inner.transmit(from, to, now, ctx, deliverAt);
+    }
+
+    uint64_t minLatencyNs() const override { return inner.minLatencyNs(); }
+
+private:
+    LinkModel &inner;
+    double lossRate;
+};
+
+// Wraps another link and keeps every channel FIFO: a message never arrives
+// before (or together with) the previous message on the same channel.
+class FifoLink : public LinkModel {
+public:
+    explicit FifoLink(LinkModel &inner) : inner(inner) {}
+
+    bool transmit(int from, int to, uint64_t now, SimContext &ctx, uint64_t &deliverAt) override {
+        if (!inner.transmit(from, to, now, ctx, deliverAt)) {
+            return false;
+        }
+        uint64_t &lastArrival = ctx.channelState().lastArrival(((uint64_t)(uint32_t)from << 32) | (uint32_t)to, now);
+        deliverAt = std::max(deliverAt, lastArrival + 1);
+        lastArrival = deliverAt;
+        return true;
+    }
+
+    uint64_t minLatencyNs() const override { return inner.minLatencyNs(); }
+
+private:
+    LinkModel &inner;
+};
+
+// Builds one of the standard link models from a menu choice:
+// 1 = fixed, 2 = jitter (reordering), 3 = jitter with FIFO channels,
+// 4 = jitter with 1% loss.
+class LinkModelChoice {
+public:
+    LinkModelChoice(int choice, uint64_t latencyNs) {
+        if (choice == 1) {
+            base.reset(new FixedLatencyLink(latencyNs));
+            link = base.get();
+            return;
+        }
+        base.reset(new JitterLink(latencyNs / 2, latencyNs * 3 / 2));
+        link = base.get();
+        if (choice == 3) {
+            wrapper.reset(new FifoLink(*base));
+            link = wrapper.get();
+        } else if (choice == 4) {
+            wrapper.reset(new LossyLink(*base, 0.01));
+            link = wrapper.get();
+        }
+    }
+
+    LinkModel &get() { return *link; }
+
+private:
+    std::unique_ptr<LinkModel> base, wrapper;
+    LinkModel *link;
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// Fork-join pool shared by the Ring (4_RING.cpp) and Bully (5_BULLY.cpp)
+// programs: the ring shards concurrent elections over it, the bully
+// simulation delivers each round of messages on it.
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that run one parallel loop at a time. The range
+// [0, count) is cut into one contiguous block per worker, and the worker index
+// is passed along so callers can keep per-worker accumulators or buffers.
+class ThreadPool {
+public:
+    typedef std::function<void(int worker, int begin, int end)> Body;
+
+    explicit ThreadPool(int threads) : threadCount(std::max(threads, 1)) {
+        for (int w = 0; w < threadCount; w++) {
+            workers.emplace_back(&ThreadPool::workerLoop, this, w);
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &t : workers) {
+            t.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int size() const { return threadCount; }
+
+    void parallelFor(int count, const Body &body) {
+        std::unique_lock<std::mutex> lock(m);
+        job = &body;
+        jobCount = count;
+        pending = threadCount;
+        generation++;
+        wake.notify_all();
+        finished.wait(lock, [this] { return pending == 0; });
+        job = nullptr;
+    }
+
+private:
+    void workerLoop(int w) {
+        long long seen = 0;
+        while (true) {
+            const Body *body;
+            int count;
+            {
+                std::unique_lock<std::mutex> lock(m);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+                body = job;
+                count = jobCount;
+            }
+            int begin = (long long)count * w / threadCount;
+            int end = (long long)count * (w + 1) / threadCount;
+            if (begin < end) {
+                (*body)(w, begin, end);
+            }
+            std::lock_guard<std::mutex> lock(m);
+            if (--pending == 0) {
+                finished.notify_one();
+            }
+        }
+    }
+
+    int threadCount;
+    std::vector<std::thread> workers;
+    std::mutex m;
+    std::condition_variable wake, finished;
+    const Body *job = nullptr;
+    int jobCount = 0;
+    int pending = 0;
+    long long generation = 0;
+    bool stopping = false;
+};
+
+#endif